@@ -0,0 +1,27 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "common/fs.h"
+
+namespace metafs {
+
+// 目录的create capability: 从目录owner租用的一段inode, 以及尚未写入server的异步create
+// 租约内本client在该目录下创建文件时直接分配租用的inode并返回, 攒批后用batch mknod(prealloc)写入server
+struct CreateCap {
+    std::mutex mutex;
+    metafs_inode_t next_inode = 0; // [next_inode, end_inode)为还没有用掉的inode
+    metafs_inode_t end_inode = 0;
+    uint64_t expire_us = 0; // 租约到期时间(monotonic), 到期后先写入已攒的create再重新租用
+
+    // 尚未写入server的create, 按创建顺序
+    std::vector<std::pair<std::string, mode_t>> entries;
+    std::vector<metafs_inode_t> inodes;
+    std::vector<int> flags; // 创建时的open flags
+
+    int error = 0; // 写入失败的第一个错误, 由下一个barrier(fsync/close目录)返回
+};
+
+} // end namespace metafs
@@ -4,59 +4,77 @@
 #include <rocksdb/status.h>
 
 #include "common/fs.h"
-#include "common/lrucache.h"
+#include "util/clock_cache.h"
+#include "xxHash/xxhash.h"
 
 using namespace std;
 using namespace rocksdb;
 
-namespace metafs { 
+namespace metafs {
 
-//Client LRU Cache: key = pinode+fname, value = inode+stat
+//Client dentry Cache: key = pinode+fname, value = inode+stat
 struct DirentryValue {
     metafs_inode_t inode;
-    DirentryValue(metafs_inode_t inode = 0) : inode(inode) {}
+    // 负缓存项记录文件不存在: lease到期时间(为0表示正常缓存项), 以及缓存时所在region的create_version
+    uint64_t neg_expire_us;
+    uint64_t neg_version;
+    // readdirplus/stat得到的属性及其lease到期时间, 为0表示没有缓存属性
+    uint64_t attr_expire_us;
+    metafs_stat_t stat;
+    DirentryValue(metafs_inode_t inode = 0) : inode(inode), neg_expire_us(0), neg_version(0), attr_expire_us(0) {}
+
+    bool is_negative() const {
+        return neg_expire_us != 0;
+    }
+
+    bool has_attr() const {
+        return attr_expire_us != 0;
+    }
 };
 
-// Cache for Directory, use `Cache` to build it.
+// Cache for Directory, use `ClockCache` to build it.
+// key为(pinode, xxh3(fname)低64位), 高64位的低32位作为指纹; 查找时不拼接字符串, 不分配内存
 template<class TEntry>
 class DentryCache {
     public:
-        DentryCache(int capacity) : cache_(new lru11::Cache<string, TEntry>(capacity, capacity >> 2)), cache_miss_cnt(0) { }
+        typedef typename ClockCache<TEntry>::Stats Stats;
+
+        // capacity_bytes: 缓存占用的内存大小
+        DentryCache(size_t capacity_bytes) : cache_(capacity_bytes) { }
 
         ~DentryCache() {
         }
 
         // dir_id + fname -> direntry
         rocksdb::Status Get(const metafs_inode_t dir_id, const string &fname, TEntry *value) {
-            string key = fname;
-            PutFixed64(&key, dir_id);
-            if(cache_->tryGet(key, *value)) {
+            XXH128_hash_t h = XXH3_128bits(fname.data(), fname.size());
+            if(cache_.Get(dir_id, h.low64, (uint32_t)h.high64, value)) {
                 return rocksdb::Status::OK();
             }
             return rocksdb::Status::NotFound();
         }
 
         rocksdb::Status Put(const metafs_inode_t dir_id, const string &fname, const TEntry &value) {
-            string key = fname;
-            PutFixed64(&key, dir_id);
-            TEntry value_copy(value);
-            cache_->insert(key, value_copy);
+            XXH128_hash_t h = XXH3_128bits(fname.data(), fname.size());
+            cache_.Put(dir_id, h.low64, (uint32_t)h.high64, value);
             return rocksdb::Status::OK();
         }
 
-        int cache_miss_cnt_incr() {
-            return ++cache_miss_cnt;
+        rocksdb::Status Erase(const metafs_inode_t dir_id, const string &fname) {
+            XXH128_hash_t h = XXH3_128bits(fname.data(), fname.size());
+            if(cache_.Erase(dir_id, h.low64, (uint32_t)h.high64)) {
+                return rocksdb::Status::OK();
+            }
+            return rocksdb::Status::NotFound();
         }
 
-        static inline void PutFixed64(std::string* dst, uint64_t value) {
-            char buf[sizeof(value)];
-            memcpy(buf, &value, sizeof(value));
-            dst->append(buf, sizeof(buf));
+        // hit/miss/eviction计数
+        Stats GetStats() {
+            return cache_.GetStats();
         }
 
     private:
-        lru11::Cache<string, TEntry> *cache_;
-        int cache_miss_cnt;
+        ClockCache<TEntry> cache_;
 };
 
-} // end namespace metaf
+} // end namespace metafs
@@ -2,6 +2,7 @@
 
 #include "common/fs.h"
 #include "client/dentry_cache.h"
+#include "client/region_route.h"
 #include "common/region.h"
 #include "rpc/rpc_common.h"
 
@@ -10,6 +11,10 @@
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unordered_map>
+#include <memory>
+#include <map>
+#include <mutex>
+#include <atomic>
 
 struct statfs;
 struct linux_dirent;
@@ -45,19 +50,34 @@ struct client_config {
     // memcached server ip and port
     char *memcached_ip;
     int32_t memcached_port;
-};
 
-// 客户端查询一个key属于哪个region,查询时将key抓换为 <key, key> pair 进行范围查询
-// 测试在test/region_test.cc
-struct region_cmp_func {
-    bool operator()(const ClientRegion &lhs, const ClientRegion &rhs) const {
-        return lhs.end_key.hi < rhs.start_key.hi;
-    }
+    // dentry cache占用的内存大小, 单位为字节
+    int32_t dentry_cache_size;
+    // 负缓存(文件不存在)的lease, 单位为毫秒, 为0时不缓存
+    int32_t negative_dentry_timeout_ms;
+    // 打开的文件缓存的stat的有效期, 单位为毫秒, 为0时一直有效直到close(close-to-open一致性)
+    int32_t attr_timeout_ms;
+    // dentry cache中缓存的文件属性(stat)的lease, 单位为毫秒; 大于0时readdir使用readdirplus同时获取属性
+    int32_t dentry_attr_timeout_ms;
+    // 异步create每次向server租用的inode数, 为0时不使用异步create; 租约时长由server的create_cap_lease_ms决定
+    int32_t async_create_inodes;
 };
 
-// 客户端的region按照regionkey排序
-// 根据博客测试，使用map的包装的find()速度不如顺序查找，所以目前在客户端定位region仍然采用顺序查找
-typedef std::map<ClientRegion, region_id_t, region_cmp_func> region_map_t;
+// client记录的region create_version槽位数, 按region_id取模
+// 每个槽位把region_id的高位和create_version打包在一个uint64中: 槽位中是其他region时视为无效,
+// 同一region只保留更大的版本(迟到的旧响应不会覆盖), 冲突只会使负缓存提前失效
+const int32_t kRegionVersionSlots = 1024;
+const int kRegionVersionBits = 42; // create_version占低42位
+const uint64_t kRegionVersionMask = (1ULL << kRegionVersionBits) - 1;
+const uint64_t kInvalidRegionVersion = ~0ULL;
+
+static inline int32_t get_region_version_slot(region_id_t region_id) {
+    return region_id & (kRegionVersionSlots - 1);
+}
+
+static inline uint64_t get_region_version_tag(region_id_t region_id) {
+    return (uint64_t)((uint32_t)region_id / kRegionVersionSlots) << kRegionVersionBits;
+}
 
 struct client_context {
     int32_t id;
@@ -65,32 +85,72 @@ struct client_context {
     erpc::Nexus *nexus_;
     DentryCache<DirentryValue> *dentry_cache;
 
-    erpc::Rpc<erpc::CTransport> *rpc_;
     int32_t total_servers;
+    // 下一个新建的线程rpc context使用的rpc_id, 不超过client_threads
+    std::atomic<int32_t> next_rpc_id;
+    // 已退出线程留下的rpc context, 之后创建的线程优先复用(连同其rpc_id)
+    std::mutex rpc_ctx_mutex;
+    std::vector<struct client_rpc_context *> free_rpc_ctxs;
+
+    // 保护route_table, region_map和synced_map_epoch的更新
+    std::mutex region_map_mutex;
+    // region路由表, 每次读取region map后整体替换, 替换后route_version加1
+    std::shared_ptr<const RegionRouteTable> route_table;
+    std::atomic<uint64_t> route_version;
+    // 本地region map, 增量读取的region按region_id合并
+    std::map<region_id_t, ClientRegion> region_map;
+    // 每个server进程维护一份region map: 本地已同步到的epoch, 以及响应中看到的最新epoch
+    std::vector<std::atomic<uint64_t>> synced_map_epoch;
+    std::vector<std::atomic<uint64_t>> seen_map_epoch;
+    // 每个region响应中看到的最大create_version(打包了region_id, 见get_region_version_tag),
+    // 与负缓存项中记录的不同时该负缓存项失效
+    std::atomic<uint64_t> region_create_version[kRegionVersionSlots];
+};
+
+// 每个线程一个rpc context, 线程第一次发送rpc时创建: 独立的erpc::Rpc, rpc_id, session以及msgbuf window
+// 线程退出时销毁erpc::Rpc, context放回c_ctx->free_rpc_ctxs由之后的线程复用, 同时存在的线程数不超过client_threads
+struct client_rpc_context {
+    int32_t rpc_id;
+    erpc::Rpc<erpc::CTransport> *rpc_;
     std::vector<int> session_num_vec_;
     int num_sm_resps_;
 
-    region_map_t region_map;
-
+    // 每个window同时只承载一个在途请求, 异步rpc的句柄即window下标
     struct {
         erpc::MsgBuffer req_msgbuf_;
         erpc::MsgBuffer resp_msgbuf_;
+        bool complete;
+        int32_t server_session_id;
+        region_id_t region_id;
+        uint32_t seq; // 每次分配时递增, 句柄加上seq才能唯一确定一个请求
+        std::atomic<uint32_t> abandoned_seq; // 其他线程放弃了该seq的请求, 由本线程回收; window复用后旧的标记不再匹配
     } window_[MAX_MSG_BUF_WINDOW];
+    uint32_t busy_windows; // 已分配window的bitmap
+    uint32_t prefetch_windows; // 其中用于目录预取的window, 预取数有上限, 保证batch流水线总有window可用
+};
+
+// 每个线程缓存一份路由表, route_version变化时才加锁重新获取
+struct route_table_cache {
+    std::shared_ptr<const RegionRouteTable> table;
+    uint64_t version;
 };
 
 extern struct client_config *c_cfg;
 
 extern struct client_context *c_ctx;
 
-// return -1 if not find, else return region id the regionkey belong to
-// 目前使用顺序查找，可以考虑使用find()函数
-static inline region_id_t find_region_id(const RegionKey &regionkey) {
-    for(auto iter = c_ctx->region_map.begin(); iter != c_ctx->region_map.end(); iter++) {
-        if(regionkey.hi >= iter->first.start_key.hi && regionkey.hi <= iter->first.end_key.hi) {
-            return iter->second;
-        }
+extern thread_local struct client_rpc_context *c_rpc_ctx;
+
+extern thread_local struct route_table_cache c_route_cache;
+
+// return nullptr if not find, else return the route of the region the pinode_hash belong to
+static inline const RegionRoute *find_region_route(uint64_t pinode_hash) {
+    if(unlikely(c_route_cache.version != c_ctx->route_version.load(std::memory_order_acquire))) {
+        std::lock_guard<std::mutex> lock(c_ctx->region_map_mutex);
+        c_route_cache.table = c_ctx->route_table;
+        c_route_cache.version = c_ctx->route_version.load();
     }
-    return -1;// not find
+    return c_route_cache.table ? c_route_cache.table->find(pinode_hash) : nullptr;
 }
 
 void init_client_ctx();
@@ -9,12 +9,14 @@
 #include "rpc/rpc_client.h"
 #include "client/dentry_cache.h"
 #include "common/fs.h"
-#include "common/lrucache.h"
 #include "util/jump_hash.h"
 #include "client/open_file_map.h"
 #include "client/open_dir.h"
+#include "client/create_cap.h"
 #include "client/hooks.h"
 
+#include <unordered_map>
+
 using namespace std;
 
 #define METAFS_CLIENT (MetaClient::get_Instance())
@@ -30,9 +32,21 @@ class MetaClient{
             return &client; 
         }
 
-        MetaClient() : ofm_(std::make_shared<OpenFileMap>()) { }
+        MetaClient() : rpc_client_(nullptr), ofm_(std::make_shared<OpenFileMap>()), num_create_caps_(0),
+                       next_cap_expire_us_(UINT64_MAX) { }
 
         ~MetaClient() {
+            if(rpc_client_ != nullptr) {
+                // 进程退出前写入所有异步create
+                flush_all_creates();
+            }
+#ifdef USE_CACHE
+            if(c_ctx != nullptr && c_ctx->dentry_cache != nullptr) {
+                auto stats = c_ctx->dentry_cache->GetStats();
+                LOG(INFO) << "dentry cache hits: " << stats.hits << ", misses: " << stats.misses
+                          << ", evictions: " << stats.evictions << ", entries: " << stats.entries;
+            }
+#endif
             delete rpc_client_;
         };
 
@@ -55,10 +69,30 @@ class MetaClient{
 
         int Mknod(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat);
 
+        // 同一目录下批量创建文件, 每个rpc携带多个文件, 多个rpc流水线发送
+        // rets[i]为第i个文件的返回值: 0, -EEXIST或-EIO; 成功时inodes[i]为其inode
+        // prealloc_inodes不为空时使用其中从server租用的inode
+        void Mknod_batch(metafs_inode_t pinode, const vector<pair<string, mode_t>> &entries,
+                         vector<metafs_inode_t> &inodes, vector<int> &rets,
+                         const vector<metafs_inode_t> *prealloc_inodes = nullptr);
+
         int Open(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat);
 
+        // open(O_CREAT)的普通文件, 一次RPC完成打开或创建
+        // 持有目录的create capability时不等待RPC, 使用租用的inode异步创建, 见async_create
+        // 返回0成功, -EEXIST(O_EXCL且已存在), -EISDIR(已存在的是目录)
+        int OpenCreate(metafs_inode_t pinode, const string &fname, mode_t mode, int flags,
+                       metafs_inode_t &inode, metafs_stat_t &stat);
+
         int Unlink(metafs_inode_t pinode, const string &fname);
 
+        // 批量stat/unlink同一目录下的文件, 请求通过异步rpc流水线发送
+        // rets[i]为第i个文件的返回值, 与Getstat/Unlink相同
+        void Getstat_batch(metafs_inode_t pinode, const vector<string> &fnames, vector<metafs_inode_t> &inodes,
+                           vector<metafs_stat_t> &stats, vector<int> &rets);
+
+        void Unlink_batch(metafs_inode_t pinode, const vector<string> &fnames, vector<int> &rets);
+
         // TODO: need to redo.
         // int Rename(const string &src, const string &target);
 
@@ -66,7 +100,16 @@ class MetaClient{
 
         int Mkdir(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat);
 
-        int Readdir(metafs_inode_t dir_inode, shared_ptr<OpenDir> &open_dir);
+        // O_DIRECTORY打开目录, 一次RPC获取目录的stat, 通常同时获取第一页entry
+        // 返回0成功, -ENOENT, -ENOTDIR
+        int Opendir(const string &path, metafs_inode_t pinode, const string &fname, shared_ptr<OpenDir> &open_dir);
+
+        // 按需读取目录: 保证位置pos的entry已在open_dir的当前页中, pos超过目录末尾时返回1
+        // 调用者需持有open_dir->dir_mutex()
+        int Readdir(shared_ptr<OpenDir> &open_dir, unsigned long pos);
+
+        // 关闭目录时放弃预取的页
+        void Releasedir(shared_ptr<OpenDir> &open_dir);
 
         int Rmdir(metafs_inode_t pinode, const string &fname);
 
@@ -78,18 +121,78 @@ class MetaClient{
 
         int ReadRegionmap();
 
+        // durability barrier: 把目录pinode下的异步create写入server, 返回之前写入失败的第一个错误
+        // take_error为false时只写入, 错误留给之后的barrier返回; flushed不为空时返回是否有未写入的create
+        int flush_creates(metafs_inode_t pinode, bool take_error = true, bool *flushed = nullptr);
+
+        int flush_all_creates(bool take_error = true);
+
         // return if need to retry
         bool handle_rpc_resp(rpc_resp_t res, const char *rpc_info);
  
     private:
 
+        int read_dir_page(shared_ptr<OpenDir> &open_dir);
+
+        void release_dir_prefetch(shared_ptr<OpenDir> &open_dir);
+
+        bool can_prefetch_dir();
+
+        // 使用租用的inode创建文件并立即返回, 不能异步创建时返回false
+        bool async_create(metafs_inode_t pinode, const string &fname, mode_t mode, int flags,
+                          metafs_inode_t &inode, metafs_stat_t &stat);
+
+        // 需要持有cap.mutex
+        void flush_cap_locked(metafs_inode_t pinode, CreateCap &cap);
+
+        // 写入所有租约已到期的异步create
+        void flush_expired_creates();
+
+        void note_cap_expire(uint64_t expire_us);
+
+        // 有异步create的租约到期时写入, 由每个访问目录的操作调用
+        void check_cap_expire() {
+            if(unlikely(get_monotonic_us() >= next_cap_expire_us_.load(std::memory_order_relaxed))) {
+                flush_expired_creates();
+            }
+        }
+
+        // 访问目录pinode之前调用, 保证本client之前的异步create对server可见
+        void sync_creates(metafs_inode_t pinode) {
+            if(num_create_caps_.load(std::memory_order_relaxed) > 0) {
+                flush_creates(pinode, false);
+                check_cap_expire();
+            }
+        }
+
         // Parse the `path` to get target file's pinode and fname.
         rocksdb::Status Internal_ResolvePath(const string &path, metafs_inode_t &pinode, string &fname, int* depth);
 
+#ifdef USE_CACHE
+        // 负缓存项存在且有效时返回true, 失效的负缓存项会被删除
+        bool lookup_negative_dentry(metafs_inode_t pinode, const string &fname);
+
+        // server返回kENOENT后缓存一个负缓存项
+        void insert_negative_dentry(metafs_inode_t pinode, const string &fname);
+
+        // dentry cache中有未过期的属性时返回true
+        bool lookup_dentry_attr(metafs_inode_t pinode, const string &fname, metafs_inode_t &inode, metafs_stat_t &stat);
+
+        // 缓存readdirplus/stat/open得到的属性, lease为dentry_attr_timeout_ms
+        void insert_dentry_attr(metafs_inode_t pinode, const string &fname, metafs_inode_t inode, const metafs_stat_t &stat);
+#endif
+
         RpcClient *rpc_client_;
 
         // file descriptors table, use a hashmap to store it
         std::shared_ptr<OpenFileMap> ofm_;
+
+        // 目录inode -> create capability, 只增不删
+        std::mutex create_caps_mutex_;
+        std::unordered_map<metafs_inode_t, std::shared_ptr<CreateCap>> create_caps_;
+        std::atomic<int32_t> num_create_caps_;
+        // 有未写入create的cap中最早的租约到期时间, 没有时为UINT64_MAX
+        std::atomic<uint64_t> next_cap_expire_us_;
 };
 
 } // end namaspace metafs
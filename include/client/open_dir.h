@@ -2,39 +2,75 @@
 
 #include <string>
 #include <vector>
+#include <mutex>
 
 #include "client/open_file_map.h"
 #include "common/fs.h"
 
 namespace metafs {
 
-class DirEntry {
-private:
-    std::string name_;
-    FileType type_;
-    metafs_inode_t inode_;
-public:
-    DirEntry(const std::string& name, FileType type, metafs_inode_t inode);
+// 当前页中一个entry的定长记录, 名字存放在OpenDir::names_中
+struct DirEntry {
+    uint32_t name_off; // 名字在names_中的偏移
+    uint32_t name_len; // 名字长度, 不含'\0'
+    FileType type;
+    metafs_inode_t inode;
+};
 
-    const std::string& name();
+struct client_rpc_context;
 
-    FileType type();
+// 目录的读取游标: 按页从server读取, 每页读取后异步预取下一页
+struct ReaddirCursor {
+    uint64_t next_offset = 0; // 下一页在server端的offset
+    bool eof = false; // 已读取到最后一页
+    int32_t prefetch_handle = -1; // 预取下一页的异步rpc句柄, -1表示没有预取
+    client_rpc_context *prefetch_owner = nullptr; // 发起预取的线程的rpc context, 句柄只能在该线程使用
+    uint32_t prefetch_seq = 0; // 预取所在window的seq, 线程退出后context被复用时旧句柄不再匹配
 };
 
+// 打开的目录只保存当前一页的entry, 由getdents按需读取, 内存占用与目录大小无关
 class OpenDir : public OpenFile {
 private:
+    // 当前页: 所有名字连续存放在names_中(end with '\0'), 换页时只清空不释放, 不为每个entry分配内存
+    std::vector<char> names_;
     std::vector<DirEntry> entries;
+    unsigned long base_pos_; // entries[0]在目录中的位置
+    ReaddirCursor cursor_;
+    std::mutex dir_mutex_;
 
 public:
-    explicit OpenDir(const std::string& path, metafs_inode_t pinode, const std::string& fname, metafs_inode_t inode);
+    explicit OpenDir(const std::string& path, metafs_inode_t pinode, const std::string& fname, metafs_inode_t inode,
+                     const metafs_stat_t &stat);
+
+    // name_len不含'\0'
+    void add(const char *name, size_t name_len, FileType type, metafs_inode_t inode);
+
+    // pos为目录中的位置, 需要contains(pos)
+    const DirEntry& getdent(unsigned long pos) const {
+        return entries[pos - base_pos_];
+    }
 
-    void add(const std::string& name, const FileType& type, metafs_inode_t inode);
+    // entry的名字(end with '\0'), 换页前有效
+    const char *name(const DirEntry &de) const {
+        return names_.data() + de.name_off;
+    }
 
-    const DirEntry& getdent(unsigned int pos);
+    bool contains(unsigned long pos) const;
+
+    // 丢弃当前页, 下一页从base_pos开始
+    void reset_page(unsigned long base_pos);
 
     void clearEntries();
 
+    // 当前页的entry数
     size_t size();
+
+    unsigned long base_pos() const;
+
+    // 以下需要持有dir_mutex
+    ReaddirCursor &cursor();
+
+    std::mutex &dir_mutex();
 };
 
 } // end namespace metafs
\ No newline at end of file
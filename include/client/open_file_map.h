@@ -5,6 +5,7 @@
 #include <mutex>
 #include <memory>
 #include <atomic>
+#include <vector>
 
 #include "common/fs.h"
 
@@ -33,21 +34,26 @@ class OpenFile {
 protected:
     FileType type_;
     std::string path_;
-    metafs_inode_t inode_; // 文件自身的inode
+    std::atomic<metafs_inode_t> inode_; // 文件自身的inode, 异步create的文件在server上已存在时会被替换
     std::array<bool, static_cast<int>(OpenFile_flags::flag_count)> flags_ = {{false}};
-    unsigned long pos_;
-    std::mutex pos_mutex_;
+    std::atomic<unsigned long> pos_; // dup出的多个fd共享同一个位置
     std::mutex flag_mutex_;
 
     metafs_inode_t pinode_; // parent inode
     std::string fname_; // file_name
     // metafs_inode_t inode; // itself inode
 
+    // open/create时server返回的stat, fstat直接使用(close-to-open一致性), 不需要RPC
+    metafs_stat_t stat_;
+    uint64_t stat_time_us_; // stat_的获取时间
+    std::mutex stat_mutex_;
+
 public:
     // multiple threads may want to update the file position if fd has been duplicated by dup()
 
     OpenFile(const std::string& path, int flags, metafs_inode_t pinode, 
-                const std::string &fname, metafs_inode_t inode, FileType type = FileType::regular);
+                const std::string &fname, metafs_inode_t inode, const metafs_stat_t &stat,
+                FileType type = FileType::regular);
 
     ~OpenFile() = default;
 
@@ -57,6 +63,8 @@ public:
 
     unsigned long pos();
     void pos(unsigned long pos_);
+    // 原子地移动位置, 返回移动后的位置
+    unsigned long advance_pos(long off);
 
     // get pinode
     metafs_inode_t pinode();
@@ -64,6 +72,13 @@ public:
     // get fname
     std::string &fname();
 
+    metafs_inode_t inode() const;
+    void inode(metafs_inode_t inode);
+
+    // 缓存的stat获取时间未超过timeout_us时返回true, timeout_us为0表示一直有效直到close
+    bool get_stat(metafs_stat_t &stat, uint64_t timeout_us);
+    void set_stat(const metafs_stat_t &stat);
+
     bool get_flag(OpenFile_flags flag);
     void set_flag(OpenFile_flags flag, bool value);
 
@@ -71,28 +86,62 @@ public:
 };
 
 
+// 同时打开的文件数上限, fd的范围为[START_FD, START_FD + kMaxOpenFiles)
+const int kMaxOpenFiles = 1 << 16;
+
+// 定长数组实现的fd表, 下标为fd - START_FD
+// 槽位通过原子指针发布, get/exist不加锁(wait-free); close摘下的槽位由EBR在所有读者退出后释放
+// 空闲槽位用bitmap记录, fd会被复用
 class OpenFileMap {
 
 private:
-    std::unordered_map<int, std::shared_ptr<OpenFile>> files_;
-    std::recursive_mutex files_mutex_;
-
-    int safe_generate_fd_idx_();
+    // 每个槽位指向一个持有OpenFile的shared_ptr, 为空表示fd未使用
+    typedef std::shared_ptr<OpenFile> FileRef;
+    std::atomic<FileRef *> *slots_;
+
+    static const int kBitmapWords = kMaxOpenFiles / 64;
+    // 已分配槽位的bitmap, 先分配槽位再发布指针, 先摘下指针再释放槽位
+    std::atomic<uint64_t> used_bits_[kBitmapWords];
+    std::atomic<int> next_word_; // 下一次分配开始查找的位置
+
+    // replace_inode时还没有建立fd的文件(create返回后、add之前被其他线程写入server), 在add时替换
+    struct ReplacedInode {
+        metafs_inode_t pinode;
+        std::string fname;
+        metafs_inode_t leased_inode;
+        metafs_inode_t inode;
+        metafs_stat_t stat;
+    };
+    std::mutex replaced_mutex_;
+    std::vector<ReplacedInode> replaced_;
+    std::atomic<int> num_replaced_;
+
+    // open_file是replaced_中记录的文件时替换inode和stat, 并删除该记录
+    void apply_replaced(const std::shared_ptr<OpenFile> &open_file);
 
     /*
      * TODO: Setting our file descriptor index to a specific value is dangerous because we might clash with the kernel.
      * E.g., if we would passthrough and not intercept and the kernel assigns a file descriptor but we will later use
      * the same fd value, we will intercept calls that were supposed to be going to the kernel. This works the other way around too.
      * To mitigate this issue, we set the initial fd number to a high value. We "hope" that we do not clash but this is no permanent solution.
-     * Note: This solution will probably work well already for many cases because kernel fd values are reused, unlike to ours.
-     * The only case where we will clash with the kernel is, if one process has more than 100000 files open at the same time.
+     * The only case where we will clash with the kernel is, if one process has more than START_FD files open at the same time.
      */
-    int fd_idx;
-    std::mutex fd_idx_mutex;
-    std::atomic<bool> fd_validation_needed;
+    static bool valid_fd(int fd) {
+        return fd >= START_FD && fd < START_FD + kMaxOpenFiles;
+    }
+
+    // 返回分配的槽位, 已满返回-1
+    int alloc_slot();
+    // 标记槽位已分配, 返回之前是否空闲
+    bool claim_slot(int slot);
+    void free_slot(int slot);
+
+    // 在已分配的槽位上发布open_file, 替换掉的旧文件延迟释放
+    void publish(int slot, const std::shared_ptr<OpenFile> &open_file);
 
 public:
     OpenFileMap();
+    ~OpenFileMap();
 
     std::shared_ptr<OpenFile> get(int fd);
 
@@ -100,6 +149,7 @@ public:
 
     bool exist(int fd);
 
+    // 返回新的fd, fd表已满时返回-EMFILE
     int add(std::shared_ptr<OpenFile>);
 
     bool remove(int fd);
@@ -108,9 +158,9 @@ public:
 
     int dup2(int oldfd, int newfd);
 
-    int generate_fd_idx();
-
-    int get_fd_idx();
+    // 异步create写入server时发现文件已存在, 把用租用的inode打开的文件改为server上的inode和stat, 返回更新的文件数
+    int replace_inode(metafs_inode_t pinode, const std::string &fname, metafs_inode_t leased_inode,
+                      metafs_inode_t inode, const metafs_stat_t &stat);
 };
 
 } // end namespace metafs
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+#include "common/common.h"
+#include "common/region.h"
+#include "util/jump_hash.h"
+
+namespace metafs {
+
+// 客户端路由表中的一项, 缓存region对应server线程的session下标, 避免每次op都计算JumpConsistentHash
+struct RegionRoute {
+    uint64_t start_hi;
+    uint64_t end_hi;
+    region_id_t region_id;
+    int32_t session_idx;
+};
+
+// 客户端region路由表: 按start_key.hi排序的扁平数组, 查找时对起始key做无分支二分查找
+// 路由表构建后只读, region map更新时整体重建
+class RegionRouteTable {
+public:
+    RegionRouteTable(const std::vector<ClientRegion> &regions, int32_t total_servers) {
+        routes_.reserve(regions.size());
+        for(auto &r : regions) {
+            int32_t session_idx = r.region_id < total_servers ? r.region_id :
+                                    JumpConsistentHash(r.region_id, total_servers);
+            routes_.push_back(RegionRoute{r.start_key.hi, r.end_key.hi, r.region_id, session_idx});
+        }
+        std::sort(routes_.begin(), routes_.end(), [](const RegionRoute &lhs, const RegionRoute &rhs) {
+            return lhs.start_hi < rhs.start_hi;
+        });
+        // 起始key单独存放, 二分查找时只访问这一段连续内存
+        starts_.reserve(routes_.size());
+        for(auto &r : routes_) {
+            starts_.push_back(r.start_hi);
+        }
+    }
+
+    // return nullptr if not find
+    const RegionRoute *find(uint64_t pinode_hash) const {
+        size_t n = starts_.size();
+        if(unlikely(n == 0)) {
+            return nullptr;
+        }
+        // 找到最后一个start_hi <= pinode_hash的位置, 循环体内没有分支, 编译为cmov
+        const uint64_t *base = starts_.data();
+        while(n > 1) {
+            size_t half = n >> 1;
+            base = (base[half] <= pinode_hash) ? base + half : base;
+            n -= half;
+        }
+        const RegionRoute *route = &routes_[base - starts_.data()];
+        if(pinode_hash < route->start_hi || pinode_hash > route->end_hi) {
+            return nullptr;
+        }
+        return route;
+    }
+
+    size_t size() const {
+        return routes_.size();
+    }
+
+private:
+    std::vector<uint64_t> starts_;
+    std::vector<RegionRoute> routes_;
+};
+
+} // end namespace metafs
@@ -12,6 +12,7 @@
 #include <fcntl.h>
 #include <malloc.h>
 #include <errno.h>
+#include <time.h>
 
 #define BUILD_BUG_ON(condition) ((void)sizeof(char[1 - 2 * !!(condition)]))
 #define likely(x) __builtin_expect(!!(x), 1)
@@ -170,5 +171,12 @@ static inline unsigned long rdtsc(void)
 	return tsc.tsc_64;
 }
 
+static inline uint64_t get_monotonic_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 } // namespace indexfs
 
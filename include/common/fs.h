@@ -5,6 +5,8 @@
 #include <sys/time.h>
 #include <stdint.h>
 
+#include "util/coarse_clock.h"
+
 #define METAFS_MAX_FNAME_LEN 128 // 文件长度最长为128
 #define METAFS_MAGIC 0x19990627
 #define METAFS_BLK_SIZE 40960
@@ -38,21 +40,14 @@ struct metafs_stat_t {
     metafs_stat_t() {}
     
     // 目前用不到oid
+    // gettimeofday开销很大, 使用粗粒度时钟
     metafs_stat_t(mode_t mode) : mode(mode) {
         oid.lo = oid.hi = 0;
-        struct timeval tv; 
-        // gettimeofday(&tv, NULL); // 开销很大
-        mtime = tv.tv_sec;
-        atime = tv.tv_sec;
-        ctime = tv.tv_sec;
+        mtime = atime = ctime = CoarseClock::now();
     }
 
     metafs_stat_t(const oid_t &oid, mode_t mode) : oid(oid), mode(mode) {
-        struct timeval tv; 
-        // gettimeofday(&tv, NULL);
-        mtime = tv.tv_sec;
-        atime = tv.tv_sec;
-        ctime = tv.tv_sec;
+        mtime = atime = ctime = CoarseClock::now();
     }
 };
 
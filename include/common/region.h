@@ -4,19 +4,19 @@
 #include <map>
 #include <atomic>
 
+#include "common/fs.h"
+#include "xxHash/xxhash.h"
+
 using namespace std;
 
 namespace metafs {
 
-// 每个region的初始范围大小
-#define PINODE_HASH_RANGE 1024 // 2^10
-#define FNAME_HASH_RANGE 1024
-
 // region分裂阈值(kv数目最大值)
 const uint32_t region_split_threshold = 200000;
 
 // region key需保证不重叠，是一个左闭右闭区间,
 // 目前只使用hi字段，即只根据pinode的hash值确定属于哪个region; 以只使用hi字段进行region split
+// hi字段覆盖xxhash(pinode)的完整64位值域[0, UINT64_MAX]
 struct RegionKey {
     uint64_t hi; // hi : xxhash(pinode)
     uint64_t low; // low : xxhash(fname)
@@ -45,24 +45,45 @@ struct ServerRegion {
     atomic<int32_t> kv_num; // amount of kvs in this region
     atomic<int32_t> log_id; // 分配给log的序号
     atomic<RegionStatus> region_status; 
+    atomic<uint64_t> create_version; // region内每次创建文件/目录时递增, 随响应返回给client用于使负缓存失效
 
     ServerRegion(region_id_t region_id, const RegionKey& start_key, const RegionKey& end_key)
         :region_id(region_id), left_region_id(0),start_key(start_key), end_key(end_key), 
-            region_status(RegionStatus::Normal), kv_num(0), log_id(0) {}
+            region_status(RegionStatus::Normal), kv_num(0), log_id(0), create_version(0) {}
 
     // 构造一个临时region用来查找，之后需要在客户端单独实现一个region类型
-    ServerRegion(const RegionKey& key) : start_key(key), end_key(key) {}
+    ServerRegion(const RegionKey& key) : start_key(key), end_key(key), create_version(0) {}
 };
 
+// pinode的64位hash值，客户端路由、服务端region检查和pinode_table都使用该值
+static inline uint64_t get_pinode_hash(metafs_inode_t pinode) {
+    return XXH3_64bits(&pinode, sizeof(metafs_inode_t));
+}
+
+// 初始region按照region总数(所有server的前台线程数)等分整个64位hash值域,
+// 第region_id个region负责[start_key.hi, end_key.hi], 最后一个region的end_key.hi为UINT64_MAX
+static inline void get_init_region_range(region_id_t region_id, int32_t num_regions,
+                                         RegionKey &start_key, RegionKey &end_key) {
+    unsigned __int128 hash_space = ((unsigned __int128)1) << 64;
+    start_key = RegionKey(0, (uint64_t)(hash_space * region_id / num_regions));
+    end_key = RegionKey(0, (uint64_t)(hash_space * (region_id + 1) / num_regions - 1));
+}
+
+// region分裂点: 左半部分为[start, split_key], 右半部分为[split_key + 1, end]
+static inline uint64_t get_region_split_key(const RegionKey &start_key, const RegionKey &end_key) {
+    return start_key.hi + (end_key.hi - start_key.hi) / 2;
+}
+
 // 客户端region结构体
 // 服务器端目前使用其用来做全局region缓存，之后需要移到zk
 struct ClientRegion {
     region_id_t region_id;
     RegionKey start_key;
     RegionKey end_key;
+    uint64_t epoch; // 该region最近一次被修改时的region map epoch, 用于增量同步region map
 
-    ClientRegion(region_id_t region_id, const RegionKey& start_key, const RegionKey& end_key)
-        : region_id(region_id), start_key(start_key), end_key(end_key) {}
+    ClientRegion(region_id_t region_id, const RegionKey& start_key, const RegionKey& end_key, uint64_t epoch = 0)
+        : region_id(region_id), start_key(start_key), end_key(end_key), epoch(epoch) {}
 };
 }
 
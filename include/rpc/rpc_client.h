@@ -14,17 +14,23 @@
 
 #include <glog/logging.h>
 #include <rocksdb/cache.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <chrono>
 
-#define C_RPC_CONTEXT_WINDOW(index) (c_ctx->window_[index])
-#define C_RPC_REQ_BUF(index) (reinterpret_cast<wire_req_t *>(C_RPC_CONTEXT_WINDOW(index).req_msgbuf_.buf_))
-#define C_RPC_RESP_BUF(index) (reinterpret_cast<wire_resp_t*>(C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_.buf_))
+#define C_RPC_CONTEXT_WINDOW(rctx, index) ((rctx)->window_[index])
+#define C_RPC_REQ_BUF(rctx, index) (reinterpret_cast<wire_req_t *>(C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_.buf_))
+#define C_RPC_RESP_BUF(rctx, index) (reinterpret_cast<wire_resp_t*>(C_RPC_CONTEXT_WINDOW(rctx, index).resp_msgbuf_.buf_))
 
 namespace metafs {
 
+// 异步rpc句柄, 即线程rpc context中的window下标
+typedef int32_t rpc_handle_t;
+
 /// A basic session management handler that expects successful responses
 static inline void client_basic_sm_handler(int session_num, erpc::SmEventType sm_event_type,
                       erpc::SmErrType sm_err_type, void *_context) {
-  auto *c = static_cast<client_context *>(_context);
+  auto *c = static_cast<client_rpc_context *>(_context);
   c->num_sm_resps_++;
 
   erpc::rt_assert(
@@ -52,80 +58,418 @@ class RpcClient {
 
     void operator=(RpcClient const&) = delete;
 
-    RpcClient(size_t rpc_id = 0) {
-      c_ctx->rpc_ = new erpc::Rpc<erpc::CTransport>(c_ctx->nexus_, static_cast<void *>(c_ctx),
+    // rpc context按线程懒创建, 见thread_rpc_ctx()
+    RpcClient() {
+    }
+
+    ~RpcClient() {
+    }
+  
+    rpc_resp_t RPC_Getinode(const metafs_inode_t pinode, const string &fname, metafs_inode_t &inode) {
+      return RPC_Getinode_finish(RPC_Getinode_async(pinode, fname), inode);
+    }
+
+    rpc_resp_t RPC_Getstat(metafs_inode_t pinode, const string &fname, metafs_inode_t &inode, metafs_stat_t &stat) {
+      return RPC_Getstat_finish(RPC_Getstat_async(pinode, fname), inode, stat);
+    }
+
+    rpc_resp_t RPC_Mknod(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat) {
+      return RPC_Mknod_finish(RPC_Mknod_async(pinode, fname, mode), inode, stat);
+    }
+
+    rpc_resp_t RPC_Open(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat) {
+      return RPC_Open_finish(RPC_Open_async(pinode, fname, mode), inode, stat);
+    }
+
+    rpc_resp_t RPC_OpenCreate(metafs_inode_t pinode, const string &fname, mode_t mode, int flags,
+                              metafs_inode_t &inode, metafs_stat_t &stat, bool &created) {
+      return RPC_OpenCreate_finish(RPC_OpenCreate_async(pinode, fname, mode, flags), inode, stat, created);
+    }
+
+    rpc_resp_t RPC_Unlink(metafs_inode_t pinode, const string &fname) {
+      return RPC_Unlink_finish(RPC_Unlink_async(pinode, fname));
+    }
+
+    rpc_resp_t RPC_Rmdir(metafs_inode_t pinode, const string &fname) {
+      return RPC_Rmdir_finish(RPC_Rmdir_async(pinode, fname));
+    }
+
+    rpc_resp_t RPC_Mkdir(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode) {
+      return RPC_Mkdir_finish(RPC_Mkdir_async(pinode, fname, mode), inode);
+    }
+
+    // 读取整个目录, stats不为空时使用readdirplus, 按entry加入open_dir的顺序依次追加其stat
+    rpc_resp_t RPC_Readdir(metafs_inode_t pinode, shared_ptr<OpenDir> &open_dir, vector<metafs_stat_t> *stats = nullptr);
+
+    // 读取目录从offset开始的一页, plus为true时使用readdirplus
+    rpc_handle_t RPC_Readdir_page_async(metafs_inode_t pinode, uint64_t offset, bool plus);
+    // 把一页entry加入open_dir, readdirplus时stats不能为空
+    rpc_resp_t RPC_Readdir_page_finish(rpc_handle_t handle, shared_ptr<OpenDir> &open_dir, vector<metafs_stat_t> *stats,
+                                       uint64_t &next_offset, bool &is_uncomplete);
+
+    // 打开目录: 成功时创建open_dir, 目录的entry与dentry在同一server线程上时同时填入第一页并设置cursor
+    rpc_handle_t RPC_Opendir_async(metafs_inode_t pinode, const string &fname);
+    rpc_resp_t RPC_Opendir_finish(rpc_handle_t handle, const string &path, metafs_inode_t pinode,
+                                  const string &fname, shared_ptr<OpenDir> &open_dir);
+
+    rpc_resp_t RPC_Opendir(const string &path, metafs_inode_t pinode, const string &fname, shared_ptr<OpenDir> &open_dir) {
+      return RPC_Opendir_finish(RPC_Opendir_async(pinode, fname), path, pinode, fname, open_dir);
+    }
+
+    rpc_resp_t RPC_Readdir_page(metafs_inode_t pinode, uint64_t offset, shared_ptr<OpenDir> &open_dir,
+                                vector<metafs_stat_t> *stats, uint64_t &next_offset, bool &is_uncomplete) {
+      return RPC_Readdir_page_finish(RPC_Readdir_page_async(pinode, offset, stats != nullptr),
+                                     open_dir, stats, next_offset, is_uncomplete);
+    }
+
+    /**
+     * 异步rpc: *_async发送请求后立即返回句柄, *_finish等待该请求完成, 取出结果并释放句柄
+     * 句柄即当前线程rpc context中的window下标, 只能在提交它的线程中使用;
+     * 每个线程最多MAX_MSG_BUF_WINDOW个请求同时在途, 发往不同server的请求可以重叠网络往返.
+     * 每个句柄必须且只能调用一次对应的*_finish.
+     */
+    rpc_handle_t RPC_Getinode_async(metafs_inode_t pinode, const string &fname);
+    rpc_resp_t RPC_Getinode_finish(rpc_handle_t handle, metafs_inode_t &inode);
+
+    rpc_handle_t RPC_Getstat_async(metafs_inode_t pinode, const string &fname);
+    rpc_resp_t RPC_Getstat_finish(rpc_handle_t handle, metafs_inode_t &inode, metafs_stat_t &stat);
+
+    rpc_handle_t RPC_Mknod_async(metafs_inode_t pinode, const string &fname, mode_t mode);
+    rpc_resp_t RPC_Mknod_finish(rpc_handle_t handle, metafs_inode_t &inode, metafs_stat_t &stat);
+
+    rpc_handle_t RPC_Open_async(metafs_inode_t pinode, const string &fname, mode_t mode);
+    rpc_resp_t RPC_Open_finish(rpc_handle_t handle, metafs_inode_t &inode, metafs_stat_t &stat);
+
+    // 打开文件, 不存在时创建; mode为创建时的mode, flags为open flags
+    rpc_handle_t RPC_OpenCreate_async(metafs_inode_t pinode, const string &fname, mode_t mode, int flags);
+    rpc_resp_t RPC_OpenCreate_finish(rpc_handle_t handle, metafs_inode_t &inode, metafs_stat_t &stat, bool &created);
+
+    rpc_handle_t RPC_Unlink_async(metafs_inode_t pinode, const string &fname);
+    rpc_resp_t RPC_Unlink_finish(rpc_handle_t handle);
+
+    rpc_handle_t RPC_Rmdir_async(metafs_inode_t pinode, const string &fname);
+    rpc_resp_t RPC_Rmdir_finish(rpc_handle_t handle);
+
+    rpc_handle_t RPC_Mkdir_async(metafs_inode_t pinode, const string &fname, mode_t mode);
+    rpc_resp_t RPC_Mkdir_finish(rpc_handle_t handle, metafs_inode_t &inode);
+
+    // 从entries[start]开始, 把至多max_count个(fname, mode)打包进一个batch mknod请求, count返回打包的文件数
+    // prealloc_inodes不为空时entries[i]使用prealloc_inodes[i]作为inode(从server租用)
+    rpc_handle_t RPC_BatchMknod_async(metafs_inode_t pinode, const vector<pair<string, mode_t>> &entries,
+                                      size_t start, size_t max_count, size_t &count,
+                                      const metafs_inode_t *prealloc_inodes = nullptr);
+    // results/inodes中依次写入count个文件的结果, 整批失败(如需要更新region map)时不写入
+    rpc_resp_t RPC_BatchMknod_finish(rpc_handle_t handle, rpc_resp_t *results, metafs_inode_t *inodes);
+
+    rpc_resp_t RPC_BatchMknod(metafs_inode_t pinode, const vector<pair<string, mode_t>> &entries,
+                              size_t start, size_t max_count, size_t &count, rpc_resp_t *results, metafs_inode_t *inodes,
+                              const metafs_inode_t *prealloc_inodes = nullptr) {
+      return RPC_BatchMknod_finish(RPC_BatchMknod_async(pinode, entries, start, max_count, count, prealloc_inodes),
+                                   results, inodes);
+    }
+
+    // 向目录的owner租用至多count个inode, 成功时返回[start_inode, start_inode + granted)和server给出的租约时长;
+    // server没有开启异步create时返回kFail
+    rpc_resp_t RPC_AllocInodes(metafs_inode_t pinode, int32_t count, metafs_inode_t &start_inode, int32_t &granted,
+                               int32_t &lease_ms);
+
+    // 从names[start]开始发送尽量多的路径分量, 由server依次解析, count返回发送的分量数
+    rpc_handle_t RPC_ResolvePath_async(metafs_inode_t pinode, const vector<string> &names, size_t start, size_t &count);
+    // inodes中依次写入num_resolved个已解析分量的inode
+    rpc_resp_t RPC_ResolvePath_finish(rpc_handle_t handle, metafs_inode_t *inodes, int32_t &num_resolved);
+
+    rpc_resp_t RPC_ResolvePath(metafs_inode_t pinode, const vector<string> &names, size_t start,
+                               metafs_inode_t *inodes, int32_t &num_resolved) {
+      size_t count;
+      return RPC_ResolvePath_finish(RPC_ResolvePath_async(pinode, names, start, count), inodes, num_resolved);
+    }
+
+    // 推进一次事件循环, 返回请求是否已完成; 完成后仍需调用*_finish
+    bool RPC_Poll(rpc_handle_t handle) {
+      client_rpc_context *rctx = thread_rpc_ctx();
+      if(!C_RPC_CONTEXT_WINDOW(rctx, handle).complete) {
+        rctx->rpc_->run_event_loop_once();
+      }
+      return C_RPC_CONTEXT_WINDOW(rctx, handle).complete;
+    }
+
+    // 放弃一个不再需要结果的异步请求, owner和seq为提交时的RPC_Context()和RPC_Window_seq()
+    // 在owner线程上等待其完成后释放; 在其他线程上只做标记, 由owner线程在window用完时回收;
+    // owner线程已退出(window已回收)或context已被其他线程复用时不做任何事
+    void RPC_Abandon(client_rpc_context *owner, rpc_handle_t handle, uint32_t seq) {
+      if(owner == c_rpc_ctx) {
+        if(RPC_Owns(owner, handle, seq)) {
+          wait_response(owner, handle);
+          free_window(owner, handle);
+        }
+      } else {
+        C_RPC_CONTEXT_WINDOW(owner, handle).abandoned_seq.store(seq, std::memory_order_release);
+      }
+    }
+
+    // 当前线程的rpc context, 用于判断异步请求句柄是否属于当前线程
+    client_rpc_context *RPC_Context() {
+      return thread_rpc_ctx();
+    }
+
+    // 刚提交的请求所在window的seq
+    uint32_t RPC_Window_seq(rpc_handle_t handle) {
+      return C_RPC_CONTEXT_WINDOW(thread_rpc_ctx(), handle).seq;
+    }
+
+    // (owner, handle, seq)是否为当前线程提交且尚未finish的请求
+    bool RPC_Owns(client_rpc_context *owner, rpc_handle_t handle, uint32_t seq) {
+      return owner == thread_rpc_ctx() && (owner->busy_windows & (1u << handle))
+             && C_RPC_CONTEXT_WINDOW(owner, handle).seq == seq;
+    }
+
+    // 标记一个刚提交的请求为目录预取
+    void RPC_Mark_prefetch(rpc_handle_t handle) {
+      thread_rpc_ctx()->prefetch_windows |= 1u << handle;
+    }
+
+    // 当前线程在途的目录预取数(包括已放弃但还未回收的)
+    int RPC_Prefetch_windows() {
+      client_rpc_context *rctx = thread_rpc_ctx();
+      return __builtin_popcount(rctx->busy_windows & rctx->prefetch_windows);
+    }
+
+    // 当前线程空闲的window数, 即还能提交的异步请求数; 快用完时先回收其他线程放弃的window
+    int RPC_Free_windows() {
+      client_rpc_context *rctx = thread_rpc_ctx();
+      int free_windows = MAX_MSG_BUF_WINDOW - __builtin_popcount(rctx->busy_windows);
+      if(free_windows <= 1) {
+        reap_abandoned_windows(rctx);
+        free_windows = MAX_MSG_BUF_WINDOW - __builtin_popcount(rctx->busy_windows);
+      }
+      return free_windows;
+    }
+
+    // use in Rename.
+    rpc_resp_t RPC_Create(metafs_inode_t pinode, const string &fname, const metafs_stat_t &stat);
+
+    // use in rename
+    rpc_resp_t RPC_Remove(metafs_inode_t pinode, const string &fname, mode_t mode);
+
+    // force为true时从所有server读取, 否则只读取响应中epoch比本地新的server
+    rpc_resp_t RPC_ReadRegionmap(bool force = false);
+
+    // 是否有server的region map epoch比本地新
+    bool region_map_stale() const {
+      for(int32_t i = 0; i < c_cfg->num_servers; i++) {
+        if(c_ctx->seen_map_epoch[i] > c_ctx->synced_map_epoch[i]) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // 返回当前线程的rpc context, 线程第一次调用时创建(或复用已退出线程的context)并连接所有server的前台线程
+    client_rpc_context *thread_rpc_ctx() {
+      if(likely(c_rpc_ctx != nullptr)) {
+        return c_rpc_ctx;
+      }
+
+      client_rpc_context *rctx = nullptr;
+      {
+        std::lock_guard<std::mutex> lock(c_ctx->rpc_ctx_mutex);
+        if(!c_ctx->free_rpc_ctxs.empty()) {
+          rctx = c_ctx->free_rpc_ctxs.back();
+          c_ctx->free_rpc_ctxs.pop_back();
+        }
+      }
+      if(rctx == nullptr) {
+        int32_t rpc_id = c_ctx->next_rpc_id++;
+        p_assert(rpc_id < c_cfg->num_client_threads, 
+                  "too many live client threads, client_threads in config is %d", c_cfg->num_client_threads);
+        rctx = new client_rpc_context();
+        rctx->rpc_id = rpc_id;
+        rctx->busy_windows = 0;
+        rctx->prefetch_windows = 0;
+        for(size_t i = 0; i < MAX_MSG_BUF_WINDOW; i++) {
+          C_RPC_CONTEXT_WINDOW(rctx, i).seq = 0;
+          C_RPC_CONTEXT_WINDOW(rctx, i).abandoned_seq = 0;
+        }
+      }
+      int32_t rpc_id = rctx->rpc_id;
+
+      rctx->num_sm_resps_ = 0;
+      rctx->rpc_ = new erpc::Rpc<erpc::CTransport>(c_ctx->nexus_, static_cast<void *>(rctx),
                             static_cast<uint8_t>(rpc_id), client_basic_sm_handler);
-      c_ctx->rpc_->retry_connect_on_invalid_rpc_id_ = true;
+      rctx->rpc_->retry_connect_on_invalid_rpc_id_ = true;
 
       size_t gid_ = c_ctx->id * c_cfg->num_client_threads + rpc_id;
-      c_ctx->session_num_vec_.resize(c_ctx->total_servers);
+      rctx->session_num_vec_.resize(c_ctx->total_servers);
       // 连接到server的所有前台线程
       for(int i = 0; i < c_cfg->num_servers; i++) {
         for(int j = 0; j < c_cfg->server_fg_threads; j++) {
           LOG(INFO) << "Client gid#" << gid_ << " connect to " <<"server [" << c_cfg->server_list[i] << "], thread_id#" << j;
           int session_id = i * c_cfg->server_fg_threads + j;
-          c_ctx->session_num_vec_[session_id] = c_ctx->rpc_->create_session(c_cfg->server_list[i], j);
+          rctx->session_num_vec_[session_id] = rctx->rpc_->create_session(c_cfg->server_list[i], j);
         }
       }
 
       // wait for all session connect
-      while(c_ctx->num_sm_resps_ != c_ctx->total_servers) {
-        c_ctx->rpc_->run_event_loop_once();
+      while(rctx->num_sm_resps_ != c_ctx->total_servers) {
+        rctx->rpc_->run_event_loop_once();
       }
 
-      for(int i = 0; i < c_cfg->num_servers; i++) {
-        for(int j = 0; j < c_cfg->server_fg_threads; j++) {
-          int session_id = i * c_cfg->server_fg_threads + j;
-          if(!c_ctx->rpc_->is_connected(c_ctx->session_num_vec_[session_id])) {
-            p_assert(false, "erpc not connected");
-          }
+      for(int i = 0; i < c_ctx->total_servers; i++) {
+        if(!rctx->rpc_->is_connected(rctx->session_num_vec_[i])) {
+          p_assert(false, "erpc not connected");
         }
       }
 
       LOG(INFO) << "connected complete";
 
-      alloc_req_resp_msg_buffers(c_ctx);
-      LOG(INFO) << "RPC Client Init Sucess";
-    }
+      alloc_req_resp_msg_buffers(rctx);
+      LOG(INFO) << "RPC Client gid#" << gid_ << " Init Sucess";
 
-    ~RpcClient() {
+      c_rpc_ctx = rctx;
+      // 主线程的context保留到进程退出, MetaClient析构时还要用它写入异步create
+      if(syscall(SYS_gettid) != getpid()) {
+        rpc_ctx_releaser_.client = this;
+      }
+      return rctx;
     }
-  
-    rpc_resp_t RPC_Getinode(const metafs_inode_t pinode, const string &fname, metafs_inode_t &inode);
 
-    rpc_resp_t RPC_Getstat(metafs_inode_t pinode, const string &fname, metafs_inode_t &inode, metafs_stat_t &stat);
+    // 线程退出时调用: 等待所有在途请求, 断开session并销毁erpc::Rpc, context和rpc_id留给之后创建的线程
+    void release_thread_rpc_ctx() {
+      client_rpc_context *rctx = c_rpc_ctx;
+      if(rctx == nullptr) {
+        return;
+      }
+      for(rpc_handle_t i = 0; i < MAX_MSG_BUF_WINDOW; i++) {
+        if(rctx->busy_windows & (1u << i)) {
+          wait_response(rctx, i);
+          free_window(rctx, i);
+        }
+      }
+
+      int expected_sm_resps = rctx->num_sm_resps_;
+      for(int session_num : rctx->session_num_vec_) {
+        if(rctx->rpc_->destroy_session(session_num) == 0) {
+          expected_sm_resps++;
+        }
+      }
+      // server没有响应时最多等待1s
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+      while(rctx->num_sm_resps_ < expected_sm_resps && std::chrono::steady_clock::now() < deadline) {
+        rctx->rpc_->run_event_loop_once();
+      }
+      // msgbuf随erpc::Rpc的hugepage allocator一起释放
+      delete rctx->rpc_;
+      rctx->rpc_ = nullptr;
+      c_rpc_ctx = nullptr;
+
+      std::lock_guard<std::mutex> lock(c_ctx->rpc_ctx_mutex);
+      c_ctx->free_rpc_ctxs.push_back(rctx);
+    }
 
-    rpc_resp_t RPC_Mknod(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat);
+    // Allocate request and response MsgBuffers
+    void alloc_req_resp_msg_buffers(client_rpc_context *c) {
+      for (size_t msgbuf_idx = 0; msgbuf_idx < MAX_MSG_BUF_WINDOW; msgbuf_idx++) {
+        c->window_[msgbuf_idx].req_msgbuf_ =
+            c->rpc_->alloc_msg_buffer_or_die(sizeof(wire_req_t));
 
-    rpc_resp_t RPC_Open(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat);
+        c->window_[msgbuf_idx].resp_msgbuf_ =
+            c->rpc_->alloc_msg_buffer_or_die(sizeof(wire_resp_t));
 
-    rpc_resp_t RPC_Unlink(metafs_inode_t pinode, const string &fname);
+      }
+    }
 
-    rpc_resp_t RPC_Rmdir(metafs_inode_t pinode, const string &fname);
+  private:
+    // 线程退出时析构, 把线程的rpc context还回c_ctx
+    struct ThreadRpcCtxReleaser {
+      RpcClient *client;
+      ThreadRpcCtxReleaser() : client(nullptr) {}
+      ~ThreadRpcCtxReleaser() {
+        if(client != nullptr) {
+          client->release_thread_rpc_ctx();
+        }
+      }
+    };
+    inline static thread_local ThreadRpcCtxReleaser rpc_ctx_releaser_;
 
-    rpc_resp_t RPC_Mkdir(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode);
+    // 分配一个空闲window, 所有window都在使用时报错: 调用者在途的异步请求不能超过MAX_MSG_BUF_WINDOW
+    rpc_handle_t alloc_window(client_rpc_context *rctx) {
+      if(unlikely(rctx->busy_windows == (1u << MAX_MSG_BUF_WINDOW) - 1)) {
+        reap_abandoned_windows(rctx);
+      }
+      p_assert(rctx->busy_windows != (1u << MAX_MSG_BUF_WINDOW) - 1, "no free rpc window");
+      rpc_handle_t index = __builtin_ctz(~rctx->busy_windows);
+      rctx->busy_windows |= 1u << index;
+      rctx->prefetch_windows &= ~(1u << index);
+      C_RPC_CONTEXT_WINDOW(rctx, index).seq++;
+      return index;
+    }
 
-    rpc_resp_t RPC_Readdir(metafs_inode_t pinode, shared_ptr<OpenDir> &open_dir);
+    void free_window(client_rpc_context *rctx, rpc_handle_t index) {
+      rctx->busy_windows &= ~(1u << index);
+    }
 
-    // use in Rename.
-    rpc_resp_t RPC_Create(metafs_inode_t pinode, const string &fname, const metafs_stat_t &stat);
+    void reap_abandoned_windows(client_rpc_context *rctx) {
+      for(rpc_handle_t i = 0; i < MAX_MSG_BUF_WINDOW; i++) {
+        auto &window = C_RPC_CONTEXT_WINDOW(rctx, i);
+        if((rctx->busy_windows & (1u << i)) && window.abandoned_seq.load(std::memory_order_acquire) == window.seq) {
+          wait_response(rctx, i);
+          free_window(rctx, i);
+        }
+      }
+    }
 
-    // use in rename
-    rpc_resp_t RPC_Remove(metafs_inode_t pinode, const string &fname, mode_t mode);
+    // 发送window中已填好的请求, 不等待响应
+    void send_request(client_rpc_context *rctx, rpc_handle_t index, int32_t server_session_id,
+                      region_id_t region_id, uint8_t req_type) {
+      auto &window = C_RPC_CONTEXT_WINDOW(rctx, index);
+      window.complete = false;
+      window.server_session_id = server_session_id;
+      window.region_id = region_id;
+      rctx->rpc_->enqueue_request(rctx->session_num_vec_[server_session_id],
+                              req_type, &window.req_msgbuf_, &window.resp_msgbuf_,
+                              set_complete_cb, reinterpret_cast<void*>(&window.complete));
+    }
 
-    rpc_resp_t RPC_ReadRegionmap();
+    // 等待window中的请求完成并返回响应, 等待期间同时推进其他在途请求
+    wire_resp_t *wait_response(client_rpc_context *rctx, rpc_handle_t index) {
+      auto &window = C_RPC_CONTEXT_WINDOW(rctx, index);
+      while(window.complete == false) {
+        rctx->rpc_->run_event_loop_once();
+      }
+      note_map_epoch(window.server_session_id, C_RPC_RESP_BUF(rctx, index)->map_epoch);
+      return C_RPC_RESP_BUF(rctx, index);
+    }
 
-    // Allocate request and response MsgBuffers
-    void alloc_req_resp_msg_buffers(client_context *c) {
-      for (size_t msgbuf_idx = 0; msgbuf_idx < MAX_MSG_BUF_WINDOW; msgbuf_idx++) {
-        c->window_[msgbuf_idx].req_msgbuf_ =
-            c->rpc_->alloc_msg_buffer_or_die(sizeof(wire_req_t));
+    // 记录响应中携带的server region map epoch
+    void note_map_epoch(int32_t server_session_id, uint64_t map_epoch) {
+      int32_t server_id = server_session_id / c_cfg->server_fg_threads;
+      uint64_t seen = c_ctx->seen_map_epoch[server_id].load();
+      while(map_epoch > seen && !c_ctx->seen_map_epoch[server_id].compare_exchange_weak(seen, map_epoch)) {
+      }
+    }
 
-        c->window_[msgbuf_idx].resp_msgbuf_ =
-            c->rpc_->alloc_msg_buffer_or_die(sizeof(wire_resp_t));
-      
+    // 记录响应中携带的region create_version, server处理了该请求时才有效
+    void note_create_version(region_id_t region_id, rpc_resp_t res, uint64_t create_version) {
+      if(res == RespType::kSuccess || res == RespType::kENOENT || res == RespType::kEXIST) {
+        std::atomic<uint64_t> &slot = c_ctx->region_create_version[get_region_version_slot(region_id)];
+        uint64_t tag = get_region_version_tag(region_id);
+        uint64_t word = tag | (create_version & kRegionVersionMask);
+        uint64_t cur = slot.load();
+        // 同一region只增不减; 槽位被其他region占用时直接替换
+        while(!((cur & ~kRegionVersionMask) == tag && (cur & kRegionVersionMask) >= (word & kRegionVersionMask))
+              && !slot.compare_exchange_weak(cur, word)) {
+        }
       }
     }
+
+    // 根据pinode的hash值定位其所属region, 返回该region所在server线程的session下标
+    int32_t locate_server(metafs_inode_t pinode, uint64_t &pinode_hash, region_id_t &region_id) {
+      pinode_hash = get_pinode_hash(pinode);
+      const RegionRoute *route = find_region_route(pinode_hash);
+      p_assert(route != nullptr, "Invalid region_id");
+      region_id = route->region_id;
+      return route->session_idx;
+    }
 };
 
 } // end namespace metafs
\ No newline at end of file
@@ -11,6 +11,14 @@ using namespace std;
 // 当前配置下erpc message buffer最大长度为3824B，设置一个小点的MAX_SIZE
 #define MSG_ENTEY_MAX_SIZE 3712
 #define MAX_MSG_BUF_WINDOW 8
+// 一个batch mknod请求最多携带的文件数
+#define MAX_BATCH_MKNOD_ENTRIES 128
+// 一个resolve path请求最多携带的路径分量数
+#define MAX_RESOLVE_PATH_COMPONENTS 64
+// opendir响应中第一页entries的最大长度, 给目录的inode和stat留出空间
+#define OPENDIR_ENTRY_MAX_SIZE (MSG_ENTEY_MAX_SIZE - 128)
+// 一次alloc inodes请求最多租用的inode数
+#define MAX_INODE_GRANT 4096
 
 namespace metafs {
 
@@ -32,6 +40,12 @@ enum kReqType : uint8_t {
   kFSMkdirReq, // create a directory
   kFSRmdirReq, // remove a directory
   kFSGetinodeReq, // get file/dir 's inode
+  kFSBatchMknodReq, // create many files in the same directory
+  kFSResolvePathReq, // resolve several path components at once
+  kFSReaddirPlusReq, // read a directory with each entry's stat, use FSReaddirReq/FSReaddirResp
+  kFSOpenCreateReq, // open a file, create it if not exists (O_CREAT)
+  kFSOpendirReq, // open a directory, return its stat and the first page of entries
+  kFSAllocInodesReq, // lease a range of inodes for client side creates in a directory
 
   kReadRegionmap,
 
@@ -81,6 +95,51 @@ struct wire_req_t {
       char fname[METAFS_MAX_FNAME_LEN];
     }FSMknodReq;
 
+    struct {
+      region_id_t region_id;
+      oid_t oid;
+      metafs_inode_t pinode;
+      uint64_t pinode_hash;
+      mode_t mode; // 创建时使用的mode
+      int32_t flags; // open flags, server处理O_EXCL/O_TRUNC及访问模式
+      char fname[METAFS_MAX_FNAME_LEN];
+    }FSOpenCreateReq;
+
+    struct {
+      region_id_t region_id;
+      metafs_inode_t pinode;
+      uint64_t pinode_hash;
+      char fname[METAFS_MAX_FNAME_LEN];
+    }FSOpendirReq;
+
+    struct {
+      region_id_t region_id;
+      metafs_inode_t pinode;
+      uint64_t pinode_hash;
+      int32_t num_entries; // 文件数, 不超过MAX_BATCH_MKNOD_ENTRIES
+      int32_t entries_len; // actual entries' length
+      int32_t prealloc; // 为1时inode由client从租用的inode中分配
+      // entries内每条entry结构: mode(4B) + fname(end with '\0'); prealloc时为mode(4B) + inode(8B) + fname
+      uint8_t entries[MSG_ENTEY_MAX_SIZE];
+    }FSBatchMknodReq;
+
+    struct {
+      region_id_t region_id;
+      metafs_inode_t pinode; // 在该目录下创建文件, 请求发往目录的owner
+      uint64_t pinode_hash;
+      int32_t count; // 希望租用的inode数
+    }FSAllocInodesReq;
+
+    struct {
+      region_id_t region_id; // 第一个分量所在的region
+      metafs_inode_t pinode; // 第一个分量的父目录
+      uint64_t pinode_hash;
+      int32_t num_components; // 分量数, 不超过MAX_RESOLVE_PATH_COMPONENTS
+      int32_t components_len; // actual components' length
+      // 依次存放每个分量的名字(end with '\0')
+      char components[MSG_ENTEY_MAX_SIZE];
+    }FSResolvePathReq;
+
     struct {
       region_id_t region_id;
       metafs_inode_t inode;
@@ -105,6 +164,8 @@ struct wire_req_t {
 
     struct {
       int32_t client_id; // 随便传个数据
+      region_id_t start_region_id; // 分页读取时从该region_id开始
+      uint64_t since_epoch; // 只读取epoch大于since_epoch的region, 为0时读取全部region
     }ReadRegionmapReq;
 
     // server to server rpc
@@ -145,9 +206,14 @@ const size_t FSOpenReq_size = sizeof(wire_req_t::FSOpenReq);
 const size_t FSUnlinkReq_size = sizeof(wire_req_t::FSUnlinkReq);
 const size_t FSStatReq_size = sizeof(wire_req_t::FSStatReq);
 const size_t FSMknodReq_size = sizeof(wire_req_t::FSMknodReq);
+const size_t FSOpenCreateReq_size = sizeof(wire_req_t::FSOpenCreateReq);
+const size_t FSOpendirReq_size = sizeof(wire_req_t::FSOpendirReq);
 const size_t FSReaddirReq_size = sizeof(wire_req_t::FSReaddirReq);
 const size_t FSMkdirReq_size = sizeof(wire_req_t::FSMkdirReq);
 const size_t FSRmdirReq_size = sizeof(wire_req_t::FSRmdirReq);
+const size_t FSBatchMknodReq_hdr_size = offsetof(wire_req_t, FSBatchMknodReq.entries);
+const size_t FSResolvePathReq_hdr_size = offsetof(wire_req_t, FSResolvePathReq.components);
+const size_t FSAllocInodesReq_size = sizeof(wire_req_t::FSAllocInodesReq);
 
 const size_t CreateRegionReq_size = sizeof(wire_req_t::CreateRegionReq);
 const size_t SendRegionReq_size = sizeof(wire_req_t::SendRegionReq);
@@ -164,38 +230,96 @@ enum RespType : rpc_resp_t {
   kEISDIR, // is a directory
   kEBUSY, // Device or resource busy, client need to retry
   kUpdateRegionMap, // notice client to Update ServerRegion map
+  kENOTEMPTY, // directory not empty
 };
 
 struct wire_resp_t {
+  // 每个响应都携带server当前的region map epoch, client发现其比本地新时增量更新region map
+  uint64_t map_epoch;
   union {
     struct  {
       rpc_resp_t resp_type;
       metafs_inode_t inode;
+      uint64_t create_version; // region内create操作的版本号, client用来判断负缓存是否失效
     }FSGetinodeResp;
 
     struct {
       rpc_resp_t resp_type;
       metafs_inode_t inode;
+      uint64_t create_version;
       metafs_stat_t stat;
     }FSOpenResp;
 
     struct {
       rpc_resp_t resp_type;
       metafs_inode_t inode;
+      uint64_t create_version;
       metafs_stat_t stat;
     }FSStatResp;
 
     struct {
       rpc_resp_t resp_type;
       metafs_inode_t inode;
+      uint64_t create_version;
       metafs_stat_t stat;
     }FSMknodResp;
 
+    struct {
+      // kSuccess: 打开已有文件或创建成功; kEXIST: O_EXCL且文件已存在; kEISDIR: 已存在的是目录
+      rpc_resp_t resp_type;
+      int32_t created; // 1表示文件由本次请求创建
+      metafs_inode_t inode;
+      uint64_t create_version;
+      metafs_stat_t stat;
+    }FSOpenCreateResp;
+
+    struct {
+      rpc_resp_t resp_type; // kENOTDIR: 不是目录
+      // 目录的entry与dentry在同一个server线程上时为1, 之后的字段有效(格式同FSReaddirResp); 否则client另外读取
+      int32_t page_included;
+      metafs_inode_t inode;
+      uint64_t create_version;
+      metafs_stat_t stat;
+      int32_t is_uncomplete;
+      int32_t num_result;
+      int32_t entries_len;
+      int64_t next_offset;
+      uint8_t entries[OPENDIR_ENTRY_MAX_SIZE];
+    }FSOpendirResp;
+
+    struct {
+      rpc_resp_t resp_type;
+      int32_t count; // 实际租用的inode数, 不超过MAX_INODE_GRANT
+      metafs_inode_t start_inode; // 租用的inode为[start_inode, start_inode + count)
+      int32_t lease_ms; // 租约时长, 到期后server拒绝用这些inode创建
+    }FSAllocInodesResp;
+
     struct {
       rpc_resp_t resp_type;
       metafs_inode_t inode;
+      uint64_t create_version;
     }FSMkdirResp;
 
+    struct {
+      rpc_resp_t resp_type; // 为kSuccess时entries有效, 否则整批都未处理
+      int32_t num_entries;
+      uint64_t create_version;
+      struct {
+        rpc_resp_t resp_type;
+        metafs_inode_t inode;
+      } entries[MAX_BATCH_MKNOD_ENTRIES]; // 与请求中的entry一一对应
+    }FSBatchMknodResp;
+
+    struct {
+      // kSuccess: 前num_resolved个分量解析成功(至少一个), 之后的分量不在本server线程上, client继续向其owner解析
+      // kENOENT: 第num_resolved个分量不存在
+      rpc_resp_t resp_type;
+      int32_t num_resolved;
+      region_id_t last_region_id; // 最后一个查找的分量所在的region
+      uint64_t create_version; // last_region_id的create_version
+      metafs_inode_t inodes[MAX_RESOLVE_PATH_COMPONENTS]; // 每个已解析前缀的inode
+    }FSResolvePathResp;
+
     struct {
       rpc_resp_t resp_type;
     }FSUnlinkResp;
@@ -211,11 +335,14 @@ struct wire_resp_t {
       int32_t entries_len; // actual entries' length
       int64_t next_offset; // 如果没读完,则记录下一次readdir RPC的offset
       // entries内每一条entry结构:pinode(8B)+fname(end with '\0')+inode(8B,最高位存储文件类型file/dir, 1是目录)
+      // readdirplus时每一条entry结构:fname(end with '\0')+inode(8B)+stat(metafs_stat_size, 获取失败时mode为0)
       uint8_t entries[MSG_ENTEY_MAX_SIZE]; 
     }FSReaddirResp;
 
     struct {
       rpc_resp_t resp_type;
+      int32_t is_uncomplete; // 是否读完
+      region_id_t next_region_id; // 如果没读完,记录下一次ReadRegionmap RPC的start_region_id
       int32_t num_entries;
       ClientRegion entries[MSG_ENTEY_MAX_SIZE/sizeof(ClientRegion)]; 
     }ReadRegionmapResp; // client read region map from server
@@ -243,17 +370,28 @@ struct wire_resp_t {
   };
 };
 
-const size_t FSGetinodeResp_size = sizeof(wire_resp_t::FSGetinodeResp);
-const size_t FSOpenResp_size = sizeof(wire_resp_t::FSOpenResp);
-const size_t FSStatResp_size = sizeof(wire_resp_t::FSStatResp);
-const size_t FSMknodResp_size = sizeof(wire_resp_t::FSMknodResp);
-const size_t FSMkdirResp_size = sizeof(wire_resp_t::FSMkdirResp);
-const size_t FSUnlinkResp_size = sizeof(wire_resp_t::FSUnlinkResp);
-const size_t FSRmdirResp_size = sizeof(wire_resp_t::FSRmdirResp);
-const size_t FSReaddirResp_size = sizeof(wire_resp_t::FSReaddirResp);
-
-const size_t CreateRegionResp_size = sizeof(wire_resp_t::CreateRegionResp);
-const size_t SendRegionResp_size = sizeof(wire_resp_t::SendRegionResp);
-const size_t SendRegionLogResp_size = sizeof(wire_resp_t::SendRegionLogResp);
+// 响应大小包含union前的公共头部(map_epoch)
+const size_t wire_resp_hdr_size = offsetof(wire_resp_t, FSGetinodeResp);
+
+const size_t FSGetinodeResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSGetinodeResp);
+const size_t FSOpenResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSOpenResp);
+const size_t FSStatResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSStatResp);
+const size_t FSMknodResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSMknodResp);
+const size_t FSOpenCreateResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSOpenCreateResp);
+// opendir的响应只发送entries_len长度的entries
+const size_t FSOpendirResp_hdr_size = offsetof(wire_resp_t, FSOpendirResp.entries);
+const size_t FSAllocInodesResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSAllocInodesResp);
+const size_t FSMkdirResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSMkdirResp);
+const size_t FSUnlinkResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSUnlinkResp);
+const size_t FSRmdirResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSRmdirResp);
+const size_t FSReaddirResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::FSReaddirResp);
+// batch mknod的响应只发送前num_entries个entry
+const size_t FSBatchMknodResp_hdr_size = offsetof(wire_resp_t, FSBatchMknodResp.entries);
+// resolve path的响应只发送前num_resolved个inode
+const size_t FSResolvePathResp_hdr_size = offsetof(wire_resp_t, FSResolvePathResp.inodes);
+
+const size_t CreateRegionResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::CreateRegionResp);
+const size_t SendRegionResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::SendRegionResp);
+const size_t SendRegionLogResp_size = wire_resp_hdr_size + sizeof(wire_resp_t::SendRegionLogResp);
 } // end namespace metafs
 
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <thread>
+
+#include "common/fs.h"
+#include "common/region.h"
+#include "eRPC/src/rpc.h"
+#include "metakv/include/metadb.h"
+
+namespace metafs {
+
+struct server_context;
+
+// 请求的处理方式
+enum HandlerClass : int32_t {
+    kHandlerInline = 0, // 在eRPC前台线程内处理完并回复(点查询/点更新)
+    kHandlerBackground, // 扫描MetaDb的部分交给BgWorkerPool, 完成后回到前台线程回复(readdir/rmdir/opendir)
+    kNumHandlerClasses,
+};
+
+// 交给后台worker的任务, 由前台线程new, 在done之后delete
+struct BgTask {
+    server_context *ctx;        // 提交任务的前台线程
+    erpc::ReqHandle *req_handle;
+    // 在worker线程执行, 只读ctx->metadb(与split线程的迁移扫描一样和前台并发读), 可以写c_resp,
+    // 不能访问前台线程私有的状态(dirty_stats/inode_cache/pinode_table/region等)
+    void (*work)(BgTask *task);
+    // 回到提交任务的前台线程执行, 负责回复响应
+    void (*done)(BgTask *task);
+    size_t start_tsc;           // handler开始处理的时间, 用于统计延迟
+
+    // handler从请求中拷贝的参数, 后台处理期间eRPC可能已经回收请求buffer
+    region_id_t region_id;
+    metafs_inode_t pinode;
+    uint64_t pinode_hash;
+    metafs_inode_t inode;
+    uint64_t offset;
+    char fname[METAFS_MAX_FNAME_LEN];
+    // rmdir: 目录下文件所属的region在本线程时记录其create_version, done时判断检查期间是否有新建文件
+    bool child_region_local;
+    region_id_t child_region_id;
+    uint64_t child_create_version;
+
+    // work的结果
+    MetaKvStatus status;
+    bool has_entries;
+};
+
+// 进程内共享的后台worker池, 所有前台线程向同一个队列提交任务
+// worker执行完work后把任务放回提交线程的完成队列, 前台线程在event loop中取出并执行done
+class BgWorkerPool {
+public:
+    BgWorkerPool() : stop_(false) {}
+
+    BgWorkerPool(const BgWorkerPool &) = delete;
+    BgWorkerPool &operator=(const BgWorkerPool &) = delete;
+
+    ~BgWorkerPool() {
+        stop();
+    }
+
+    // complete: worker执行完work后调用, 把任务交还给前台线程
+    void start(int num_threads, void (*complete)(BgTask *task)) {
+        complete_ = complete;
+        for(int i = 0; i < num_threads; i++) {
+            threads_.emplace_back(&BgWorkerPool::worker_loop, this);
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for(auto &t : threads_) {
+            t.join();
+        }
+        threads_.clear();
+    }
+
+    size_t num_threads() const {
+        return threads_.size();
+    }
+
+    void submit(BgTask *task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push_back(task);
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void worker_loop() {
+        while(true) {
+            BgTask *task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+                if(tasks_.empty()) {
+                    return; // stop_且队列已空
+                }
+                task = tasks_.front();
+                tasks_.pop_front();
+            }
+            task->work(task);
+            complete_(task);
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<BgTask *> tasks_;
+    bool stop_;
+    void (*complete_)(BgTask *task);
+    std::vector<std::thread> threads_;
+};
+
+} // end namespace metafs
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+#include "common/fs.h"
+#include "util/clock_cache.h"
+#include "xxHash/xxhash.h"
+
+namespace metafs {
+
+struct InodeCacheValue {
+    metafs_inode_t inode;
+    uint64_t gen; // 插入时的InodeCache::gen_
+    metafs_stat_t stat;
+    InodeCacheValue() : inode(0), gen(0) {}
+};
+
+// server线程的DRAM热点缓存: (pinode, fname) -> (inode, stat), 挡在MetaDb(PM)之前
+// 只由所属的前台线程访问, 不加锁; 前台对MetaDb的插入/更新/删除同步写入缓存(write-through)
+// key与client的DentryCache相同, 为(pinode, xxh3(fname)低64位), 高64位的低32位作为指纹
+// region迁出后本线程不再拥有其中的目录, 迁移完成时调用Invalidate()使之前的缓存项全部失效(迁出很少发生)
+class InodeCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t stale; // 因Invalidate()失效而丢弃的缓存项
+        uint64_t evictions;
+        uint64_t entries;
+    };
+
+    // capacity_bytes: 缓存占用的内存大小
+    InodeCache(size_t capacity_bytes) : cache_(capacity_bytes, 16), gen_(0), stale_(0) {}
+
+    bool Get(metafs_inode_t pinode, const char *fname, metafs_inode_t *inode, metafs_stat_t *stat) {
+        XXH128_hash_t h = XXH3_128bits(fname, strlen(fname));
+        InodeCacheValue value;
+        if(!cache_.Get(pinode, h.low64, (uint32_t)h.high64, &value)) {
+            return false;
+        }
+        if(unlikely(value.gen != gen_.load(std::memory_order_relaxed))) {
+            cache_.Erase(pinode, h.low64, (uint32_t)h.high64);
+            stale_++;
+            return false;
+        }
+        *inode = value.inode;
+        *stat = value.stat;
+        return true;
+    }
+
+    void Put(metafs_inode_t pinode, const char *fname, metafs_inode_t inode, const metafs_stat_t &stat) {
+        XXH128_hash_t h = XXH3_128bits(fname, strlen(fname));
+        InodeCacheValue value;
+        value.inode = inode;
+        value.gen = gen_.load(std::memory_order_relaxed);
+        value.stat = stat;
+        cache_.Put(pinode, h.low64, (uint32_t)h.high64, value);
+    }
+
+    void Erase(metafs_inode_t pinode, const char *fname) {
+        XXH128_hash_t h = XXH3_128bits(fname, strlen(fname));
+        cache_.Erase(pinode, h.low64, (uint32_t)h.high64);
+    }
+
+    // 使所有缓存项失效, 可以由split线程调用; 失效的项在之后查找到时删除
+    void Invalidate() {
+        gen_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // 只在所属线程调用
+    Stats GetStats() {
+        typename ClockCache<InodeCacheValue, NullLock>::Stats st = cache_.GetStats();
+        // stale的查找在ClockCache中计为命中
+        return Stats{st.hits - stale_, st.misses + stale_, stale_, st.evictions, st.entries};
+    }
+
+private:
+    ClockCache<InodeCacheValue, NullLock> cache_;
+    std::atomic<uint64_t> gen_;
+    uint64_t stale_;
+};
+
+} // end namespace metafs
@@ -6,6 +6,8 @@
 #include <rocksdb/slice.h>
 #include <unordered_set>
 #include <unordered_map>
+#include <map>
+#include <vector>
 
 #include "common/fs.h"
 #include "common/region.h"
@@ -15,8 +17,14 @@
 #include "util/memcached_tool.h"
 #include "util/bitmap.h"
 #include "util/rwlock.h"
+#include "util/brlock.h"
+#include "util/latency_hist.h"
 #include "util/threadsafe_queue.h"
 #include "server/region_and_log.h"
+#include "server/region_table.h"
+#include "server/inode_cache.h"
+#include "server/pinode_table.h"
+#include "server/bg_worker.h"
 
 #include "eRPC/src/rpc.h"
 #include "xxHash/xxhash.h"
@@ -52,9 +60,12 @@ const metafs_inode_t inode_prefix_ssb = ((metafs_inode_t)1)<<(metafs_inode_size*
 // 负责全局region id分配，之后需要移到zk
 extern atomic<region_id_t> global_region_id;
 
-extern unordered_map<region_id_t, ClientRegion> global_region_map;
+// 按region_id有序, client按region_id分页增量读取
+extern map<region_id_t, ClientRegion> global_region_map;
 // region_map的rwlock
-extern RWLock global_region_map_rwlock;
+extern BRLock global_region_map_rwlock;
+// region map版本号, 在global_region_map_rwlock写锁内递增, 修改的region记录修改时的epoch
+extern atomic<uint64_t> global_region_epoch;
 
 struct server_config {
   int32_t id; // 从memcached分配id
@@ -80,6 +91,39 @@ struct server_config {
   // memcached server ip and port
   char *memcached_ip;
   int memcached_port;
+
+  // 写打开时的时间戳更新策略: strict/relatime/noatime/lazytime
+  char *timestamp_policy;
+  int32_t ts_policy; // 由timestamp_policy解析得到的TimestampPolicy
+  int32_t lazytime_flush_ms; // lazytime下dirty时间戳写回MetaDb的周期
+  int32_t lazytime_max_dirty; // lazytime下每个线程最多缓存的dirty inode数, 超过时立即写回
+
+  int32_t inode_cache_size; // 每个前台线程的DRAM inode缓存大小(字节), 为0时不使用
+
+  int32_t create_cap_lease_ms; // client租用inode异步create的租约时长, 为0时不授予
+};
+
+// 写打开(O_WRONLY/O_RDWR)时更新mtime/atime的策略
+enum TimestampPolicy : int32_t {
+  kTsStrict = 0, // 每次写打开都更新时间戳并写入MetaDb
+  kTsRelatime,   // atime只在不晚于mtime/ctime或超过一天时更新, 时间戳未变化时不写MetaDb
+  kTsNoatime,    // 不更新atime, mtime未变化时不写MetaDb
+  kTsLazytime,   // 时间戳只记录到线程的dirty表, 定时或dirty表满时批量写入MetaDb
+};
+
+// lazytime下尚未写入MetaDb的时间戳
+struct DirtyTimes {
+  time_t mtime;
+  time_t ctime;
+  time_t atime;
+};
+
+// 授予client的一段inode, client只能在租约内用它们在pinode下batch mknod(prealloc)
+struct InodeGrant {
+  metafs_inode_t pinode;
+  metafs_inode_t start_inode;
+  metafs_inode_t end_inode; // [start_inode, end_inode)
+  uint64_t expire_us;
 };
 
 // 每个前台线程的context
@@ -92,12 +136,28 @@ struct server_context {
   rocksdb::DB *log_db;
   erpc::Rpc<erpc::CTransport> *rpc;
 
-  unordered_map<region_id_t, ServerRegion*> region_map;
-  RWLock region_map_lock;
+  // handler在EpochGuard内查找并使用region, split线程删除的region经EBR延迟释放
+  RegionTable region_table;
+
+  // 存储hash(pinode)->pinode, 按hash有序遍历, 用于判断哪些pinode需要随region迁移; 内部分片加锁
+  PinodeTable pinode_table;
+
+  // lazytime下尚未写入MetaDb的时间戳, 只由本线程访问(split线程只迁移dentry, 不读stat)
+  unordered_map<metafs_inode_t, DirtyTimes> dirty_stats;
 
-  // 使用map来直接遍历所有的元素，而不是尝试hash范围中的每一个值
-  std::map<uint64_t, set<metafs_inode_t>> pinode_table; // 存储hash(pinode)->set(pinode)的集合,用于判断哪些pinode可能需要进行迁移
-  RWLock pinode_table_lock;
+  InodeCache *inode_cache; // 没有开启时为nullptr
+
+  // 每个region上尚未到期的inode租约, 只由本线程访问; region迁出后其上的租约随之失效
+  unordered_map<region_id_t, vector<InodeGrant>> inode_grants;
+
+  // 后台任务, 见bg_worker.h
+  uint32_t bg_inflight; // 已提交但还未执行done的任务数, 只由本线程访问
+  threadsafe_queue<BgTask *> bg_done; // worker执行完work的任务
+
+  // 每类请求的处理延迟, 只由本线程更新, 定期打印后清零
+  LatencyHist latency[kNumHandlerClasses];
+  size_t req_start_tsc; // 当前请求开始处理的时间
+  bool req_deferred;    // 当前请求已交给后台, 延迟在done之后统计
 };
 
 // 后台region_split线程的context
@@ -133,6 +193,9 @@ extern threadsafe_queue<pair<size_t, region_id_t>> shared_split_queue;
 
 extern struct split_region_thread_context *st_ctx;
 
+// server_bg_threads为0时为nullptr, 后台任务直接在前台线程执行
+extern BgWorkerPool *bg_pool;
+
 void init_server_config();
 void init_server_context(size_t thread_id);
 void init_and_start_loop();
@@ -163,6 +226,12 @@ void fs_mkdir_handler(erpc::ReqHandle *req_handle, void *_context);
 void fs_readdir_handler(erpc::ReqHandle *req_handle, void *_context);
 void fs_rmdir_handler(erpc::ReqHandle *req_handle, void *_context);
 void fs_getinode_handler(erpc::ReqHandle *req_handle, void *_context);
+void fs_batch_mknod_handler(erpc::ReqHandle *req_handle, void *_context);
+void fs_resolve_path_handler(erpc::ReqHandle *req_handle, void *_context);
+void fs_readdir_plus_handler(erpc::ReqHandle *req_handle, void *_context);
+void fs_open_create_handler(erpc::ReqHandle *req_handle, void *_context);
+void fs_opendir_handler(erpc::ReqHandle *req_handle, void *_context);
+void fs_alloc_inodes_handler(erpc::ReqHandle *req_handle, void *_context);
 
 void read_region_map_handler(erpc::ReqHandle *req_handle, void *_context);
 
@@ -184,6 +253,101 @@ static inline bool check_status_ok(const MetaKvStatus status) {
 
 rpc_resp_t convert_status_to_resptype(MetaKvStatus status);
 
+// 用本线程尚未写回的时间戳覆盖从MetaDb读出的stat
+static inline void overlay_dirty_times(server_context *ctx, metafs_inode_t inode, metafs_stat_t *st) {
+  auto iter = ctx->dirty_stats.find(inode);
+  if(iter != ctx->dirty_stats.end()) {
+    st->mtime = iter->second.mtime;
+    st->ctime = iter->second.ctime;
+    st->atime = iter->second.atime;
+  }
+}
+
+// 读取stat, lazytime下叠加尚未写回的时间戳
+static inline MetaKvStatus get_stat(server_context *ctx, metafs_inode_t inode, MetaKvSlice *stat_slice) {
+  MetaKvStatus status = GetStat(ctx->metadb, inode, stat_slice);
+  if(unlikely(!ctx->dirty_stats.empty()) && check_status_ok(status)) {
+    overlay_dirty_times(ctx, inode, (metafs_stat_t *)(stat_slice->data));
+  }
+  return status;
+}
+
+// 删除inode时丢弃其dirty时间戳
+static inline void drop_dirty_stat(server_context *ctx, metafs_inode_t inode) {
+  if(unlikely(!ctx->dirty_stats.empty())) {
+    ctx->dirty_stats.erase(inode);
+  }
+}
+
+// 前台handler对dentry<pinode+fname -> inode>和stat<inode -> stat>的访问统一经过以下函数
+// metakv中dentry的value固定为8B inode, stat只能按inode单独存取, 查找/创建/删除各需要两次索引操作;
+// metakv支持在dentry中内联stat之后只需修改这里
+// 开启inode_cache时先查DRAM缓存, MetaDb的修改同步写入缓存
+static inline MetaKvStatus lookup_dentry(server_context *ctx, metafs_inode_t pinode, MetaKvSlice *fname_slice,
+                                         metafs_inode_t *inode, MetaKvSlice *stat_slice) {
+  InodeCache *cache = ctx->inode_cache;
+  if(cache != nullptr && cache->Get(pinode, fname_slice->data, inode, (metafs_stat_t *)stat_slice->data)) {
+    return OK;
+  }
+  MetaKvStatus status = GetFileInode(ctx->metadb, pinode, fname_slice, inode);
+  if(likely(check_status_ok(status))) {
+    status = get_stat(ctx, *inode, stat_slice);
+    if(cache != nullptr && likely(check_status_ok(status))) {
+      cache->Put(pinode, fname_slice->data, *inode, *(metafs_stat_t *)stat_slice->data);
+    }
+  }
+  return status;
+}
+
+static inline MetaKvStatus insert_dentry(server_context *ctx, metafs_inode_t pinode, MetaKvSlice *fname_slice,
+                                         metafs_inode_t inode, MetaKvSlice *stat_slice) {
+  MetaKvStatus status = InsertFileInode(ctx->metadb, pinode, fname_slice, inode);
+  if(likely(check_status_ok(status))) {
+    status = InsertStat(ctx->metadb, inode, stat_slice);
+    if(ctx->inode_cache != nullptr && likely(check_status_ok(status))) {
+      ctx->inode_cache->Put(pinode, fname_slice->data, inode, *(metafs_stat_t *)stat_slice->data);
+    }
+  }
+  return status;
+}
+
+static inline MetaKvStatus remove_dentry(server_context *ctx, metafs_inode_t pinode, MetaKvSlice *fname_slice,
+                                         metafs_inode_t *inode) {
+  if(ctx->inode_cache != nullptr) {
+    ctx->inode_cache->Erase(pinode, fname_slice->data);
+  }
+  MetaKvStatus status = DeleteFileInode(ctx->metadb, pinode, fname_slice, inode);
+  if(likely(check_status_ok(status))) {
+    status = DeleteStat(ctx->metadb, *inode);
+    drop_dirty_stat(ctx, *inode);
+  }
+  return status;
+}
+
+// 写打开时按s_cfg->ts_policy更新stat_slice中的时间戳, 需要时写入MetaDb, 并同步到inode_cache
+MetaKvStatus touch_stat_on_write_open(server_context *ctx, metafs_inode_t pinode, MetaKvSlice *fname_slice,
+                                      metafs_inode_t inode, MetaKvSlice *stat_slice, bool trunc);
+
+// 将线程的dirty时间戳批量写回MetaDb
+void flush_dirty_stats(server_context *ctx);
+
+// 前台handler把task交给bg_pool, 没有bg_pool时直接执行work和done
+void submit_bg_task(BgTask *task);
+
+// 在前台线程执行worker已完成的任务的done
+void poll_bg_tasks(server_context *ctx);
+
+static inline void record_latency(server_context *ctx, HandlerClass cls, size_t start_tsc) {
+  ctx->latency[cls].record((uint64_t)((erpc::rdtsc() - start_tsc) / ctx->rpc->get_freq_ghz()));
+}
+
+// 回复响应, 在响应头中附带当前region map epoch, client据此发现本地region map已过期
+static inline void enqueue_resp(erpc::Rpc<erpc::CTransport> *rpc, erpc::ReqHandle *req_handle, size_t resp_size) {
+  reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->map_epoch = global_region_epoch.load();
+  rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, resp_size);
+  rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+}
+
 /// A basic session management handler that expects successful responses
 static inline void st_basic_sm_handler(int session_num, erpc::SmEventType sm_event_type,
                       erpc::SmErrType sm_err_type, void *_context) {
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "common/fs.h"
+
+namespace metafs {
+
+// 服务线程的目录表: 记录hash(pinode) -> pinode, region分裂时按hash区间找出需要迁移的目录
+// hash值域按高kShardBits位分成kShards个分片, 每个分片再按之后的kBucketBits位分成kBuckets个桶,
+// 分片和桶都与hash值的顺序一致, 可以按hash区间有序遍历;
+// 每个桶是按(hash, pinode)有序的紧凑数组, 每个目录只占16B; 分片各自加锁, mkdir/rmdir与迁移扫描只在同一分片上互斥
+class PinodeTable {
+public:
+    struct Entry {
+        uint64_t hash;
+        metafs_inode_t pinode;
+
+        bool operator<(const Entry &other) const {
+            return hash < other.hash || (hash == other.hash && pinode < other.pinode);
+        }
+        bool operator==(const Entry &other) const {
+            return hash == other.hash && pinode == other.pinode;
+        }
+    };
+
+    PinodeTable() : shards_(new Shard[kShards]) {}
+
+    ~PinodeTable() {
+        delete[] shards_;
+    }
+
+    PinodeTable(const PinodeTable &) = delete;
+    PinodeTable &operator=(const PinodeTable &) = delete;
+
+    // 已存在时返回false
+    bool insert(uint64_t hash, metafs_inode_t pinode) {
+        Entry e{hash, pinode};
+        Shard &shard = shards_[shard_index(hash)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::vector<Entry> &bucket = shard.buckets[bucket_index(hash)];
+        auto iter = std::lower_bound(bucket.begin(), bucket.end(), e);
+        if(iter != bucket.end() && *iter == e) {
+            return false;
+        }
+        bucket.insert(iter, e);
+        shard.num_entries++;
+        return true;
+    }
+
+    // 不存在时返回false
+    bool erase(uint64_t hash, metafs_inode_t pinode) {
+        Entry e{hash, pinode};
+        Shard &shard = shards_[shard_index(hash)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        std::vector<Entry> &bucket = shard.buckets[bucket_index(hash)];
+        auto iter = std::lower_bound(bucket.begin(), bucket.end(), e);
+        if(iter == bucket.end() || !(*iter == e)) {
+            return false;
+        }
+        bucket.erase(iter);
+        shard.num_entries--;
+        shrink(bucket);
+        return true;
+    }
+
+    // 查找hash <= end_hash且(hash, pinode)不小于给定值的第一个目录, 用于分批遍历一个hash区间;
+    // 每次调用只短暂持有一个分片的锁, 两次调用之间的插入/删除可能看得到也可能看不到
+    bool lower_bound(uint64_t hash, metafs_inode_t pinode, uint64_t end_hash, Entry *out) {
+        Entry key{hash, pinode};
+        while(key.hash <= end_hash) {
+            Shard &shard = shards_[shard_index(key.hash)];
+            {
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if(shard.num_entries != 0) {
+                    // 在本分片内从key所在的桶开始向后找
+                    for(uint32_t b = bucket_index(key.hash); b < kBuckets; b++) {
+                        const std::vector<Entry> &bucket = shard.buckets[b];
+                        auto iter = std::lower_bound(bucket.begin(), bucket.end(), key);
+                        if(iter != bucket.end()) {
+                            if(iter->hash > end_hash) {
+                                return false;
+                            }
+                            *out = *iter;
+                            return true;
+                        }
+                    }
+                }
+            }
+            // 下一个分片
+            uint64_t next_hash = (uint64_t)(shard_index(key.hash) + 1) << (64 - kShardBits);
+            if(next_hash == 0) {
+                break; // 已经是最后一个分片
+            }
+            key = Entry{next_hash, 0};
+        }
+        return false;
+    }
+
+    // 删除hash在[start_hash, end_hash]内的所有目录, 返回删除的数量; region迁出后调用
+    size_t erase_range(uint64_t start_hash, uint64_t end_hash) {
+        size_t erased = 0;
+        for(uint32_t s = shard_index(start_hash); s <= shard_index(end_hash); s++) {
+            Shard &shard = shards_[s];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            if(shard.num_entries == 0) {
+                continue;
+            }
+            uint32_t first = (s == shard_index(start_hash)) ? bucket_index(start_hash) : 0;
+            uint32_t last = (s == shard_index(end_hash)) ? bucket_index(end_hash) : kBuckets - 1;
+            for(uint32_t b = first; b <= last; b++) {
+                std::vector<Entry> &bucket = shard.buckets[b];
+                auto begin = std::lower_bound(bucket.begin(), bucket.end(), Entry{start_hash, 0});
+                auto end = std::upper_bound(begin, bucket.end(), Entry{end_hash, ~(metafs_inode_t)0});
+                size_t n = end - begin;
+                if(n != 0) {
+                    bucket.erase(begin, end);
+                    shard.num_entries -= n;
+                    erased += n;
+                    shrink(bucket);
+                }
+            }
+        }
+        return erased;
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for(uint32_t s = 0; s < kShards; s++) {
+            std::lock_guard<std::mutex> lock(shards_[s].mutex);
+            n += shards_[s].num_entries;
+        }
+        return n;
+    }
+
+private:
+    static const uint32_t kShardBits = 6;
+    static const uint32_t kShards = 1U << kShardBits;
+    static const uint32_t kBucketBits = 8; // 空表约占kShards * kBuckets * 24B = 384KB
+    static const uint32_t kBuckets = 1U << kBucketBits;
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        size_t num_entries = 0;
+        std::vector<Entry> buckets[kBuckets];
+    };
+
+    static inline uint32_t shard_index(uint64_t hash) {
+        return (uint32_t)(hash >> (64 - kShardBits));
+    }
+
+    static inline uint32_t bucket_index(uint64_t hash) {
+        return (uint32_t)(hash >> (64 - kShardBits - kBucketBits)) & (kBuckets - 1);
+    }
+
+    // 大量删除后释放多余的容量
+    static inline void shrink(std::vector<Entry> &bucket) {
+        if(bucket.capacity() > 64 && bucket.size() < bucket.capacity() / 4) {
+            bucket.shrink_to_fit();
+        }
+    }
+
+    Shard *shards_;
+};
+
+} // end namespace metafs
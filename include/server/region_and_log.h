@@ -42,7 +42,7 @@ struct put_log_val {
     char fname[METAFS_MAX_FNAME_LEN];
 
     put_log_val(metafs_inode_t pinode, metafs_inode_t inode, const char *str, const metafs_stat_t *st) 
-                    : pinode(pinode), inode(inode) {
+                    : pinode(pinode), inode(inode), only_update_stat(false) {
         memcpy((void*)&stat, (void*)st, metafs_stat_size);
         p_assert(strlen(str) < METAFS_MAX_FNAME_LEN, "fname is too long");
         strcpy(fname, str);
@@ -83,6 +83,10 @@ void log_op(ServerRegion *region, bool is_delete_op,
         metafs_inode_t pinode, const char *fname,
         const metafs_stat_t *stat = nullptr, metafs_inode_t inode = 0);
 
+// batch mknod时将同一目录下的多个put op合并为一次log写入
+void log_put_ops(ServerRegion *region, metafs_inode_t pinode, int32_t num_ops,
+        const char *const *fnames, const metafs_stat_t *stats, const metafs_inode_t *inodes);
+
 // region RPC interfaces
 // origin server向target server发送create_region RPC
 void rpc_create_region(region_id_t region_id);
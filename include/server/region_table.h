@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+#include "common/region.h"
+#include "util/epoch.h"
+
+namespace metafs {
+
+// 服务线程的region表, RCU方式读取
+// 表的内容是不可变的快照, 读者在EpochGuard内一次原子load拿到快照后无锁查找;
+// 写者(注册/分裂/迁移完成, 很少发生)在write_lock_内拷贝当前快照, 修改后发布新快照, 旧快照交给EBR延迟释放
+// 每个线程只有几个region, 快照使用按region_id有序的数组
+class RegionTable {
+public:
+    typedef std::pair<region_id_t, ServerRegion *> Entry;
+
+    struct Snapshot {
+        uint64_t version; // 每次发布递增
+        std::vector<Entry> regions;
+    };
+
+    RegionTable() : snap_(new Snapshot{0, {}}) {}
+
+    // 调用者需要在EpochGuard内, 返回的快照在退出EpochGuard之前有效
+    const Snapshot *snapshot() const {
+        return snap_.load(std::memory_order_acquire);
+    }
+
+    // 不存在时返回nullptr, 不会像unordered_map::operator[]一样插入空项
+    ServerRegion *find(region_id_t region_id) const {
+        const Snapshot *snap = snapshot();
+        auto iter = std::lower_bound(snap->regions.begin(), snap->regions.end(), region_id,
+                        [](const Entry &e, region_id_t id) { return e.first < id; });
+        if(iter != snap->regions.end() && iter->first == region_id) {
+            return iter->second;
+        }
+        return nullptr;
+    }
+
+    // 已存在时覆盖
+    void insert(region_id_t region_id, ServerRegion *region) {
+        update([&](std::vector<Entry> &regions) {
+            auto iter = std::lower_bound(regions.begin(), regions.end(), region_id,
+                            [](const Entry &e, region_id_t id) { return e.first < id; });
+            if(iter != regions.end() && iter->first == region_id) {
+                iter->second = region;
+            } else {
+                regions.insert(iter, Entry(region_id, region));
+            }
+        });
+    }
+
+    void erase(region_id_t region_id) {
+        update([&](std::vector<Entry> &regions) {
+            auto iter = std::lower_bound(regions.begin(), regions.end(), region_id,
+                            [](const Entry &e, region_id_t id) { return e.first < id; });
+            if(iter != regions.end() && iter->first == region_id) {
+                regions.erase(iter);
+            }
+        });
+    }
+
+private:
+    template <typename F>
+    void update(F modify) {
+        std::lock_guard<std::mutex> lock(write_lock_);
+        Snapshot *old_snap = snap_.load(std::memory_order_relaxed);
+        Snapshot *new_snap = new Snapshot(*old_snap);
+        new_snap->version++;
+        modify(new_snap->regions);
+        snap_.store(new_snap, std::memory_order_release);
+        EpochManager::instance().retire(old_snap);
+    }
+
+    std::mutex write_lock_;
+    std::atomic<Snapshot *> snap_;
+};
+
+} // end namespace metafs
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+#include "common/common.h"
+
+namespace metafs {
+
+// 读者偏向的读写锁(brlock)
+// 每个线程固定使用一个独占cache line的读者计数, 读锁只修改自己的计数再检查writer标志, 读者之间不共享cache line;
+// 写者先置writer标志阻止新读者, 再等待所有读者计数归零, 写锁的开销与读者槽数成正比, 适合读多写少的场景
+// 与RWLock接口相同, 可以直接用于ReadGuard/WriteGuard; 同RWLock一样不可重入
+class BRLock {
+public:
+    static const int kReaderSlots = 64; // 线程数超过时多个线程共享一个槽
+    static const int kSpinLimit = 128;
+
+    struct Stats {
+        uint64_t read_contended;  // 读锁遇到写者而等待的次数
+        uint64_t write_contended; // 写锁遇到其他写者而等待的次数
+        uint64_t write_drain;     // 写锁等待读者退出的次数
+    };
+
+    BRLock() : writer_(false), read_contended_(0), write_contended_(0), write_drain_(0) {}
+
+    BRLock(const BRLock &) = delete;
+    BRLock &operator=(const BRLock &) = delete;
+
+    void lockRead() {
+        std::atomic<int32_t> &readers = slots_[thread_slot()].readers;
+        while(true) {
+            // 先发布读者再检查writer, 与lockWrite中先置标志再检查读者对应(都是seq_cst)
+            readers.fetch_add(1, std::memory_order_seq_cst);
+            if(likely(!writer_.load(std::memory_order_seq_cst))) {
+                return;
+            }
+            readers.fetch_sub(1, std::memory_order_release);
+            read_contended_.fetch_add(1, std::memory_order_relaxed);
+            int spins = 0;
+            while(writer_.load(std::memory_order_relaxed)) {
+                backoff(spins);
+            }
+        }
+    }
+
+    void unlockRead() {
+        slots_[thread_slot()].readers.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lockWrite() {
+        bool expected = false;
+        if(unlikely(!writer_.compare_exchange_strong(expected, true, std::memory_order_seq_cst))) {
+            write_contended_.fetch_add(1, std::memory_order_relaxed);
+            int spins = 0;
+            do {
+                expected = false;
+                backoff(spins);
+            } while(writer_.load(std::memory_order_relaxed) ||
+                    !writer_.compare_exchange_weak(expected, true, std::memory_order_seq_cst));
+        }
+        for(int i = 0; i < kReaderSlots; i++) {
+            if(unlikely(slots_[i].readers.load(std::memory_order_seq_cst) != 0)) {
+                write_drain_.fetch_add(1, std::memory_order_relaxed);
+                int spins = 0;
+                while(slots_[i].readers.load(std::memory_order_acquire) != 0) {
+                    backoff(spins);
+                }
+            }
+        }
+    }
+
+    void unlockWrite() {
+        writer_.store(false, std::memory_order_release);
+    }
+
+    Stats stats() const {
+        return Stats{read_contended_.load(std::memory_order_relaxed),
+                     write_contended_.load(std::memory_order_relaxed),
+                     write_drain_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct alignas(64) ReaderSlot {
+        std::atomic<int32_t> readers{0};
+    };
+
+    // 先自旋, 等待较久时(持锁线程可能被调度出去)让出CPU
+    static inline void backoff(int &spins) {
+        if(++spins < kSpinLimit) {
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    // 线程第一次使用时按顺序分配槽, 所有BRLock共用同一个编号
+    static int thread_slot() {
+        static std::atomic<uint32_t> next_slot(0);
+        static thread_local int slot = next_slot.fetch_add(1, std::memory_order_relaxed) % kReaderSlots;
+        return slot;
+    }
+
+    ReaderSlot slots_[kReaderSlots];
+    alignas(64) std::atomic<bool> writer_;
+    alignas(64) std::atomic<uint64_t> read_contended_;
+    std::atomic<uint64_t> write_contended_;
+    std::atomic<uint64_t> write_drain_;
+};
+
+} // end namespace metafs
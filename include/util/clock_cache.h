@@ -0,0 +1,243 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <mutex>
+
+#include "common/common.h"
+
+namespace metafs {
+
+// 不加锁, 单线程使用时作为ClockCache的TLock
+struct NullLock {
+    void lock() {}
+    void unlock() {}
+};
+
+// 分片CLOCK缓存, 不在查找路径上分配内存
+// key为两个64位整数(key1, key2), 另存32位指纹fp, 用于区分key2本身是hash值时的冲突
+// 每个分片是一个线性探测的开放寻址表, 槽位数组按cache line对齐; 分片满时用CLOCK算法淘汰
+// 查找/插入/删除只持有所在分片的锁, TValue需要可默认构造和拷贝
+template <class TValue, class TLock = std::mutex>
+class ClockCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        uint64_t entries;
+    };
+
+    // capacity_bytes: 所有分片槽位数组占用的总字节数; num_shards会向下取整为2的幂
+    ClockCache(size_t capacity_bytes, size_t num_shards = 64) {
+        shard_bits_ = 0;
+        while(((size_t)2 << shard_bits_) <= num_shards && shard_bits_ < 16) {
+            shard_bits_++;
+        }
+        num_shards_ = (size_t)1 << shard_bits_;
+
+        size_t shard_bytes = capacity_bytes / num_shards_;
+        size_t num_slots = kMinSlots;
+        while(num_slots * 2 * sizeof(Slot) <= shard_bytes) {
+            num_slots *= 2;
+        }
+
+        shards_ = new Shard[num_shards_];
+        for(size_t i = 0; i < num_shards_; i++) {
+            Shard &shard = shards_[i];
+            void *mem = nullptr;
+            int ret = posix_memalign(&mem, kCacheLineSize, num_slots * sizeof(Slot));
+            p_assert(ret == 0, "alloc clock cache fail");
+            shard.slots = static_cast<Slot *>(mem);
+            for(size_t j = 0; j < num_slots; j++) {
+                new (&shard.slots[j]) Slot();
+            }
+            shard.mask = num_slots - 1;
+            // 负载因子3/4, 保证线性探测的链足够短
+            shard.max_entries = num_slots / 4 * 3;
+        }
+    }
+
+    ~ClockCache() {
+        for(size_t i = 0; i < num_shards_; i++) {
+            for(size_t j = 0; j <= shards_[i].mask; j++) {
+                shards_[i].slots[j].~Slot();
+            }
+            free(shards_[i].slots);
+        }
+        delete[] shards_;
+    }
+
+    ClockCache(const ClockCache &) = delete;
+    ClockCache &operator=(const ClockCache &) = delete;
+
+    bool Get(uint64_t key1, uint64_t key2, uint32_t fp, TValue *value) {
+        uint64_t h = hash(key1, key2);
+        Shard &shard = get_shard(h);
+        std::lock_guard<TLock> guard(shard.lock);
+        Slot *slot = find(shard, h, key1, key2, fp);
+        if(slot == nullptr) {
+            shard.misses++;
+            return false;
+        }
+        slot->ref = 1;
+        *value = slot->value;
+        shard.hits++;
+        return true;
+    }
+
+    void Put(uint64_t key1, uint64_t key2, uint32_t fp, const TValue &value) {
+        uint64_t h = hash(key1, key2);
+        Shard &shard = get_shard(h);
+        std::lock_guard<TLock> guard(shard.lock);
+        Slot *slot = find(shard, h, key1, key2, fp);
+        if(slot != nullptr) {
+            slot->value = value;
+            slot->ref = 1;
+            return;
+        }
+        if(shard.num_entries >= shard.max_entries) {
+            evict_one(shard);
+        }
+        // 新插入的条目ref为0, 只访问一次的条目在下一轮CLOCK扫描时被淘汰
+        uint32_t i = h & shard.mask;
+        while(shard.slots[i].used) {
+            i = (i + 1) & shard.mask;
+        }
+        slot = &shard.slots[i];
+        slot->key1 = key1;
+        slot->key2 = key2;
+        slot->fp = fp;
+        slot->used = 1;
+        slot->ref = 0;
+        slot->value = value;
+        shard.num_entries++;
+    }
+
+    bool Erase(uint64_t key1, uint64_t key2, uint32_t fp) {
+        uint64_t h = hash(key1, key2);
+        Shard &shard = get_shard(h);
+        std::lock_guard<TLock> guard(shard.lock);
+        Slot *slot = find(shard, h, key1, key2, fp);
+        if(slot == nullptr) {
+            return false;
+        }
+        erase_at(shard, slot - shard.slots);
+        return true;
+    }
+
+    Stats GetStats() {
+        Stats stats = {0, 0, 0, 0};
+        for(size_t i = 0; i < num_shards_; i++) {
+            std::lock_guard<TLock> guard(shards_[i].lock);
+            stats.hits += shards_[i].hits;
+            stats.misses += shards_[i].misses;
+            stats.evictions += shards_[i].evictions;
+            stats.entries += shards_[i].num_entries;
+        }
+        return stats;
+    }
+
+    // 最多能缓存的条目数
+    size_t Capacity() const {
+        return num_shards_ * shards_[0].max_entries;
+    }
+
+private:
+    static const size_t kCacheLineSize = 64;
+    static const size_t kMinSlots = 16;
+
+    struct Slot {
+        uint64_t key1;
+        uint64_t key2;
+        uint32_t fp;
+        uint8_t used;
+        uint8_t ref; // CLOCK访问位
+        TValue value;
+        Slot() : key1(0), key2(0), fp(0), used(0), ref(0), value() {}
+    };
+
+    // 分片按cache line对齐, 避免不同分片的锁和计数器伪共享
+    struct alignas(64) Shard {
+        TLock lock;
+        Slot *slots = nullptr;
+        uint32_t mask = 0;
+        uint32_t max_entries = 0;
+        uint32_t num_entries = 0;
+        uint32_t hand = 0; // CLOCK指针
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    static inline uint64_t hash(uint64_t key1, uint64_t key2) {
+        uint64_t h = key2 ^ (key1 * 0x9E3779B97F4A7C15ULL);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // 高位选分片, 低位选槽位
+    inline Shard &get_shard(uint64_t h) {
+        return shards_[shard_bits_ == 0 ? 0 : (h >> (64 - shard_bits_))];
+    }
+
+    static inline Slot *find(Shard &shard, uint64_t h, uint64_t key1, uint64_t key2, uint32_t fp) {
+        uint32_t i = h & shard.mask;
+        while(shard.slots[i].used) {
+            Slot *slot = &shard.slots[i];
+            if(slot->key2 == key2 && slot->key1 == key1 && slot->fp == fp) {
+                return slot;
+            }
+            i = (i + 1) & shard.mask;
+        }
+        return nullptr;
+    }
+
+    static void evict_one(Shard &shard) {
+        while(true) {
+            Slot &slot = shard.slots[shard.hand];
+            if(slot.used) {
+                if(slot.ref) {
+                    slot.ref = 0;
+                } else {
+                    // 删除后该位置可能被后移的条目填上, hand不前进, 下次从该位置继续扫描
+                    erase_at(shard, shard.hand);
+                    shard.evictions++;
+                    return;
+                }
+            }
+            shard.hand = (shard.hand + 1) & shard.mask;
+        }
+    }
+
+    // 线性探测表的删除: 把后续同一探测链上的条目前移填补空位, 不使用墓碑
+    static void erase_at(Shard &shard, uint32_t i) {
+        uint32_t j = i;
+        while(true) {
+            j = (j + 1) & shard.mask;
+            Slot &next = shard.slots[j];
+            if(!next.used) {
+                break;
+            }
+            uint32_t home = hash(next.key1, next.key2) & shard.mask;
+            // home不在(i, j]区间内时, 说明该条目的探测链经过i, 需要前移到i
+            bool stay = (i < j) ? (home > i && home <= j) : (home > i || home <= j);
+            if(!stay) {
+                shard.slots[i] = next;
+                i = j;
+            }
+        }
+        shard.slots[i].used = 0;
+        shard.slots[i].ref = 0;
+        shard.num_entries--;
+    }
+
+    Shard *shards_;
+    size_t num_shards_;
+    uint32_t shard_bits_;
+};
+
+} // end namespace metafs
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+namespace metafs {
+
+// 元数据时间戳(秒级)使用的粗粒度时钟
+// CLOCK_REALTIME_COARSE由vDSO读取内核每个tick更新的时间, 不陷入内核, 精度为一个tick(1~4ms), 对秒级时间戳足够
+// server线程在event loop每一轮调用refresh(), handler中的now()只是一次原子load;
+// 没有线程驱动时(例如client), now()直接读取CLOCK_REALTIME_COARSE
+class CoarseClock {
+public:
+    // 当前时间(秒)
+    static inline time_t now() {
+        if(driven_.load(std::memory_order_relaxed)) {
+            return now_.load(std::memory_order_relaxed);
+        }
+        return read_ms() / 1000;
+    }
+
+    // 刷新缓存的时间, 返回刷新时的毫秒时间供调用者做定时
+    // 秒数变化时才写共享变量, 多个server线程同时刷新不会互相使cache line失效
+    static inline uint64_t refresh() {
+        uint64_t ms = read_ms();
+        time_t sec = (time_t)(ms / 1000);
+        if(now_.load(std::memory_order_relaxed) != sec) {
+            now_.store(sec, std::memory_order_relaxed);
+        }
+        if(!driven_.load(std::memory_order_relaxed)) {
+            driven_.store(true, std::memory_order_relaxed);
+        }
+        return ms;
+    }
+
+    static inline uint64_t read_ms() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+private:
+    static inline std::atomic<time_t> now_{0};
+    static inline std::atomic<bool> driven_{false};
+};
+
+} // end namespace metafs
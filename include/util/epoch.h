@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#include "common/common.h"
+
+namespace metafs {
+
+// 基于epoch的内存回收(EBR)
+// 读者在EpochGuard内无锁地读取共享指针并使用其指向的对象, 只有两次原子store, 不会阻塞;
+// 写者把对象从共享结构中摘下后调用retire, 等retire之后全局epoch推进两次(所有当时的读者都已退出)才真正释放
+// 每个线程第一次使用时注册一个记录, 线程退出后记录(连同未释放的对象)由之后的线程复用
+class EpochManager {
+public:
+    static EpochManager &instance() {
+        // 不析构, 进程退出时其他线程可能仍在临界区内
+        static EpochManager *mgr = new EpochManager();
+        return *mgr;
+    }
+
+    // 可嵌套
+    void enter() {
+        ThreadRecord *rec = local_record();
+        if(rec->nesting++ == 0) {
+            rec->epoch.store(global_epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            // 保证之后对共享指针的读取不会早于epoch的发布
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    void exit() {
+        ThreadRecord *rec = local_record();
+        if(--rec->nesting == 0) {
+            rec->epoch.store(kIdle, std::memory_order_release);
+        }
+    }
+
+    // ptr已经不能被新的读者访问到, 等当前所有读者退出后调用deleter(ptr)
+    void retire(void *ptr, void (*deleter)(void *)) {
+        ThreadRecord *rec = local_record();
+        rec->limbo.push_back({ptr, deleter, global_epoch_.load(std::memory_order_acquire)});
+        if(rec->limbo.size() >= kReclaimThreshold) {
+            reclaim(rec);
+        }
+    }
+
+    template <typename T>
+    void retire(T *ptr) {
+        retire(ptr, [](void *p) { delete static_cast<T *>(p); });
+    }
+
+private:
+    static const uint64_t kIdle = UINT64_MAX; // 不在临界区内
+    static const size_t kReclaimThreshold = 64;
+
+    struct Retired {
+        void *ptr;
+        void (*deleter)(void *);
+        uint64_t epoch; // retire时的全局epoch
+    };
+
+    struct ThreadRecord {
+        std::atomic<uint64_t> epoch{kIdle}; // 进入临界区时看到的全局epoch
+        std::atomic<bool> in_use{true};
+        uint32_t nesting = 0;
+        std::vector<Retired> limbo; // 按epoch递增
+        ThreadRecord *next = nullptr;
+    };
+
+    // 线程退出时归还记录
+    struct LocalHandle {
+        ThreadRecord *rec = nullptr;
+        ~LocalHandle() {
+            if(rec != nullptr) {
+                EpochManager::instance().reclaim(rec);
+                rec->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    EpochManager() : global_epoch_(0), records_(nullptr) {}
+
+    ThreadRecord *local_record() {
+        static thread_local LocalHandle handle;
+        if(unlikely(handle.rec == nullptr)) {
+            handle.rec = acquire_record();
+        }
+        return handle.rec;
+    }
+
+    ThreadRecord *acquire_record() {
+        for(ThreadRecord *rec = records_.load(std::memory_order_acquire); rec != nullptr; rec = rec->next) {
+            bool expected = false;
+            if(!rec->in_use.load(std::memory_order_relaxed) &&
+                    rec->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return rec;
+            }
+        }
+        // 记录只增不删, 数量不超过同时存在的最大线程数
+        ThreadRecord *rec = new ThreadRecord();
+        ThreadRecord *head = records_.load(std::memory_order_relaxed);
+        do {
+            rec->next = head;
+        } while(!records_.compare_exchange_weak(head, rec, std::memory_order_release, std::memory_order_relaxed));
+        return rec;
+    }
+
+    // 所有临界区内的线程都已看到当前epoch时推进全局epoch
+    void try_advance() {
+        uint64_t cur = global_epoch_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for(ThreadRecord *rec = records_.load(std::memory_order_acquire); rec != nullptr; rec = rec->next) {
+            uint64_t e = rec->epoch.load(std::memory_order_relaxed);
+            if(e != kIdle && e != cur) {
+                return;
+            }
+        }
+        global_epoch_.compare_exchange_strong(cur, cur + 1, std::memory_order_acq_rel);
+    }
+
+    void reclaim(ThreadRecord *rec) {
+        try_advance();
+        uint64_t safe = global_epoch_.load(std::memory_order_acquire);
+        size_t n = 0;
+        while(n < rec->limbo.size() && rec->limbo[n].epoch + 2 <= safe) {
+            rec->limbo[n].deleter(rec->limbo[n].ptr);
+            n++;
+        }
+        rec->limbo.erase(rec->limbo.begin(), rec->limbo.begin() + n);
+    }
+
+    std::atomic<uint64_t> global_epoch_;
+    std::atomic<ThreadRecord *> records_;
+};
+
+// 作用域内的读者临界区
+class EpochGuard {
+public:
+    EpochGuard() {
+        EpochManager::instance().enter();
+    }
+
+    ~EpochGuard() {
+        EpochManager::instance().exit();
+    }
+
+private:
+    EpochGuard(const EpochGuard&);
+    EpochGuard& operator=(const EpochGuard&);
+};
+
+} // end namespace metafs
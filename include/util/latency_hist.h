@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace metafs {
+
+// 延迟直方图, 单位ns, 只由一个线程更新
+// 每个2的幂区间再分成kSub个子桶, 分位数的相对误差不超过1/kSub
+class LatencyHist {
+public:
+    static const int kSubBits = 2;
+    static const int kSub = 1 << kSubBits;
+    static const int kBuckets = 64 * kSub;
+
+    LatencyHist() {
+        reset();
+    }
+
+    void record(uint64_t ns) {
+        buckets_[bucket_index(ns)]++;
+        count_++;
+        sum_ns_ += ns;
+        if(ns > max_ns_) {
+            max_ns_ = ns;
+        }
+    }
+
+    uint64_t count() const {
+        return count_;
+    }
+
+    uint64_t avg_ns() const {
+        return count_ == 0 ? 0 : sum_ns_ / count_;
+    }
+
+    uint64_t max_ns() const {
+        return max_ns_;
+    }
+
+    // 返回第p(0~100)百分位所在桶的上界
+    uint64_t percentile_ns(double p) const {
+        if(count_ == 0) {
+            return 0;
+        }
+        uint64_t target = (uint64_t)(count_ * p / 100);
+        if(target >= count_) {
+            target = count_ - 1;
+        }
+        uint64_t seen = 0;
+        for(int i = 0; i < kBuckets; i++) {
+            seen += buckets_[i];
+            if(seen > target) {
+                uint64_t upper = bucket_upper(i);
+                return upper < max_ns_ ? upper : max_ns_;
+            }
+        }
+        return max_ns_;
+    }
+
+    void reset() {
+        memset(buckets_, 0, sizeof(buckets_));
+        count_ = 0;
+        sum_ns_ = 0;
+        max_ns_ = 0;
+    }
+
+private:
+    static inline int bucket_index(uint64_t ns) {
+        if(ns < kSub) {
+            return (int)ns;
+        }
+        int msb = 63 - __builtin_clzll(ns);
+        return ((msb - kSubBits + 1) << kSubBits) + (int)((ns >> (msb - kSubBits)) & (kSub - 1));
+    }
+
+    static inline uint64_t bucket_upper(int index) {
+        if(index < kSub) {
+            return index;
+        }
+        int msb = (index >> kSubBits) + kSubBits - 1;
+        uint64_t width = 1ULL << (msb - kSubBits);
+        return (1ULL << msb) + (uint64_t)(index & (kSub - 1)) * width + width - 1;
+    }
+
+    uint64_t buckets_[kBuckets];
+    uint64_t count_;
+    uint64_t sum_ns_;
+    uint64_t max_ns_;
+};
+
+} // end namespace metafs
@@ -54,9 +54,11 @@ class RWLock {
     std::condition_variable m_writeCond;
 };
 
+// Lock为RWLock或BRLock等提供lockRead/unlockRead/lockWrite/unlockWrite的锁, 由构造参数推导
+template <typename Lock>
 class ReadGuard {
  public:
-    ReadGuard(RWLock& lock) : m_lock(lock) {
+    ReadGuard(Lock& lock) : m_lock(lock) {
         m_lock.lockRead();
     }
 
@@ -69,12 +71,13 @@ class ReadGuard {
     ReadGuard& operator=(const ReadGuard&);
 
  private:
-    RWLock &m_lock;
+    Lock &m_lock;
 };
 
+template <typename Lock>
 class WriteGuard {
  public:
-    WriteGuard(RWLock &lock) : m_lock(lock) {
+    WriteGuard(Lock &lock) : m_lock(lock) {
         m_lock.lockWrite();
     }
 
@@ -87,7 +90,7 @@ class WriteGuard {
     WriteGuard& operator=(const WriteGuard&);
 
  private:
-  RWLock& m_lock;
+  Lock& m_lock;
 };
 
 } /* namespace linduo */
@@ -55,6 +55,10 @@ struct client_config *c_cfg;
 
 struct client_context *c_ctx;
 
+thread_local struct client_rpc_context *c_rpc_ctx = nullptr;
+
+thread_local struct route_table_cache c_route_cache = {nullptr, 0};
+
 // parse client_json
 struct client_config *client_parse_config(const char *fn) {
     p_assert(fn, "no config file");
@@ -68,6 +72,11 @@ struct client_config *client_parse_config(const char *fn) {
         {"mount_dir", offsetof(struct client_config, mountdir), cJSON_String, "/tmp/metafs"},
         {"memcached_ip", offsetof(struct client_config, memcached_ip), cJSON_String, "localhost"},
         {"memcached_port", offsetof(struct client_config, memcached_port), cJSON_Number, "0"},
+        {"dentry_cache_size", offsetof(struct client_config, dentry_cache_size), cJSON_Number, "67108864"},
+        {"negative_dentry_timeout_ms", offsetof(struct client_config, negative_dentry_timeout_ms), cJSON_Number, "1000"},
+        {"attr_timeout_ms", offsetof(struct client_config, attr_timeout_ms), cJSON_Number, "0"},
+        {"dentry_attr_timeout_ms", offsetof(struct client_config, dentry_attr_timeout_ms), cJSON_Number, "1000"},
+        {"async_create_inodes", offsetof(struct client_config, async_create_inodes), cJSON_Number, "0"},
         {NULL, 0, 0, NULL},
     };
 
@@ -86,7 +95,7 @@ void init_client_ctx() {
     // init client context 
     c_ctx = new client_context();
 #ifdef USE_CACHE
-    c_ctx->dentry_cache = new DentryCache<DirentryValue>(10000);
+    c_ctx->dentry_cache = new DentryCache<DirentryValue>(c_cfg->dentry_cache_size);
     assert(c_ctx->dentry_cache != NULL);
 #else 
     c_ctx->dentry_cache = nullptr;
@@ -108,6 +117,10 @@ void init_client_ctx() {
     printf("client uri: %s\n", c_ctx->local_uri);
 
     c_ctx->total_servers = c_cfg->num_servers * c_cfg->server_fg_threads;
+    c_ctx->synced_map_epoch = std::vector<std::atomic<uint64_t>>(c_cfg->num_servers);
+    c_ctx->seen_map_epoch = std::vector<std::atomic<uint64_t>>(c_cfg->num_servers);
+    p_assert(c_cfg->num_client_threads > 0 && c_cfg->num_client_threads <= erpc::kMaxRpcId, 
+                "invalid client_threads: %d", c_cfg->num_client_threads);
     
     // inti erpc
     c_ctx->nexus_ = new erpc::Nexus(local_uri, 0, c_cfg->server_bg_threads);
@@ -164,8 +177,6 @@ void init_client_ctx() {
 // res记录标准规定的错误值
 // return 1/0, 1代表hook失败, 0代表hook成功
 
-// TODO:每次opendir都会打开fd，然后使用fd getattr，所以需要在fd中存储stat,不然rpc次数太多了
-
 // res记录fd
 int hook_openat(int dirfd, const char* cpath, int flags, mode_t mode, long *res) {
     // if(flags & O_PATH || flags & O_APPEND || flags & O_EXCL) {
@@ -220,14 +231,25 @@ int hook_openat(int dirfd, const char* cpath, int flags, mode_t mode, long *res)
             }
             // 目录不创建fd
         } else {
-            ret = METAFS_CLIENT->Mknod(pinode, fname, mode | S_IFREG, inode, stat);
+            // 已存在时直接打开(O_EXCL除外), 打开或创建只需要一次RPC
+            ret = METAFS_CLIENT->OpenCreate(pinode, fname, mode | S_IFREG, flags, inode, stat);
             if(ret != 0) {
-                *res = -EEXIST;
+                *res = ret;
                 return 0;
             }
-            *res = METAFS_CLIENT->file_map()->add(make_shared<OpenFile>(realpath, flags, pinode, fname, inode));
+            *res = METAFS_CLIENT->file_map()->add(make_shared<OpenFile>(realpath, flags, pinode, fname, inode, stat));
         }
         return 0;
+    } else if(flags & O_DIRECTORY) {
+        FS_LOG("opendir");
+        shared_ptr<OpenDir> open_dir;
+        int ret = METAFS_CLIENT->Opendir(realpath, pinode, fname, open_dir);
+        if(ret != 0) {
+            *res = ret;
+            return 0;
+        }
+        *res = METAFS_CLIENT->file_map()->add(open_dir);
+        FS_LOG("opendir success, fd: %d", *res);
     } else {
         FS_LOG("open");
         bool exists = true;
@@ -239,21 +261,14 @@ int hook_openat(int dirfd, const char* cpath, int flags, mode_t mode, long *res)
         if(exists == true) {
             // file exists
             if(S_ISDIR(stat.mode)) {
-                // 读目录下的所有文件
-                auto open_dir = make_shared<OpenDir>(realpath, pinode, fname, inode);
+                // 目录的entry在getdents时按页读取
+                auto open_dir = make_shared<OpenDir>(realpath, pinode, fname, inode, stat);
                 assert(open_dir);
-                ret = METAFS_CLIENT->Readdir(inode, open_dir);
-                if(ret) {
-                    FS_LOG("get dir entry failed");
-                    *res = -EBADF;
-                    return -1;
-                }
-                
                 *res = METAFS_CLIENT->file_map()->add(open_dir);
                 FS_LOG("opendir success, fd: %d", *res);
 
             } else if (S_ISREG(stat.mode)) {
-                *res = METAFS_CLIENT->file_map()->add(make_shared<OpenFile>(realpath, flags, pinode, fname, inode));
+                *res = METAFS_CLIENT->file_map()->add(make_shared<OpenFile>(realpath, flags, pinode, fname, inode, stat));
             } else {
                 *res = -ENOTSUP;
                 return 1;
@@ -267,12 +282,19 @@ int hook_openat(int dirfd, const char* cpath, int flags, mode_t mode, long *res)
 }
 
 // TODO: 读写文件如果需要sync则需要更新元数据
+// fsync是异步create的durability barrier: 文件所在目录(目录fd则为目录本身)下的create写入server
 int hook_fsync(int fd, long *res) {
     if(fd < START_FD) {
         return 1;
     }
 
-    *res = 0;
+    auto open_file = METAFS_CLIENT->file_map()->get(fd);
+    if(open_file == nullptr) {
+        *res = -EBADF;
+        return 0;
+    }
+    metafs_inode_t dir = open_file->type() == FileType::directory ? open_file->inode() : open_file->pinode();
+    *res = METAFS_CLIENT->flush_creates(dir);
     return 0;
 }
 
@@ -283,7 +305,15 @@ int hook_close(int fd, long *res) {
     }
 
     if(METAFS_CLIENT->file_map()->exist(fd)) {
+        auto open_dir = METAFS_CLIENT->file_map()->get_dir(fd);
+        *res = 0;
+        if(open_dir != nullptr) {
+            METAFS_CLIENT->Releasedir(open_dir);
+            // 关闭目录时写入该目录下的异步create
+            *res = METAFS_CLIENT->flush_creates(open_dir->inode());
+        }
         METAFS_CLIENT->file_map()->remove(fd); 
+        return 0;
     }
 
     *res = 0;
@@ -373,6 +403,18 @@ int hook_unlinkat(int dirfd, const char *cpath, int flags, long *res) {
     return 0;
 }
 
+static inline void fill_stat(struct stat *st, metafs_inode_t inode, const metafs_stat_t &stat) {
+    st->st_dev = 0;
+    st->st_ino = inode;
+    st->st_mode = stat.mode;
+    st->st_nlink = 1;
+    st->st_uid = st->st_gid = 0;
+    st->st_rdev = 0;
+    st->st_atime = stat.atime;
+    st->st_ctime = stat.ctime;
+    st->st_mtime = stat.mtime;
+}
+
 int hook_stat(const char *cpath, struct stat *st, long *res) {
     const char* mt_dir = c_cfg->mountdir;
     int mt_dir_len = c_cfg->mountdir_len;
@@ -399,15 +441,7 @@ int hook_stat(const char *cpath, struct stat *st, long *res) {
     *res = METAFS_CLIENT->Getstat(pinode, fname, inode, stat);
 
     if(*res == 0) {
-        st->st_dev = 0;
-        st->st_ino = inode;
-        st->st_mode = stat.mode;
-        st->st_nlink = 1;
-        st->st_uid = st->st_gid = 0;
-        st->st_rdev = 0;
-        st->st_atime = stat.atime;
-        st->st_ctime = stat.ctime;
-        st->st_mtime = stat.mtime;
+        fill_stat(st, inode, stat);
     }
 
     return 0;
@@ -422,23 +456,20 @@ int hook_fstat(int fd, struct stat *st, long *res) {
     if(METAFS_CLIENT->file_map()->exist(fd)) {
         auto ffd = METAFS_CLIENT->file_map()->get(fd);
 
-        metafs_inode_t pinode = ffd->pinode();
-        string fname = ffd->fname();
-
-        metafs_inode_t inode;
+        metafs_inode_t inode = ffd->inode();
         metafs_stat_t stat;
 
-        *res = METAFS_CLIENT->Getstat(pinode, fname, inode, stat);
+        // 优先使用open时缓存的stat, 超过attr_timeout_ms后重新从server获取
+        if(ffd->get_stat(stat, (uint64_t)c_cfg->attr_timeout_ms * 1000)) {
+            *res = 0;
+        } else {
+            *res = METAFS_CLIENT->Getstat(ffd->pinode(), ffd->fname(), inode, stat);
+            if(*res == 0) {
+                ffd->set_stat(stat);
+            }
+        }
         if(*res == 0) {
-            st->st_dev = 0;
-            st->st_ino = inode;
-            st->st_mode = stat.mode;
-            st->st_nlink = 1;
-            st->st_uid = st->st_gid = 0;
-            st->st_rdev = 0;
-            st->st_atime = stat.atime;
-            st->st_ctime = stat.ctime;
-            st->st_mtime = stat.mtime;
+            fill_stat(st, inode, stat);
         }
     } else {
         *res = -EINVAL;
@@ -490,15 +521,21 @@ int hook_lseek(int fd, long off, int flag, long *res) {
     }
 
     auto fs_fd = METAFS_CLIENT->file_map()->get(fd);
+    if(fs_fd == nullptr) {
+        *res = -EBADF;
+        return 0;
+    }
 
-    if(flag = SEEK_SET) {
+    if(flag == SEEK_SET) {
         if(off < 0) {
             *res = -EINVAL;
             return 1;
         }
         fs_fd->pos(off);
+        *res = off;
     } else if (flag == SEEK_CUR) {
-        fs_fd->pos(fs_fd->pos() + off);
+        // 共享同一OpenFile的fd并发lseek时不会丢失更新
+        *res = fs_fd->advance_pos(off);
     } else {
         *res = -EINVAL;
         return 1;
@@ -519,49 +556,55 @@ int hook_getdents(int fd, struct linux_dirent *dirp, int count, long *res) {
             return 1;
         }
 
+        std::lock_guard<std::mutex> lock(open_dir->dir_mutex());
         // get directory position of which entries to return
         auto pos = open_dir->pos();
-        if (pos >= open_dir->size()) {
-            *res = 0;
-            return 0;
-        }
+        int ret = 0;
 
         unsigned int written = 0;
+        bool buf_full = false;
         struct linux_dirent* current_dirp = nullptr;
-        while (pos < open_dir->size()) {
-            // get dentry fir current position
-            auto de = open_dir->getdent(pos);
-            /*
-            * Calculate the total dentry size within the kernel struct `linux_dirent` depending on the file name size.
-            * The size is then aligned to the size of `long` boundary.
-            * This line was originally defined in the linux kernel: fs/readdir.c in function filldir():
-            * int reclen = ALIGN(offsetof(struct linux_dirent, d_name) + namlen + 2, sizeof(long));
-            * However, since d_name is null-terminated and de.name().size() does not include space
-            * for the null-terminator, we add 1. Thus, + 3 in total.
-            */
-            auto total_size = ALIGN(offsetof(
-                                            struct linux_dirent, d_name) + de.name().size() + 3, sizeof(long));
-            if (total_size > (count - written)) {
-                //no enough space left on user buffer to insert next dirent
-                break;
+        // 每页只调用一次Readdir, 之后直接从页中的定长记录和名字区打包到用户buffer
+        while (!buf_full && (ret = METAFS_CLIENT->Readdir(open_dir, pos)) == 0) {
+            const unsigned long page_end = open_dir->base_pos() + open_dir->size();
+            for (; pos < page_end; ++pos) {
+                const DirEntry &de = open_dir->getdent(pos);
+                /*
+                * Calculate the total dentry size within the kernel struct `linux_dirent` depending on the file name size.
+                * The size is then aligned to the size of `long` boundary.
+                * This line was originally defined in the linux kernel: fs/readdir.c in function filldir():
+                * int reclen = ALIGN(offsetof(struct linux_dirent, d_name) + namlen + 2, sizeof(long));
+                * However, since d_name is null-terminated and de.name_len does not include space
+                * for the null-terminator, we add 1. Thus, + 3 in total.
+                */
+                auto total_size = ALIGN(offsetof(
+                                                struct linux_dirent, d_name) + de.name_len + 3, sizeof(long));
+                if (total_size > (count - written)) {
+                    //no enough space left on user buffer to insert next dirent
+                    buf_full = true;
+                    break;
+                }
+                current_dirp = reinterpret_cast<struct linux_dirent*>(reinterpret_cast<char*>(dirp) + written);
+                current_dirp->d_ino = de.inode;
+                current_dirp->d_reclen = total_size;
+
+                *(reinterpret_cast<char*>(current_dirp) + total_size - 1) =
+                        ((de.type == FileType::regular) ? DT_REG : DT_DIR);
+
+                // 名字连同'\0'一起拷贝
+                std::memcpy(&(current_dirp->d_name[0]), open_dir->name(de), de.name_len + 1);
+                FS_LOG("name: %s, pos : %lu", current_dirp->d_name, pos);
+                current_dirp->d_off = pos + 1;
+                written += total_size;
             }
-            current_dirp = reinterpret_cast<struct linux_dirent*>(reinterpret_cast<char*>(dirp) + written);
-            current_dirp->d_ino = std::hash<std::string>()(
-                    open_dir->path() + "/" + de.name());
-
-            current_dirp->d_reclen = total_size;
-
-            *(reinterpret_cast<char*>(current_dirp) + total_size - 1) =
-                    ((de.type() == FileType::regular) ? DT_REG : DT_DIR);
-
-            FS_LOG("name: %d, pos : %s", pos, de.name().c_str());
-            std::strcpy(&(current_dirp->d_name[0]), de.name().c_str());
-            ++pos;
-            current_dirp->d_off = pos;
-            written += total_size;
         }
 
         if (written == 0) {
+            if (ret != 0) {
+                // 读到目录末尾时返回0, 读取失败时返回错误码
+                *res = ret > 0 ? 0 : ret;
+                return 0;
+            }
             *res = -EINVAL;
             return 1;
         }
@@ -584,48 +627,54 @@ int hook_getdents64(int fd, struct linux_dirent64 *dirp, int count, long *res) {
             *res = -EBADF;
             return 1;
         }
-        FS_LOG("getdents64: pos: %d, total_ents: %d", open_dir->pos(), open_dir->size());
+        std::lock_guard<std::mutex> lock(open_dir->dir_mutex());
+        FS_LOG("getdents64: pos: %d", open_dir->pos());
         auto pos = open_dir->pos();
-        if (pos >= open_dir->size()) {
-            *res = 0;
-            return 0;
-        }
+        int ret = 0;
         unsigned int written = 0;
+        bool buf_full = false;
         struct linux_dirent64* current_dirp = nullptr;
-        while (pos < open_dir->size()) {
-            auto de = open_dir->getdent(pos);
-            /*
-            * Calculate the total dentry size within the kernel struct `linux_dirent` depending on the file name size.
-            * The size is then aligned to the size of `long` boundary.
-            *
-            * This line was originally defined in the linux kernel: fs/readdir.c in function filldir64():
-            * int reclen = ALIGN(offsetof(struct linux_dirent64, d_name) + namlen + 1, sizeof(u64));
-            * We keep + 1 because:
-            * Since d_name is null-terminated and de.name().size() does not include space
-            * for the null-terminator, we add 1. Since d_name in our `struct linux_dirent64` definition
-            * is not a zero-size array (as opposed to the kernel version), we subtract 1. Thus, it stays + 1.
-            */
-            auto total_size = ALIGN(offsetof(
-                                            struct linux_dirent64, d_name) + de.name().size() + 1, sizeof(uint64_t));
-            if (total_size > (count - written)) {
-                //no enough space left on user buffer to insert next dirent
-                break;
+        // 同getdents, 每页只调用一次Readdir
+        while (!buf_full && (ret = METAFS_CLIENT->Readdir(open_dir, pos)) == 0) {
+            const unsigned long page_end = open_dir->base_pos() + open_dir->size();
+            for (; pos < page_end; ++pos) {
+                const DirEntry &de = open_dir->getdent(pos);
+                /*
+                * Calculate the total dentry size within the kernel struct `linux_dirent` depending on the file name size.
+                * The size is then aligned to the size of `long` boundary.
+                *
+                * This line was originally defined in the linux kernel: fs/readdir.c in function filldir64():
+                * int reclen = ALIGN(offsetof(struct linux_dirent64, d_name) + namlen + 1, sizeof(u64));
+                * We keep + 1 because:
+                * Since d_name is null-terminated and de.name_len does not include space
+                * for the null-terminator, we add 1. Since d_name in our `struct linux_dirent64` definition
+                * is not a zero-size array (as opposed to the kernel version), we subtract 1. Thus, it stays + 1.
+                */
+                auto total_size = ALIGN(offsetof(
+                                                struct linux_dirent64, d_name) + de.name_len + 1, sizeof(uint64_t));
+                if (total_size > (count - written)) {
+                    //no enough space left on user buffer to insert next dirent
+                    buf_full = true;
+                    break;
+                }
+                current_dirp = reinterpret_cast<struct linux_dirent64*>(reinterpret_cast<char*>(dirp) + written);
+                current_dirp->d_ino = de.inode;
+                current_dirp->d_reclen = total_size;
+                current_dirp->d_type = ((de.type == FileType::regular) ? DT_REG : DT_DIR);
+
+                std::memcpy(&(current_dirp->d_name[0]), open_dir->name(de), de.name_len + 1);
+                FS_LOG("name: %s, pos : %lu", current_dirp->d_name, pos);
+                current_dirp->d_off = pos + 1;
+                written += total_size;
             }
-            current_dirp = reinterpret_cast<struct linux_dirent64*>(reinterpret_cast<char*>(dirp) + written);
-            current_dirp->d_ino = std::hash<std::string>()(
-                    open_dir->path() + "/" + de.name());
-
-            current_dirp->d_reclen = total_size;
-            current_dirp->d_type = ((de.type() == FileType::regular) ? DT_REG : DT_DIR);
-
-            FS_LOG("name: %d, pos : %s", pos, de.name().c_str());
-            std::strcpy(&(current_dirp->d_name[0]), de.name().c_str());
-            ++pos;
-            current_dirp->d_off = pos;
-            written += total_size;
         }
 
         if (written == 0) {
+            if (ret != 0) {
+                // 读到目录末尾时返回0, 读取失败时返回错误码
+                *res = ret > 0 ? 0 : ret;
+                return 0;
+            }
             *res = -EINVAL;
             return 1;
         }
@@ -10,6 +10,11 @@ namespace metafs {
 
 // return if need to retry
 bool MetaClient::handle_rpc_resp(rpc_resp_t res, const char *rpc_info) {
+    // 响应中的epoch表明region map已更新, 在下一个op之前增量同步, 避免先失败一次再更新
+    if(res != RespType::kUpdateRegionMap && rpc_client_->region_map_stale()) {
+        while(rpc_client_->RPC_ReadRegionmap() != RespType::kSuccess)
+            FS_LOG("raed region map fail, continue try...");
+    }
     switch(res) {
         case RespType::kSuccess:{
             return false;
@@ -20,7 +25,9 @@ bool MetaClient::handle_rpc_resp(rpc_resp_t res, const char *rpc_info) {
         }
         case RespType::kUpdateRegionMap:{
             LOG(INFO) << "need to update region_map";
-            while(rpc_client_->RPC_ReadRegionmap() != RespType::kSuccess)
+            // 响应epoch未变化时(如目标region尚未就绪)也需要同步, 此时从所有server增量读取
+            bool force = !rpc_client_->region_map_stale();
+            while(rpc_client_->RPC_ReadRegionmap(force) != RespType::kSuccess)
                 FS_LOG("raed region map fail, continue try...");
             return true;
         }
@@ -33,7 +40,7 @@ bool MetaClient::handle_rpc_resp(rpc_resp_t res, const char *rpc_info) {
 }
 
 int MetaClient::ReadRegionmap() {
-    rpc_resp_t res = rpc_client_->RPC_ReadRegionmap();
+    rpc_resp_t res = rpc_client_->RPC_ReadRegionmap(true);
     if(res != RespType::kSuccess)
         return -1;
     return 0;
@@ -78,59 +85,141 @@ rocksdb::Status MetaClient::ResolvePath(const string &path, metafs_inode_t &pino
     return s;
 }
 
-// TODO:放入Cache时, key = pinode + hash(fname)
+#ifdef USE_CACHE
+// 槽位中记录的不是该region时返回kInvalidRegionVersion
+static inline uint64_t get_region_create_version(metafs_inode_t pinode) {
+    const RegionRoute *route = find_region_route(get_pinode_hash(pinode));
+    if(route == nullptr) {
+        return kInvalidRegionVersion;
+    }
+    uint64_t word = c_ctx->region_create_version[get_region_version_slot(route->region_id)].load();
+    if((word & ~kRegionVersionMask) != get_region_version_tag(route->region_id)) {
+        return kInvalidRegionVersion;
+    }
+    return word & kRegionVersionMask;
+}
+
+// 负缓存项在lease内, 且所在region之后没有新的create时有效
+static inline bool check_negative_dentry_valid(metafs_inode_t pinode, const DirentryValue &value) {
+    return get_monotonic_us() < value.neg_expire_us && value.neg_version != kInvalidRegionVersion
+           && get_region_create_version(pinode) == value.neg_version;
+}
+
+bool MetaClient::lookup_negative_dentry(metafs_inode_t pinode, const string &fname) {
+    if(c_cfg->negative_dentry_timeout_ms <= 0) {
+        return false;
+    }
+    DirentryValue value;
+    rocksdb::Status s = c_ctx->dentry_cache->Get(pinode, fname, &value);
+    if(!s.ok() || !value.is_negative()) {
+        return false;
+    }
+    if(check_negative_dentry_valid(pinode, value)) {
+        return true;
+    }
+    c_ctx->dentry_cache->Erase(pinode, fname);
+    return false;
+}
+
+void MetaClient::insert_negative_dentry(metafs_inode_t pinode, const string &fname) {
+    if(c_cfg->negative_dentry_timeout_ms <= 0) {
+        return;
+    }
+    DirentryValue value;
+    value.neg_expire_us = get_monotonic_us() + (uint64_t)c_cfg->negative_dentry_timeout_ms * 1000;
+    value.neg_version = get_region_create_version(pinode);
+    if(value.neg_version == kInvalidRegionVersion) {
+        return; // 还没有该region的版本号, 无法判断之后是否有create
+    }
+    c_ctx->dentry_cache->Put(pinode, fname, value);
+}
+
+bool MetaClient::lookup_dentry_attr(metafs_inode_t pinode, const string &fname, metafs_inode_t &inode, metafs_stat_t &stat) {
+    if(c_cfg->dentry_attr_timeout_ms <= 0) {
+        return false;
+    }
+    DirentryValue value;
+    rocksdb::Status s = c_ctx->dentry_cache->Get(pinode, fname, &value);
+    if(!s.ok() || !value.has_attr() || get_monotonic_us() >= value.attr_expire_us) {
+        return false;
+    }
+    inode = value.inode;
+    stat = value.stat;
+    return true;
+}
+
+void MetaClient::insert_dentry_attr(metafs_inode_t pinode, const string &fname, metafs_inode_t inode, const metafs_stat_t &stat) {
+    if(c_cfg->dentry_attr_timeout_ms <= 0) {
+        return;
+    }
+    DirentryValue value(inode);
+    value.attr_expire_us = get_monotonic_us() + (uint64_t)c_cfg->dentry_attr_timeout_ms * 1000;
+    value.stat = stat;
+    c_ctx->dentry_cache->Put(pinode, fname, value);
+}
+#endif
+
 rocksdb::Status MetaClient::Internal_ResolvePath(const string &path, metafs_inode_t &pinode, string &fname, int *depth) {
-    int path_depth = 0;
-    metafs_inode_t pdir_id = 0;
-    string name;
+    // 拆分出所有目录分量
+    vector<string> names;
     size_t now = 0, last = 0, end = path.rfind("/");
-
     while(last < end) {
         now = path.find("/", last + 1);
         if(now - last > 1) {
-            path_depth++;
-            name = path.substr(last + 1, now - last - 1);     
-            
+            names.push_back(path.substr(last + 1, now - last - 1));
+        }
+        last = now;
+    }
+
+    metafs_inode_t pdir_id = 0;
+    size_t i = 0;
+    while(i < names.size()) {
 #ifdef USE_CACHE
-            // get from cache.
-            DirentryValue value;
-            rocksdb::Status s = c_ctx->dentry_cache->Get(pdir_id, name, &value);
-            if(!s.ok()) { // not exist in cache.
-                // printf("cache miss, times:%d\n", c_ctx->dentry_cache->cache_miss_cnt_incr());
-                // lookup from servers
-                // TODO: now don't split directory, so just use pinode to get target server.
-                rpc_resp_t res = rpc_client_->RPC_Getinode(pdir_id, name, value.inode);
-                if(handle_rpc_resp(res, "resolvepath:getinode")) {
-                    res = rpc_client_->RPC_Getinode(pdir_id, name, value.inode);
-                }
-                // add to cache.
-                if(res == kSuccess) {
-                    c_ctx->dentry_cache->Put(pdir_id, name, value);
-                } else {
-                    FS_LOG("get inode fail");
-                    return rocksdb::Status::Corruption("RPC_Getinode fail");
-                }
+        // get from cache.
+        DirentryValue value;
+        rocksdb::Status s = c_ctx->dentry_cache->Get(pdir_id, names[i], &value);
+        if(s.ok() && value.is_negative()) {
+            if(check_negative_dentry_valid(pdir_id, value)) {
+                FS_LOG("get inode fail, negative dentry");
+                return rocksdb::Status::NotFound("negative dentry");
             }
+            s = rocksdb::Status::NotFound();
+        }
+        if(s.ok()) {
             pdir_id = value.inode;
-#else
-            rpc_resp_t res = rpc_client_->RPC_Getinode(pdir_id, name, pdir_id);
-            if(handle_rpc_resp(res, "resolvepath:getinode")) {
-                res = rpc_client_->RPC_Getinode(pdir_id, name, pdir_id);
-            }
-            // add to cache.
-            if(res == kFail) {
-                FS_LOG("get inode fail");
-                return rocksdb::Status::Corruption("RPC_Getinode fail");
+            i++;
+            continue;
+        }
+#endif
+        // not exist in cache, 剩余分量一次发给server, server解析其本地能解析的部分
+        metafs_inode_t inodes[MAX_RESOLVE_PATH_COMPONENTS];
+        int32_t num_resolved;
+        rpc_resp_t res = rpc_client_->RPC_ResolvePath(pdir_id, names, i, inodes, num_resolved);
+        if(handle_rpc_resp(res, "resolvepath")) {
+            res = rpc_client_->RPC_ResolvePath(pdir_id, names, i, inodes, num_resolved);
+        }
+        // add to cache.
+        for(int32_t j = 0; j < num_resolved; j++, i++) {
+#ifdef USE_CACHE
+            c_ctx->dentry_cache->Put(pdir_id, names[i], DirentryValue(inodes[j]));
+#endif
+            pdir_id = inodes[j];
+        }
+        if(res != kSuccess) {
+#ifdef USE_CACHE
+            if(res == kENOENT) {
+                insert_negative_dentry(pdir_id, names[i]);
             }
-#endif      
+#endif
+            FS_LOG("resolve path fail");
+            return rocksdb::Status::Corruption("RPC_ResolvePath fail");
         }
-        last = now;
     }
 
     pinode = pdir_id;
     fname = path.substr(end + 1);
     if(depth != nullptr) {
-        *depth = path_depth;
+        *depth = names.size();
     }
 
     return rocksdb::Status::OK();
@@ -140,17 +229,36 @@ rocksdb::Status MetaClient::Internal_ResolvePath(const string &path, metafs_inod
 
 int MetaClient::Getstat(metafs_inode_t pinode, const string &fname, metafs_inode_t &inode, metafs_stat_t &stat) {
     FS_LOG("Getstat");
-    
+
+#ifdef USE_CACHE
+    if(lookup_dentry_attr(pinode, fname, inode, stat)) {
+        return 0;
+    }
+    if(lookup_negative_dentry(pinode, fname)) {
+        return -ENOENT;
+    }
+#endif
+
+    sync_creates(pinode);
     rpc_resp_t res = rpc_client_->RPC_Getstat(pinode, fname, inode, stat);
     if(handle_rpc_resp(res, "getstat")) {
         res = rpc_client_->RPC_Getstat(pinode, fname, inode, stat);
     }
 
     if(res != kSuccess) {
+#ifdef USE_CACHE
+        if(res == kENOENT) {
+            insert_negative_dentry(pinode, fname);
+        }
+#endif
         LOG(ERROR) << "fail Getstat: " << "pinode: " << pinode << " fname: " << fname;
         return -ENOENT; 
     }
 
+#ifdef USE_CACHE
+    insert_dentry_attr(pinode, fname, inode, stat);
+#endif
+
     FS_LOG("Getstat success");
     return 0;
 }
@@ -158,6 +266,7 @@ int MetaClient::Getstat(metafs_inode_t pinode, const string &fname, metafs_inode
 int MetaClient::Mknod(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat) {
     FS_LOG("Mknod");
 
+    sync_creates(pinode);
     rpc_resp_t res = rpc_client_->RPC_Mknod(pinode, fname, mode, inode, stat);
     if(handle_rpc_resp(res, "mknod")) {
         res = rpc_client_->RPC_Mknod(pinode, fname, mode, inode, stat);
@@ -167,13 +276,113 @@ int MetaClient::Mknod(metafs_inode_t pinode, const string &fname, mode_t mode, m
         LOG(ERROR) << "Error";
         return -EEXIST;
     }
+
+#ifdef USE_CACHE
+    // 本client创建的文件立即使负缓存失效
+    c_ctx->dentry_cache->Erase(pinode, fname);
+#endif
+
     FS_LOG("Mknod succeess");
     return 0;
 }
 
+// 在途请求按提交顺序完成, 至少保留一个空闲window给region map同步和失败重试
+struct pending_rpc_ring {
+    size_t ids[MAX_MSG_BUF_WINDOW];
+    rpc_handle_t handles[MAX_MSG_BUF_WINDOW];
+    int head = 0;
+    int count = 0;
+
+    void push(size_t id, rpc_handle_t handle) {
+        int tail = (head + count) % MAX_MSG_BUF_WINDOW;
+        ids[tail] = id;
+        handles[tail] = handle;
+        count++;
+    }
+
+    void pop(size_t &id, rpc_handle_t &handle) {
+        id = ids[head];
+        handle = handles[head];
+        head = (head + 1) % MAX_MSG_BUF_WINDOW;
+        count--;
+    }
+};
+
+void MetaClient::Mknod_batch(metafs_inode_t pinode, const vector<pair<string, mode_t>> &entries,
+                             vector<metafs_inode_t> &inodes, vector<int> &rets,
+                             const vector<metafs_inode_t> *prealloc_inodes) {
+    FS_LOG("Mknod_batch, pinode: %d, num: %d", pinode, (int)entries.size());
+    size_t n = entries.size();
+    const metafs_inode_t *prealloc = prealloc_inodes != nullptr ? prealloc_inodes->data() : nullptr;
+    inodes.assign(n, 0);
+    rets.assign(n, 0);
+    vector<rpc_resp_t> results(n, RespType::kFail);
+
+    pending_rpc_ring pending;
+    size_t counts[MAX_MSG_BUF_WINDOW];
+    size_t next = 0;
+    while(next < n || pending.count > 0) {
+        while(next < n && rpc_client_->RPC_Free_windows() > 1) {
+            size_t count;
+            rpc_handle_t handle = rpc_client_->RPC_BatchMknod_async(pinode, entries, next, n - next, count, prealloc);
+            counts[handle] = count;
+            pending.push(next, handle);
+            next += count;
+        }
+
+        size_t start;
+        size_t count;
+        rpc_resp_t res;
+        if(pending.count > 0) {
+            rpc_handle_t handle;
+            pending.pop(start, handle);
+            count = counts[handle];
+            res = rpc_client_->RPC_BatchMknod_finish(handle, &results[start], &inodes[start]);
+        } else {
+            // 没有空闲window(被其他请求占用), 退回同步rpc
+            start = next;
+            res = rpc_client_->RPC_BatchMknod(pinode, entries, start, n - start, count, &results[start], &inodes[start], prealloc);
+            next += count;
+        }
+        if(handle_rpc_resp(res, "batch mknod")) {
+            // region变化后整批重新发送
+            res = RespType::kSuccess;
+            for(size_t i = start; i < start + count && res == RespType::kSuccess; ) {
+                size_t sent;
+                res = rpc_client_->RPC_BatchMknod(pinode, entries, i, start + count - i, sent, &results[i], &inodes[i], prealloc);
+                i += sent;
+            }
+        }
+        if(res != kSuccess) {
+            LOG(ERROR) << "Error batch mknod, res: " << res;
+            for(size_t i = start; i < start + count; i++) {
+                results[i] = res;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < n; i++) {
+        if(results[i] != kSuccess) {
+            rets[i] = results[i] == kEXIST ? -EEXIST : -EIO;
+            continue;
+        }
+#ifdef USE_CACHE
+        // 本client创建的文件立即使负缓存失效
+        c_ctx->dentry_cache->Erase(pinode, entries[i].first);
+#endif
+    }
+}
+
 int MetaClient::Open(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat) {
     FS_LOG("Open, pinode %d, fname:%s", pinode, fname.c_str());
 
+#ifdef USE_CACHE
+    if(lookup_negative_dentry(pinode, fname)) {
+        return -ENOENT;
+    }
+#endif
+
+    sync_creates(pinode);
     rpc_resp_t res = rpc_client_->RPC_Open(pinode, fname, mode, inode, stat);
 
     if(handle_rpc_resp(res, "open")) {
@@ -181,17 +390,267 @@ int MetaClient::Open(metafs_inode_t pinode, const string &fname, mode_t mode, me
     }
 
     if(res != kSuccess) {
+#ifdef USE_CACHE
+        if(res == kENOENT) {
+            insert_negative_dentry(pinode, fname);
+        }
+#endif
         LOG(ERROR) << "Error";
         return -ENOENT;
     }
 
+#ifdef USE_CACHE
+    // 以写方式打开时server会更新mtime, 用返回的stat刷新缓存的属性
+    insert_dentry_attr(pinode, fname, inode, stat);
+#endif
+
     FS_LOG("Open succeess, inode: %ld", inode);
     return 0;
 }
 
+static inline int opencreate_errno(rpc_resp_t res) {
+    switch(res) {
+        case kEXIST: return -EEXIST;
+        case kEISDIR: return -EISDIR;
+        case kENOENT: return -ENOENT;
+        default: return -EIO;
+    }
+}
+
+int MetaClient::OpenCreate(metafs_inode_t pinode, const string &fname, mode_t mode, int flags,
+                           metafs_inode_t &inode, metafs_stat_t &stat) {
+    FS_LOG("OpenCreate, pinode %d, fname:%s, flags: %x", pinode, fname.c_str(), flags);
+
+    if(async_create(pinode, fname, mode, flags, inode, stat)) {
+        return 0;
+    }
+
+    sync_creates(pinode);
+    bool created = false;
+    rpc_resp_t res = rpc_client_->RPC_OpenCreate(pinode, fname, mode, flags, inode, stat, created);
+
+    if(handle_rpc_resp(res, "opencreate")) {
+        res = rpc_client_->RPC_OpenCreate(pinode, fname, mode, flags, inode, stat, created);
+    }
+
+    if(res != kSuccess) {
+        LOG(ERROR) << "Error opencreate";
+        return opencreate_errno(res);
+    }
+
+#ifdef USE_CACHE
+    if(created) {
+        // 本client创建的文件立即使负缓存失效
+        c_ctx->dentry_cache->Erase(pinode, fname);
+    }
+    insert_dentry_attr(pinode, fname, inode, stat);
+#endif
+
+    FS_LOG("OpenCreate succeess, inode: %ld, created: %d", inode, created);
+    return 0;
+}
+
+// 一个目录下攒够这么多异步create后写入server, 由Mknod_batch分成多个batch流水线发送
+static const size_t kMaxPendingCreates = 4 * MAX_BATCH_MKNOD_ENTRIES;
+
+// 只在server授予的租约内异步创建; O_EXCL需要server确认文件不存在, 总是同步; 本client已知存在的文件走同步open.
+// 写入server时发现其他client已创建同名文件, 按open已有文件处理, 并把已打开的fd改为server上的inode
+bool MetaClient::async_create(metafs_inode_t pinode, const string &fname, mode_t mode, int flags,
+                              metafs_inode_t &inode, metafs_stat_t &stat) {
+    if(c_cfg->async_create_inodes <= 0 || (flags & O_EXCL)) {
+        return false;
+    }
+    check_cap_expire();
+#ifdef USE_CACHE
+    if(lookup_dentry_attr(pinode, fname, inode, stat)) {
+        return false;
+    }
+#endif
+
+    shared_ptr<CreateCap> cap;
+    {
+        std::lock_guard<std::mutex> lock(create_caps_mutex_);
+        auto &slot = create_caps_[pinode];
+        if(slot == nullptr) {
+            slot = make_shared<CreateCap>();
+            num_create_caps_++;
+        }
+        cap = slot;
+    }
+
+    std::lock_guard<std::mutex> lock(cap->mutex);
+    uint64_t now = get_monotonic_us();
+    if(now >= cap->expire_us || cap->next_inode == cap->end_inode) {
+        // 租约到期时其他client应能看到之前的create, 先写入再重新租用
+        if(now >= cap->expire_us) {
+            flush_cap_locked(pinode, *cap);
+        }
+        metafs_inode_t start_inode;
+        int32_t granted;
+        int32_t lease_ms;
+        rpc_resp_t res = rpc_client_->RPC_AllocInodes(pinode, c_cfg->async_create_inodes, start_inode, granted, lease_ms);
+        if(handle_rpc_resp(res, "alloc inodes")) {
+            res = rpc_client_->RPC_AllocInodes(pinode, c_cfg->async_create_inodes, start_inode, granted, lease_ms);
+        }
+        if(res != kSuccess) {
+            cap->next_inode = cap->end_inode = 0;
+            return false;
+        }
+        cap->next_inode = start_inode;
+        cap->end_inode = start_inode + granted;
+        // 只用前一半租约, 留出写入server的时间, 保证batch mknod到达server时租约还未到期
+        cap->expire_us = now + (uint64_t)lease_ms * 1000 / 2;
+    }
+
+    // 攒够后先写入之前的create; 当前的create在返回并建立fd之后才写入, 文件已存在时可以更新fd的inode
+    if(cap->entries.size() >= kMaxPendingCreates) {
+        flush_cap_locked(pinode, *cap);
+    }
+
+    inode = cap->next_inode++;
+    stat = metafs_stat_t(mode);
+    cap->entries.emplace_back(fname, mode);
+    cap->inodes.push_back(inode);
+    cap->flags.push_back(flags);
+
+#ifdef USE_CACHE
+    // 本client之后对该文件的stat直接从dentry cache返回
+    c_ctx->dentry_cache->Erase(pinode, fname);
+    insert_dentry_attr(pinode, fname, inode, stat);
+#endif
+
+    note_cap_expire(cap->expire_us);
+    FS_LOG("async create, pinode: %d, fname: %s, inode: %ld", pinode, fname.c_str(), inode);
+    return true;
+}
+
+void MetaClient::flush_cap_locked(metafs_inode_t pinode, CreateCap &cap) {
+    if(cap.entries.empty()) {
+        return;
+    }
+
+    vector<metafs_inode_t> inodes;
+    vector<int> rets;
+    Mknod_batch(pinode, cap.entries, inodes, rets, &cap.inodes);
+    for(size_t i = 0; i < rets.size(); i++) {
+        if(rets[i] == 0) {
+            continue;
+        }
+        const string &fname = cap.entries[i].first;
+#ifdef USE_CACHE
+        // 缓存的是租用的inode, 与server上的不一致
+        c_ctx->dentry_cache->Erase(pinode, fname);
+#endif
+        int ret = rets[i];
+        if(ret == -EEXIST) {
+            // 其他client已创建: 按open已有文件处理, 由server更新时间戳或报告目录等错误
+            metafs_inode_t inode;
+            metafs_stat_t stat;
+            bool created;
+            rpc_resp_t res = rpc_client_->RPC_OpenCreate(pinode, fname, cap.entries[i].second, cap.flags[i], inode, stat, created);
+            if(handle_rpc_resp(res, "opencreate")) {
+                res = rpc_client_->RPC_OpenCreate(pinode, fname, cap.entries[i].second, cap.flags[i], inode, stat, created);
+            }
+            if(res == kSuccess) {
+                // 已经用租用的inode打开的fd改用server上的inode和stat
+                ofm_->replace_inode(pinode, fname, cap.inodes[i], inode, stat);
+#ifdef USE_CACHE
+                insert_dentry_attr(pinode, fname, inode, stat);
+#endif
+                continue;
+            }
+            ret = opencreate_errno(res);
+        }
+        LOG(ERROR) << "Error async create, fname: " << fname << ", ret: " << ret;
+        if(cap.error == 0) {
+            cap.error = ret;
+        }
+    }
+    cap.entries.clear();
+    cap.inodes.clear();
+    cap.flags.clear();
+}
+
+int MetaClient::flush_creates(metafs_inode_t pinode, bool take_error, bool *flushed) {
+    if(flushed != nullptr) {
+        *flushed = false;
+    }
+    shared_ptr<CreateCap> cap;
+    {
+        std::lock_guard<std::mutex> lock(create_caps_mutex_);
+        auto iter = create_caps_.find(pinode);
+        if(iter == create_caps_.end()) {
+            return 0;
+        }
+        cap = iter->second;
+    }
+
+    std::lock_guard<std::mutex> lock(cap->mutex);
+    if(flushed != nullptr) {
+        *flushed = !cap->entries.empty();
+    }
+    flush_cap_locked(pinode, *cap);
+    int error = cap->error;
+    if(take_error) {
+        cap->error = 0;
+    }
+    return error;
+}
+
+void MetaClient::note_cap_expire(uint64_t expire_us) {
+    uint64_t cur = next_cap_expire_us_.load(std::memory_order_relaxed);
+    while(expire_us < cur && !next_cap_expire_us_.compare_exchange_weak(cur, expire_us)) {
+    }
+}
+
+void MetaClient::flush_expired_creates() {
+    vector<pair<metafs_inode_t, shared_ptr<CreateCap>>> caps;
+    {
+        std::lock_guard<std::mutex> lock(create_caps_mutex_);
+        caps.assign(create_caps_.begin(), create_caps_.end());
+    }
+
+    // 先重置再扫描, 扫描期间新加入的create会重新记录到期时间
+    next_cap_expire_us_ = UINT64_MAX;
+    uint64_t now = get_monotonic_us();
+    for(auto &iter : caps) {
+        std::lock_guard<std::mutex> lock(iter.second->mutex);
+        if(iter.second->entries.empty()) {
+            continue;
+        }
+        if(now >= iter.second->expire_us) {
+            flush_cap_locked(iter.first, *iter.second);
+        } else {
+            note_cap_expire(iter.second->expire_us);
+        }
+    }
+}
+
+int MetaClient::flush_all_creates(bool take_error) {
+    vector<pair<metafs_inode_t, shared_ptr<CreateCap>>> caps;
+    {
+        std::lock_guard<std::mutex> lock(create_caps_mutex_);
+        caps.assign(create_caps_.begin(), create_caps_.end());
+    }
+
+    int error = 0;
+    for(auto &iter : caps) {
+        std::lock_guard<std::mutex> lock(iter.second->mutex);
+        flush_cap_locked(iter.first, *iter.second);
+        if(error == 0) {
+            error = iter.second->error;
+        }
+        if(take_error) {
+            iter.second->error = 0;
+        }
+    }
+    return error;
+}
+
 int MetaClient::Unlink(metafs_inode_t pinode, const string &fname) {
     FS_LOG("Unlink");
 
+    sync_creates(pinode);
     rpc_resp_t res = rpc_client_->RPC_Unlink(pinode, fname);
 
     if(handle_rpc_resp(res, "unlink")) {
@@ -203,10 +662,99 @@ int MetaClient::Unlink(metafs_inode_t pinode, const string &fname) {
         return -ENOENT;
     }
 
+#ifdef USE_CACHE
+    c_ctx->dentry_cache->Erase(pinode, fname);
+#endif
+
     FS_LOG("Unlink success");
     return 0;
 }
 
+void MetaClient::Getstat_batch(metafs_inode_t pinode, const vector<string> &fnames, vector<metafs_inode_t> &inodes,
+                               vector<metafs_stat_t> &stats, vector<int> &rets) {
+    FS_LOG("Getstat_batch, pinode: %d, num: %d", pinode, (int)fnames.size());
+    size_t n = fnames.size();
+    inodes.resize(n);
+    stats.resize(n);
+    rets.assign(n, 0);
+
+    sync_creates(pinode);
+    pending_rpc_ring pending;
+    size_t next = 0;
+    while(next < n || pending.count > 0) {
+        while(next < n && rpc_client_->RPC_Free_windows() > 1) {
+#ifdef USE_CACHE
+            if(lookup_negative_dentry(pinode, fnames[next])) {
+                rets[next++] = -ENOENT;
+                continue;
+            }
+#endif
+            pending.push(next, rpc_client_->RPC_Getstat_async(pinode, fnames[next]));
+            next++;
+        }
+        if(pending.count == 0 && next == n) {
+            break; // 剩下的都命中了负缓存
+        }
+
+        size_t i;
+        rpc_resp_t res;
+        if(pending.count > 0) {
+            rpc_handle_t handle;
+            pending.pop(i, handle);
+            res = rpc_client_->RPC_Getstat_finish(handle, inodes[i], stats[i]);
+        } else {
+            // 没有空闲window(被其他请求占用), 退回同步rpc
+            i = next++;
+            res = rpc_client_->RPC_Getstat(pinode, fnames[i], inodes[i], stats[i]);
+        }
+        if(handle_rpc_resp(res, "getstat")) {
+            res = rpc_client_->RPC_Getstat(pinode, fnames[i], inodes[i], stats[i]);
+        }
+        if(res != kSuccess) {
+#ifdef USE_CACHE
+            if(res == kENOENT) {
+                insert_negative_dentry(pinode, fnames[i]);
+            }
+#endif
+            rets[i] = -ENOENT;
+        }
+    }
+}
+
+void MetaClient::Unlink_batch(metafs_inode_t pinode, const vector<string> &fnames, vector<int> &rets) {
+    FS_LOG("Unlink_batch, pinode: %d, num: %d", pinode, (int)fnames.size());
+    size_t n = fnames.size();
+    rets.assign(n, 0);
+    sync_creates(pinode);
+
+    pending_rpc_ring pending;
+    size_t next = 0;
+    while(next < n || pending.count > 0) {
+        while(next < n && rpc_client_->RPC_Free_windows() > 1) {
+            pending.push(next, rpc_client_->RPC_Unlink_async(pinode, fnames[next]));
+            next++;
+        }
+
+        size_t i;
+        rpc_resp_t res;
+        if(pending.count > 0) {
+            rpc_handle_t handle;
+            pending.pop(i, handle);
+            res = rpc_client_->RPC_Unlink_finish(handle);
+        } else {
+            // 没有空闲window(被其他请求占用), 退回同步rpc
+            i = next++;
+            res = rpc_client_->RPC_Unlink(pinode, fnames[i]);
+        }
+        if(handle_rpc_resp(res, "unlink")) {
+            res = rpc_client_->RPC_Unlink(pinode, fnames[i]);
+        }
+        if(res != kSuccess) {
+            rets[i] = -ENOENT;
+        }
+    }
+}
+
 // 删除文件或目录
 // server不需要关心是否是目录,即认为用户已经删除了目录内的所有文件
 // int MetaClient::Remove(const string &path, mode_t mode) {
@@ -279,6 +827,8 @@ int MetaClient::Unlink(metafs_inode_t pinode, const string &fname) {
 int MetaClient::Mkdir(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat) {
     FS_LOG("Mkdir");
 
+    // 同名文件可能还在异步create中, 先写入server才能得到EEXIST
+    sync_creates(pinode);
     rpc_resp_t res = rpc_client_->RPC_Mkdir(pinode, fname, mode, inode);
 
     if(handle_rpc_resp(res, "mkdir")) {
@@ -290,34 +840,191 @@ int MetaClient::Mkdir(metafs_inode_t pinode, const string &fname, mode_t mode, m
         return -EEXIST;
     }
 
+#ifdef USE_CACHE
+    // 本client创建的文件立即使负缓存失效
+    c_ctx->dentry_cache->Erase(pinode, fname);
+#endif
+
     FS_LOG("Mkdir success");
     return 0;
 }
 
-// readdir前需要已经得到rangemap
-int MetaClient::Readdir(metafs_inode_t dir_inode, shared_ptr<OpenDir> &open_dir) {
-    FS_LOG("Readdir, dirinode: %d", dir_inode);
+// 读取open_dir的下一页到当前页, 优先使用本线程之前预取的结果
+int MetaClient::Opendir(const string &path, metafs_inode_t pinode, const string &fname, shared_ptr<OpenDir> &open_dir) {
+    FS_LOG("Opendir, pinode %d, fname:%s", pinode, fname.c_str());
+    sync_creates(pinode);
+
+#ifdef USE_CACHE
+    if(lookup_negative_dentry(pinode, fname)) {
+        return -ENOENT;
+    }
+#endif
+
+    rpc_resp_t res = rpc_client_->RPC_Opendir(path, pinode, fname, open_dir);
+    if(handle_rpc_resp(res, "opendir")) {
+        res = rpc_client_->RPC_Opendir(path, pinode, fname, open_dir);
+    }
+
+    if(res != kSuccess) {
+#ifdef USE_CACHE
+        if(res == kENOENT) {
+            insert_negative_dentry(pinode, fname);
+        }
+#endif
+        LOG(ERROR) << "Error opendir";
+        return res == kENOTDIR ? -ENOTDIR : -ENOENT;
+    }
+
+#ifdef USE_CACHE
+    metafs_stat_t stat;
+    if(open_dir->get_stat(stat, 0)) {
+        insert_dentry_attr(pinode, fname, open_dir->inode(), stat);
+    }
+#endif
+
+    // 打开之后才知道目录的inode: 目录下有未写入的异步create时, 响应中的第一页不包含这些文件, 写入后重新读取
+    if(num_create_caps_.load(std::memory_order_relaxed) > 0) {
+        bool flushed = false;
+        flush_creates(open_dir->inode(), false, &flushed);
+        if(flushed) {
+            open_dir->cursor() = ReaddirCursor();
+            open_dir->reset_page(0);
+        }
+    }
+
+    // 第一页不在响应中时立即预取, 与应用的后续处理重叠
+    ReaddirCursor &cursor = open_dir->cursor();
+    if(open_dir->size() == 0 && !cursor.eof && can_prefetch_dir()) {
+        bool plus = false;
+#ifdef USE_CACHE
+        plus = c_cfg->dentry_attr_timeout_ms > 0;
+#endif
+        cursor.prefetch_handle = rpc_client_->RPC_Readdir_page_async(open_dir->inode(), cursor.next_offset, plus);
+        cursor.prefetch_owner = rpc_client_->RPC_Context();
+        cursor.prefetch_seq = rpc_client_->RPC_Window_seq(cursor.prefetch_handle);
+        rpc_client_->RPC_Mark_prefetch(cursor.prefetch_handle);
+    }
+
+    FS_LOG("Opendir succeess, inode: %ld, first page: %d", open_dir->inode(), (int)open_dir->size());
+    return 0;
+}
+
+int MetaClient::read_dir_page(shared_ptr<OpenDir> &open_dir) {
+    ReaddirCursor &cursor = open_dir->cursor();
+    metafs_inode_t dir_inode = open_dir->inode();
+    sync_creates(dir_inode);
 
-    rpc_resp_t res = rpc_client_->RPC_Readdir(dir_inode, open_dir);
+    // 缓存属性时使用readdirplus, 之后对目录下文件的stat可以直接从dentry cache返回
+    vector<metafs_stat_t> stats;
+    vector<metafs_stat_t> *stats_ptr = nullptr;
+#ifdef USE_CACHE
+    if(c_cfg->dentry_attr_timeout_ms > 0) {
+        stats_ptr = &stats;
+    }
+#endif
+
+    rpc_resp_t res;
+    uint64_t next_offset;
+    bool is_uncomplete;
+    if(cursor.prefetch_handle >= 0 && rpc_client_->RPC_Owns(cursor.prefetch_owner, cursor.prefetch_handle, cursor.prefetch_seq)) {
+        res = rpc_client_->RPC_Readdir_page_finish(cursor.prefetch_handle, open_dir, stats_ptr, next_offset, is_uncomplete);
+        cursor.prefetch_handle = -1;
+    } else {
+        release_dir_prefetch(open_dir);
+        res = rpc_client_->RPC_Readdir_page(dir_inode, cursor.next_offset, open_dir, stats_ptr, next_offset, is_uncomplete);
+    }
 
     if(handle_rpc_resp(res, "readdir")) {
         open_dir->clearEntries();
-        res = rpc_client_->RPC_Readdir(dir_inode, open_dir);
+        stats.clear();
+        res = rpc_client_->RPC_Readdir_page(dir_inode, cursor.next_offset, open_dir, stats_ptr, next_offset, is_uncomplete);
     }
 
     if(res) {
-        LOG(ERROR) << "Error";
+        LOG(ERROR) << "Error readdir, dirinode: " << dir_inode;
         return -ENOENT;
-    } else {
-        FS_LOG("Readdir success");
     }
-    
+    cursor.next_offset = next_offset;
+    cursor.eof = !is_uncomplete;
+
+#ifdef USE_CACHE
+    for(size_t i = 0; i < stats.size(); i++) {
+        const DirEntry &de = open_dir->getdent(open_dir->base_pos() + i);
+        if(stats[i].mode != 0) {
+            insert_dentry_attr(dir_inode, string(open_dir->name(de), de.name_len), de.inode, stats[i]);
+        }
+    }
+#endif
+    return 0;
+}
+
+// 保证目录中位置pos的entry在当前页中, 顺序读时按页前进并预取下一页, 向前seek时从头重新读取
+int MetaClient::Readdir(shared_ptr<OpenDir> &open_dir, unsigned long pos) {
+    FS_LOG("Readdir, dirinode: %d, pos: %lu", open_dir->inode(), pos);
+    ReaddirCursor &cursor = open_dir->cursor();
+
+    if(pos < open_dir->base_pos()) {
+        release_dir_prefetch(open_dir);
+        cursor = ReaddirCursor();
+        open_dir->reset_page(0);
+    }
+
+    while(!open_dir->contains(pos)) {
+        if(cursor.eof) {
+            return 1;
+        }
+        open_dir->reset_page(open_dir->base_pos() + open_dir->size());
+        int ret = read_dir_page(open_dir);
+        if(ret) {
+            return ret;
+        }
+    }
+
+    // 应用处理当前页时, 下一页的rpc已经在途; 保留一个空闲window给同步rpc使用
+    if(!cursor.eof && cursor.prefetch_handle < 0 && can_prefetch_dir()) {
+        bool plus = false;
+#ifdef USE_CACHE
+        plus = c_cfg->dentry_attr_timeout_ms > 0;
+#endif
+        cursor.prefetch_handle = rpc_client_->RPC_Readdir_page_async(open_dir->inode(), cursor.next_offset, plus);
+        cursor.prefetch_owner = rpc_client_->RPC_Context();
+        cursor.prefetch_seq = rpc_client_->RPC_Window_seq(cursor.prefetch_handle);
+        rpc_client_->RPC_Mark_prefetch(cursor.prefetch_handle);
+    }
     return 0;
 }
 
+static const int kMaxDirPrefetches = 2;
+
+// 每个线程同时打开很多目录时, 预取最多占用kMaxDirPrefetches个window, 其余留给batch流水线和同步rpc
+bool MetaClient::can_prefetch_dir() {
+    return rpc_client_->RPC_Prefetch_windows() < kMaxDirPrefetches && rpc_client_->RPC_Free_windows() > 1;
+}
+
+void MetaClient::release_dir_prefetch(shared_ptr<OpenDir> &open_dir) {
+    ReaddirCursor &cursor = open_dir->cursor();
+    if(cursor.prefetch_handle >= 0) {
+        rpc_client_->RPC_Abandon(cursor.prefetch_owner, cursor.prefetch_handle, cursor.prefetch_seq);
+        cursor.prefetch_handle = -1;
+    }
+}
+
+void MetaClient::Releasedir(shared_ptr<OpenDir> &open_dir) {
+    std::lock_guard<std::mutex> lock(open_dir->dir_mutex());
+    release_dir_prefetch(open_dir);
+}
+
 int MetaClient::Rmdir(metafs_inode_t pinode, const string &fname) {
     FS_LOG("Rmdir: %s", fname.c_str());
-    
+    // 被删除的目录下可能有异步create, 只写入该目录的; 父目录的在Getstat中写入
+    if(num_create_caps_.load(std::memory_order_relaxed) > 0) {
+        metafs_inode_t inode;
+        metafs_stat_t stat;
+        if(Getstat(pinode, fname, inode, stat) == 0 && S_ISDIR(stat.mode)) {
+            flush_creates(inode, false);
+        }
+    }
+
     rpc_resp_t res = rpc_client_->RPC_Rmdir(pinode, fname);
 
     if(handle_rpc_resp(res, "rmdir")) {
@@ -326,9 +1033,13 @@ int MetaClient::Rmdir(metafs_inode_t pinode, const string &fname) {
 
     if(res != kSuccess) {
         LOG(ERROR) << "Error rmdir";
-        return -ENOENT;
+        return res == kENOTEMPTY ? -ENOTEMPTY : -ENOENT;
     }
 
+#ifdef USE_CACHE
+    c_ctx->dentry_cache->Erase(pinode, fname);
+#endif
+
     FS_LOG("Rmdir success");
     return 0;
 }
@@ -4,36 +4,50 @@
 
 namespace metafs {
 
-DirEntry::DirEntry(const std::string& name, const FileType type, metafs_inode_t inode) :
-        name_(name), type_(type), inode_(inode) {
+OpenDir::OpenDir(const std::string& path, metafs_inode_t pinode, const std::string& fname, metafs_inode_t inode,
+                 const metafs_stat_t &stat) :
+        OpenFile(path, 0, pinode, fname, inode, stat, FileType::directory), base_pos_(0) {
 }
 
-const std::string& DirEntry::name() {
-    return name_;
+void OpenDir::add(const char *name, size_t name_len, FileType type, metafs_inode_t inode) {
+    DirEntry de;
+    de.name_off = names_.size();
+    de.name_len = name_len;
+    de.type = type;
+    de.inode = inode;
+    names_.insert(names_.end(), name, name + name_len + 1);
+    entries.push_back(de);
 }
 
-FileType DirEntry::type() {
-    return type_;
+bool OpenDir::contains(unsigned long pos) const {
+    return pos >= base_pos_ && pos < base_pos_ + entries.size();
 }
 
-OpenDir::OpenDir(const std::string& path, metafs_inode_t pinode, const std::string& fname, metafs_inode_t inode) :
-        OpenFile(path, 0, pinode, fname, inode, FileType::directory) {
-}
-
-void OpenDir::add(const std::string& name, const FileType& type, metafs_inode_t inode) {
-    entries.push_back(DirEntry(name, type, inode));
-}
-
-const DirEntry& OpenDir::getdent(unsigned int pos) {
-    return entries.at(pos);
+void OpenDir::reset_page(unsigned long base_pos) {
+    names_.clear();
+    entries.clear();
+    base_pos_ = base_pos;
 }
 
 size_t OpenDir::size() {
     return entries.size();
 }
 
+unsigned long OpenDir::base_pos() const {
+    return base_pos_;
+}
+
 void OpenDir::clearEntries() {
+    names_.clear();
     entries.clear();
 }
 
+ReaddirCursor &OpenDir::cursor() {
+    return cursor_;
+}
+
+std::mutex &OpenDir::dir_mutex() {
+    return dir_mutex_;
+}
+
 } //end namespace metafs
\ No newline at end of file
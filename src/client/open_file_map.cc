@@ -5,8 +5,11 @@
 
 #include "client/open_dir.h"
 #include "client/open_file_map.h"
+#include "common/common.h"
+#include "util/epoch.h"
 
 #include <fcntl.h>
+#include <cerrno>
 #include <type_traits>
 
 template<typename E>
@@ -18,8 +21,9 @@ using namespace std;
 namespace metafs {
 
 OpenFile::OpenFile(const std::string& path, int flags, metafs_inode_t pinode, 
-                const std::string &fname, metafs_inode_t inode, FileType type) :
-        pinode_(pinode), fname_(fname), inode_(inode), type_(type), path_(path) {
+                const std::string &fname, metafs_inode_t inode, const metafs_stat_t &stat, FileType type) :
+        pinode_(pinode), fname_(fname), inode_(inode), type_(type), path_(path),
+        stat_(stat), stat_time_us_(get_monotonic_us()) {
     // set flags to OpenFile
     if (flags & O_CREAT)
         flags_[to_underlying(OpenFile_flags::creat)] = true;
@@ -37,10 +41,6 @@ OpenFile::OpenFile(const std::string& path, int flags, metafs_inode_t pinode,
     pos_ = 0; // If O_APPEND flag is used, it will be used before each write.
 }
 
-OpenFileMap::OpenFileMap() :
-        fd_idx(START_FD),
-        fd_validation_needed(false) {}
-
 std::string OpenFile::path() const {
     return path_;
 }
@@ -50,17 +50,19 @@ void OpenFile::path(const string& path) {
 }
 
 unsigned long OpenFile::pos() {
-    lock_guard<mutex> lock(pos_mutex_);
-    return pos_;
+    return pos_.load(std::memory_order_acquire);
 }
 
 void OpenFile::pos(unsigned long pos) {
-    lock_guard<mutex> lock(pos_mutex_);
-    OpenFile::pos_ = pos;
+    pos_.store(pos, std::memory_order_release);
+}
+
+unsigned long OpenFile::advance_pos(long off) {
+    return pos_.fetch_add(off, std::memory_order_acq_rel) + off;
 }
 
 bool OpenFile::get_flag(OpenFile_flags flag) {
-    lock_guard<mutex> lock(pos_mutex_);
+    lock_guard<mutex> lock(flag_mutex_);
     return flags_[to_underlying(flag)];
 }
 
@@ -81,16 +83,91 @@ std::string& OpenFile::fname() {
     return fname_;
 }
 
+metafs_inode_t OpenFile::inode() const {
+    return inode_.load(std::memory_order_acquire);
+}
+
+void OpenFile::inode(metafs_inode_t inode) {
+    inode_.store(inode, std::memory_order_release);
+}
+
+bool OpenFile::get_stat(metafs_stat_t &stat, uint64_t timeout_us) {
+    lock_guard<mutex> lock(stat_mutex_);
+    if(timeout_us != 0 && get_monotonic_us() - stat_time_us_ > timeout_us) {
+        return false;
+    }
+    stat = stat_;
+    return true;
+}
+
+void OpenFile::set_stat(const metafs_stat_t &stat) {
+    lock_guard<mutex> lock(stat_mutex_);
+    stat_ = stat;
+    stat_time_us_ = get_monotonic_us();
+}
+
 // OpenFileMap starts here
 
+OpenFileMap::OpenFileMap() : next_word_(0), num_replaced_(0) {
+    slots_ = new std::atomic<FileRef *>[kMaxOpenFiles];
+    for (int i = 0; i < kMaxOpenFiles; i++) {
+        slots_[i].store(nullptr, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < kBitmapWords; i++) {
+        used_bits_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+OpenFileMap::~OpenFileMap() {
+    for (int i = 0; i < kMaxOpenFiles; i++) {
+        delete slots_[i].load(std::memory_order_relaxed);
+    }
+    delete[] slots_;
+}
+
+int OpenFileMap::alloc_slot() {
+    int start = next_word_.load(std::memory_order_relaxed);
+    for (int n = 0; n < kBitmapWords; n++) {
+        int w = (start + n) % kBitmapWords;
+        uint64_t bits = used_bits_[w].load(std::memory_order_relaxed);
+        while (bits != ~0ULL) {
+            int b = __builtin_ctzll(~bits);
+            if (used_bits_[w].compare_exchange_weak(bits, bits | (1ULL << b), std::memory_order_acquire)) {
+                next_word_.store(w, std::memory_order_relaxed);
+                return w * 64 + b;
+            }
+        }
+    }
+    return -1;
+}
+
+bool OpenFileMap::claim_slot(int slot) {
+    uint64_t mask = 1ULL << (slot & 63);
+    return (used_bits_[slot >> 6].fetch_or(mask, std::memory_order_acquire) & mask) == 0;
+}
+
+void OpenFileMap::free_slot(int slot) {
+    used_bits_[slot >> 6].fetch_and(~(1ULL << (slot & 63)), std::memory_order_release);
+}
+
+void OpenFileMap::publish(int slot, const shared_ptr<OpenFile> &open_file) {
+    FileRef *old = slots_[slot].exchange(new FileRef(open_file), std::memory_order_acq_rel);
+    if (old != nullptr) {
+        EpochManager::instance().retire(old);
+    }
+}
+
 shared_ptr<OpenFile> OpenFileMap::get(int fd) {
-    lock_guard<recursive_mutex> lock(files_mutex_);
-    auto f = files_.find(fd);
-    if (f == files_.end()) {
+    if (!valid_fd(fd)) {
+        return nullptr;
+    }
+    // 槽位指向的FileRef在临界区内不会被释放, 拷贝后即可离开
+    EpochGuard guard;
+    FileRef *ref = slots_[fd - START_FD].load(std::memory_order_acquire);
+    if (ref == nullptr) {
         return nullptr;
-    } else {
-        return f->second;
     }
+    return *ref;
 }
 
 shared_ptr<OpenDir> OpenFileMap::get_dir(int dirfd) {
@@ -102,65 +179,53 @@ shared_ptr<OpenDir> OpenFileMap::get_dir(int dirfd) {
 }
 
 bool OpenFileMap::exist(const int fd) {
-    lock_guard<recursive_mutex> lock(files_mutex_);
-    auto f = files_.find(fd);
-    return !(f == files_.end());
-}
-
-int OpenFileMap::safe_generate_fd_idx_() {
-    auto fd = generate_fd_idx();
-    /*
-     * Check if fd is still in use and generate another if yes
-     * Note that this can only happen once the all fd indices within the int has been used to the int::max
-     * Once this limit is exceeded, we set fd_idx back to 3 and begin anew. Only then, if a file was open for
-     * a long time will we have to generate another index.
-     *
-     * This situation can only occur when all fd indices have been given away once and we start again,
-     * in which case the fd_validation_needed flag is set. fd_validation is set to false, if
-     */
-    if (fd_validation_needed) {
-        while (exist(fd)) {
-            fd = generate_fd_idx();
-        }
-    }
-    return fd;
+    return valid_fd(fd) && slots_[fd - START_FD].load(std::memory_order_acquire) != nullptr;
 }
 
 int OpenFileMap::add(std::shared_ptr<OpenFile> open_file) {
-    auto fd = safe_generate_fd_idx_();
-    lock_guard<recursive_mutex> lock(files_mutex_);
-    files_.insert(make_pair(fd, open_file));
-    return fd;
+    int slot = alloc_slot();
+    if (slot < 0) {
+        LOG(WARNING) << "open file table is full, max open files: " << kMaxOpenFiles;
+        return -EMFILE;
+    }
+    publish(slot, open_file);
+    // 先发布再检查, 与replace_inode的先记录再扫描配合, 两者至少有一方能看到对方
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_replaced_.load() > 0) {
+        apply_replaced(open_file);
+    }
+    return START_FD + slot;
 }
 
 bool OpenFileMap::remove(const int fd) {
-    lock_guard<recursive_mutex> lock(files_mutex_);
-    auto f = files_.find(fd);
-    if (f == files_.end()) {
+    if (!valid_fd(fd)) {
         return false;
     }
-    files_.erase(fd);
-    if (fd_validation_needed && files_.empty()) {
-        fd_validation_needed = false;
-        LOG(INFO) << "fd_validation flag reset";
+    int slot = fd - START_FD;
+    FileRef *old = slots_[slot].exchange(nullptr, std::memory_order_acq_rel);
+    if (old == nullptr) {
+        return false;
     }
+    free_slot(slot);
+    EpochManager::instance().retire(old);
     return true;
 }
 
 int OpenFileMap::dup(const int oldfd) {
-    lock_guard<recursive_mutex> lock(files_mutex_);
     auto open_file = get(oldfd);
     if (open_file == nullptr) {
         errno = EBADF;
         return -1;
     }
-    auto newfd = safe_generate_fd_idx_();
-    files_.insert(make_pair(newfd, open_file));
+    int newfd = add(open_file);
+    if (newfd < 0) {
+        errno = -newfd;
+        return -1;
+    }
     return newfd;
 }
 
 int OpenFileMap::dup2(const int oldfd, const int newfd) {
-    lock_guard<recursive_mutex> lock(files_mutex_);
     auto open_file = get(oldfd);
     if (open_file == nullptr) {
         errno = EBADF;
@@ -168,41 +233,76 @@ int OpenFileMap::dup2(const int oldfd, const int newfd) {
     }
     if (oldfd == newfd)
         return newfd;
-    // remove newfd if exists in filemap silently
-    if (exist(newfd)) {
-        remove(newfd);
-    }
-    // to prevent duplicate fd idx in the future. First three fd are reservered by os streams that we do not overwrite
-    if (get_fd_idx() < newfd && newfd != 0 && newfd != 1 && newfd != 2)
-        fd_validation_needed = true;
-    files_.insert(make_pair(newfd, open_file));
+    // newfd只能落在fd表的范围内
+    if (!valid_fd(newfd)) {
+        errno = EBADF;
+        return -1;
+    }
+    // newfd已打开时静默替换
+    claim_slot(newfd - START_FD);
+    publish(newfd - START_FD, open_file);
     return newfd;
 }
 
-/**
- * Generate new file descriptor index to be used as an fd within one process
- * @return fd_idx
- */
-int OpenFileMap::generate_fd_idx() {
-    // We need a mutex here for thread safety
-    std::lock_guard<std::mutex> inode_lock(fd_idx_mutex);
-    if (fd_idx == std::numeric_limits<int>::max()) {
-        LOG(INFO) << " Warning: File descriptor index exceeded ints max value. Setting it back to " << START_FD;
-        /*
-         * Setting fd_idx back to 3 could have the effect that fd are given twice for different path.
-         * This must not happen. Instead a flag is set which tells can tell the OpenFileMap that it should check
-         * if this fd is really safe to use.
-         */
-        fd_idx = START_FD;
-        fd_validation_needed = true;
+void OpenFileMap::apply_replaced(const shared_ptr<OpenFile> &open_file) {
+    if (open_file->type() != FileType::regular) {
+        return;
+    }
+    lock_guard<mutex> lock(replaced_mutex_);
+    for (auto iter = replaced_.begin(); iter != replaced_.end(); ++iter) {
+        if (open_file->inode() == iter->leased_inode && open_file->pinode() == iter->pinode
+            && open_file->fname() == iter->fname) {
+            open_file->inode(iter->inode);
+            open_file->set_stat(iter->stat);
+            replaced_.erase(iter);
+            num_replaced_--;
+            return;
+        }
     }
-    return fd_idx++;
 }
 
-int OpenFileMap::get_fd_idx() {
-    std::lock_guard<std::mutex> inode_lock(fd_idx_mutex);
-    return fd_idx;
-}
+int OpenFileMap::replace_inode(metafs_inode_t pinode, const std::string &fname, metafs_inode_t leased_inode,
+                               metafs_inode_t inode, const metafs_stat_t &stat) {
+    {
+        lock_guard<mutex> lock(replaced_mutex_);
+        replaced_.push_back(ReplacedInode{pinode, fname, leased_inode, inode, stat});
+        num_replaced_++;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
+    int replaced = 0;
+    EpochGuard guard;
+    for (int w = 0; w < kBitmapWords; w++) {
+        uint64_t bits = used_bits_[w].load(std::memory_order_acquire);
+        while (bits != 0) {
+            int slot = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            FileRef *ref = slots_[slot].load(std::memory_order_acquire);
+            if (ref == nullptr) {
+                continue;
+            }
+            OpenFile *f = ref->get();
+            if (f->type() == FileType::regular && f->inode() == leased_inode
+                && f->pinode() == pinode && f->fname() == fname) {
+                f->inode(inode);
+                f->set_stat(stat);
+                replaced++;
+            }
+        }
+    }
+
+    // 一次create只对应一次open, 已经替换过fd时之后的add不需要再检查
+    if (replaced > 0) {
+        lock_guard<mutex> lock(replaced_mutex_);
+        for (auto iter = replaced_.begin(); iter != replaced_.end(); ++iter) {
+            if (iter->leased_inode == leased_inode) {
+                replaced_.erase(iter);
+                num_replaced_--;
+                break;
+            }
+        }
+    }
+    return replaced;
+}
 
 } // end namespace metafs
\ No newline at end of file
@@ -2,334 +2,603 @@
 
 namespace metafs{
 
-rpc_resp_t RpcClient::RPC_Open(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat) {
-    uint64_t pinode_hash = XXH3_64bits(&pinode, metafs_inode_size) % PINODE_HASH_RANGE;
-    region_id_t region_id = find_region_id(RegionKey(0, pinode_hash));
-    p_assert(region_id != -1, "Invalid region_id");
-    int32_t server_session_id = region_id < c_ctx->total_servers ? region_id : 
-                                    JumpConsistentHash(region_id, c_ctx->total_servers);  
+rpc_handle_t RpcClient::RPC_Open_async(metafs_inode_t pinode, const string &fname, mode_t mode) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
 
-    int index = 0;
+    rpc_handle_t index = alloc_window(rctx);
 
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
                     offsetof(wire_req_t, FSOpenReq.fname) + fname.length() + 1);
-    auto req_buf = C_RPC_REQ_BUF(index);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSOpenReq.region_id = region_id;
     req_buf->FSOpenReq.pinode = pinode;
+    req_buf->FSOpenReq.pinode_hash = pinode_hash;
     req_buf->FSOpenReq.mode = mode;
     strcpy(req_buf->FSOpenReq.fname, fname.c_str());
     
-    bool complete_cb = false;
-    c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                            kFSOpenReq, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                            &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                            set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-    while(complete_cb == false) {
-        c_ctx->rpc_->run_event_loop_once();
-    }
-    
-    auto resp_buf = C_RPC_RESP_BUF(index);
+    send_request(rctx, index, server_session_id, region_id, kFSOpenReq);
+    return index;
+}
+
+rpc_resp_t RpcClient::RPC_Open_finish(rpc_handle_t handle, metafs_inode_t &inode, metafs_stat_t &stat) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
     auto res = resp_buf->FSOpenResp.resp_type;
+    note_create_version(C_RPC_CONTEXT_WINDOW(rctx, handle).region_id, res, resp_buf->FSOpenResp.create_version);
     if(likely(res == kSuccess)) {
         inode = resp_buf->FSOpenResp.inode;
         stat = resp_buf->FSOpenResp.stat;
     }
+    free_window(rctx, handle);
     return res;
 }
 
-rpc_resp_t RpcClient::RPC_Getinode(const metafs_inode_t pinode, const string &fname, metafs_inode_t &inode) {
-    uint64_t pinode_hash = XXH3_64bits(&pinode, metafs_inode_size) % PINODE_HASH_RANGE;
-    region_id_t region_id = find_region_id(RegionKey(0, pinode_hash));
-    p_assert(region_id != -1, "Invalid region_id");
-    int32_t server_session_id = region_id < c_ctx->total_servers ? region_id : 
-                                    JumpConsistentHash(region_id, c_ctx->total_servers); 
+rpc_handle_t RpcClient::RPC_OpenCreate_async(metafs_inode_t pinode, const string &fname, mode_t mode, int flags) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
+
+    rpc_handle_t index = alloc_window(rctx);
+
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
+                    offsetof(wire_req_t, FSOpenCreateReq.fname) + fname.length() + 1);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSOpenCreateReq.region_id = region_id;
+    req_buf->FSOpenCreateReq.oid.lo = req_buf->FSOpenCreateReq.oid.hi = 0;
+    req_buf->FSOpenCreateReq.pinode = pinode;
+    req_buf->FSOpenCreateReq.pinode_hash = pinode_hash;
+    req_buf->FSOpenCreateReq.mode = mode;
+    req_buf->FSOpenCreateReq.flags = flags;
+    strcpy(req_buf->FSOpenCreateReq.fname, fname.c_str());
+    
+    send_request(rctx, index, server_session_id, region_id, kFSOpenCreateReq);
+    return index;
+}
 
-    int index = 0;
+rpc_resp_t RpcClient::RPC_OpenCreate_finish(rpc_handle_t handle, metafs_inode_t &inode, metafs_stat_t &stat, bool &created) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
+    auto res = resp_buf->FSOpenCreateResp.resp_type;
+    note_create_version(C_RPC_CONTEXT_WINDOW(rctx, handle).region_id, res, resp_buf->FSOpenCreateResp.create_version);
+    if(likely(res == kSuccess)) {
+        inode = resp_buf->FSOpenCreateResp.inode;
+        stat = resp_buf->FSOpenCreateResp.stat;
+        created = resp_buf->FSOpenCreateResp.created != 0;
+    }
+    free_window(rctx, handle);
+    return res;
+}
 
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+rpc_handle_t RpcClient::RPC_Getinode_async(metafs_inode_t pinode, const string &fname) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
+
+    rpc_handle_t index = alloc_window(rctx);
+
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
                     offsetof(wire_req_t, FSGetinodeReq.fname) + fname.length() + 1);
-    auto req_buf = C_RPC_REQ_BUF(index);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSGetinodeReq.region_id = region_id;
     req_buf->FSGetinodeReq.pinode = pinode;
+    req_buf->FSGetinodeReq.pinode_hash = pinode_hash;
     strcpy(req_buf->FSGetinodeReq.fname, fname.c_str());
     
-    bool complete_cb = false;
-    c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                            kFSGetinodeReq, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                            &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                            set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-    while(complete_cb == false) {
-        c_ctx->rpc_->run_event_loop_once();
-    }
-    
-    auto resp_buf = C_RPC_RESP_BUF(index);
+    send_request(rctx, index, server_session_id, region_id, kFSGetinodeReq);
+    return index;
+}
+
+rpc_resp_t RpcClient::RPC_Getinode_finish(rpc_handle_t handle, metafs_inode_t &inode) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
     auto res = resp_buf->FSGetinodeResp.resp_type;
+    note_create_version(C_RPC_CONTEXT_WINDOW(rctx, handle).region_id, res, resp_buf->FSGetinodeResp.create_version);
     if(likely(res == RespType::kSuccess)) {
         inode = resp_buf->FSGetinodeResp.inode;
     }
+    free_window(rctx, handle);
     return res;
 }
 
 /**
  * @param in pinode file's parent's inode
  * @param in fname filename
- * @param out stat file's stat
  * 
  * XXX: 注意写dentrycache
  */
-rpc_resp_t RpcClient::RPC_Getstat(metafs_inode_t pinode, const string &fname, metafs_inode_t &inode, metafs_stat_t &stat) {
+rpc_handle_t RpcClient::RPC_Getstat_async(metafs_inode_t pinode, const string &fname) {
+    client_rpc_context *rctx = thread_rpc_ctx();
     FS_LOG("Getstat pinode: %d, fname: %s", pinode, fname.c_str());
     
-    uint64_t pinode_hash = XXH3_64bits(&pinode, metafs_inode_size) % PINODE_HASH_RANGE;
-    region_id_t region_id = find_region_id(RegionKey(0, pinode_hash));
-    p_assert(region_id != -1, "Invalid region_id");
-    int32_t server_session_id = region_id < c_ctx->total_servers ? region_id : 
-                                    JumpConsistentHash(region_id, c_ctx->total_servers); 
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
 
-    int index = 0;
+    rpc_handle_t index = alloc_window(rctx);
 
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
                     offsetof(wire_req_t, FSStatReq.fname) + fname.length() + 1);
-    auto req_buf = C_RPC_REQ_BUF(index);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSStatReq.region_id = region_id;
     req_buf->FSStatReq.pinode = pinode;
+    req_buf->FSStatReq.pinode_hash = pinode_hash;
     strcpy(req_buf->FSStatReq.fname, fname.c_str());
     
-    bool complete_cb = false;
-    c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                                     kFSStatReq, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                                     &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                                     set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-    while(complete_cb == false) {
-        c_ctx->rpc_->run_event_loop_once();
-    }
-    
-    auto resp_buf = C_RPC_RESP_BUF(index);
+    send_request(rctx, index, server_session_id, region_id, kFSStatReq);
+    return index;
+}
+
+/**
+ * @param out inode file's inode
+ * @param out stat file's stat
+ */
+rpc_resp_t RpcClient::RPC_Getstat_finish(rpc_handle_t handle, metafs_inode_t &inode, metafs_stat_t &stat) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
     auto res = resp_buf->FSStatResp.resp_type;
+    note_create_version(C_RPC_CONTEXT_WINDOW(rctx, handle).region_id, res, resp_buf->FSStatResp.create_version);
     if(likely(res == RespType::kSuccess)) {
         inode = resp_buf->FSStatResp.inode;
         stat = resp_buf->FSStatResp.stat;
     }
+    free_window(rctx, handle);
     return res;
 }
 
-rpc_resp_t RpcClient::RPC_Mknod(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode, metafs_stat_t &stat) {
-    uint64_t pinode_hash = XXH3_64bits(&pinode, metafs_inode_size) % PINODE_HASH_RANGE;
-    region_id_t region_id = find_region_id(RegionKey(0, pinode_hash));
-    p_assert(region_id != -1, "Invalid region_id");
-    int32_t server_session_id = region_id < c_ctx->total_servers ? region_id : 
-                                    JumpConsistentHash(region_id, c_ctx->total_servers); 
+rpc_handle_t RpcClient::RPC_Mknod_async(metafs_inode_t pinode, const string &fname, mode_t mode) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
 
-    int index = 0;
+    rpc_handle_t index = alloc_window(rctx);
 
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
                     offsetof(wire_req_t, FSMknodReq.fname) + fname.length() + 1);
-    auto req_buf = C_RPC_REQ_BUF(index);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSMknodReq.region_id = region_id;
     req_buf->FSMknodReq.pinode = pinode;
+    req_buf->FSMknodReq.pinode_hash = pinode_hash;
     req_buf->FSMknodReq.mode = mode;
     strcpy(req_buf->FSMknodReq.fname, fname.c_str());
     
-    bool complete_cb = false;
-    c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                            kFSMknodReq, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                            &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                            set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-    while(complete_cb == false) {
-        c_ctx->rpc_->run_event_loop_once();
-    }
-    
-    auto resp_buf = C_RPC_RESP_BUF(index);
-    auto res = resp_buf->FSMkdirResp.resp_type;
+    send_request(rctx, index, server_session_id, region_id, kFSMknodReq);
+    return index;
+}
+
+rpc_resp_t RpcClient::RPC_Mknod_finish(rpc_handle_t handle, metafs_inode_t &inode, metafs_stat_t &stat) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
+    auto res = resp_buf->FSMknodResp.resp_type;
+    note_create_version(C_RPC_CONTEXT_WINDOW(rctx, handle).region_id, res, resp_buf->FSMknodResp.create_version);
     if(likely(res == RespType::kSuccess)) {
         inode = resp_buf->FSMknodResp.inode;
         stat = resp_buf->FSMknodResp.stat;
     }
+    free_window(rctx, handle);
     return res;
 }
 
-rpc_resp_t RpcClient::RPC_Unlink(metafs_inode_t pinode, const string &fname) {
-    uint64_t pinode_hash = XXH3_64bits(&pinode, metafs_inode_size) % PINODE_HASH_RANGE;
-    region_id_t region_id = find_region_id(RegionKey(0, pinode_hash));
-    p_assert(region_id != -1, "Invalid region_id");
-    int32_t server_session_id = region_id < c_ctx->total_servers ? region_id : 
-                                    JumpConsistentHash(region_id, c_ctx->total_servers); 
+rpc_handle_t RpcClient::RPC_Unlink_async(metafs_inode_t pinode, const string &fname) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
 
-    int index = 0;
+    rpc_handle_t index = alloc_window(rctx);
 
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
                     offsetof(wire_req_t, FSUnlinkReq.fname) + fname.length() + 1);
-    auto req_buf = C_RPC_REQ_BUF(index);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSUnlinkReq.region_id = region_id;
     req_buf->FSUnlinkReq.pinode = pinode;
+    req_buf->FSUnlinkReq.pinode_hash = pinode_hash;
     strcpy(req_buf->FSUnlinkReq.fname, fname.c_str());
     
-    bool complete_cb = false;
-    c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                            kFSUnlinkReq, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                            &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                            set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-    while(complete_cb == false) {
-        c_ctx->rpc_->run_event_loop_once();
-    }
-    
-    return C_RPC_RESP_BUF(index)->FSUnlinkResp.resp_type;
+    send_request(rctx, index, server_session_id, region_id, kFSUnlinkReq);
+    return index;
 }
 
-rpc_resp_t RpcClient::RPC_Mkdir(metafs_inode_t pinode, const string &fname, mode_t mode, metafs_inode_t &inode) {
-    uint64_t pinode_hash = XXH3_64bits(&pinode, metafs_inode_size) % PINODE_HASH_RANGE;
-    region_id_t region_id = find_region_id(RegionKey(0, pinode_hash));
-    p_assert(region_id != -1, "Invalid region_id");
-    int32_t server_session_id = region_id < c_ctx->total_servers ? region_id : 
-                                    JumpConsistentHash(region_id, c_ctx->total_servers); 
+rpc_resp_t RpcClient::RPC_Unlink_finish(rpc_handle_t handle) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto res = wait_response(rctx, handle)->FSUnlinkResp.resp_type;
+    free_window(rctx, handle);
+    return res;
+}
 
-    int index = 0;
+rpc_handle_t RpcClient::RPC_Mkdir_async(metafs_inode_t pinode, const string &fname, mode_t mode) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
 
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+    rpc_handle_t index = alloc_window(rctx);
+
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
                     offsetof(wire_req_t, FSMkdirReq.fname) + fname.length() + 1);
-    auto req_buf = C_RPC_REQ_BUF(index);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSMkdirReq.region_id = region_id;
     req_buf->FSMkdirReq.pinode = pinode;
+    req_buf->FSMkdirReq.pinode_hash = pinode_hash;
     req_buf->FSMkdirReq.mode = mode;
     strcpy(req_buf->FSMkdirReq.fname, fname.c_str());
     
-    bool complete_cb = false;
-    c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                            kFSMkdirReq, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                            &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                            set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-    while(complete_cb == false) {
-        c_ctx->rpc_->run_event_loop_once();
-    }
-    
-    auto resp_buf = C_RPC_RESP_BUF(index);
+    send_request(rctx, index, server_session_id, region_id, kFSMkdirReq);
+    return index;
+}
+
+rpc_resp_t RpcClient::RPC_Mkdir_finish(rpc_handle_t handle, metafs_inode_t &inode) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
     auto res = resp_buf->FSMkdirResp.resp_type;
+    note_create_version(C_RPC_CONTEXT_WINDOW(rctx, handle).region_id, res, resp_buf->FSMkdirResp.create_version);
     if(likely(res == RespType::kSuccess)) {
         inode = resp_buf->FSMkdirResp.inode;
     }
+    free_window(rctx, handle);
     return res;
 }
 
-rpc_resp_t RpcClient::RPC_Rmdir(metafs_inode_t pinode, const string &fname) {
-    uint64_t pinode_hash = XXH3_64bits(&pinode, metafs_inode_size) % PINODE_HASH_RANGE;
-    region_id_t region_id = find_region_id(RegionKey(0, pinode_hash));
-    p_assert(region_id != -1, "Invalid region_id");
-    int32_t server_session_id = region_id < c_ctx->total_servers ? region_id : 
-                                    JumpConsistentHash(region_id, c_ctx->total_servers); 
+rpc_handle_t RpcClient::RPC_Rmdir_async(metafs_inode_t pinode, const string &fname) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
 
-    int index = 0;
+    rpc_handle_t index = alloc_window(rctx);
 
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
                     offsetof(wire_req_t, FSRmdirReq.fname) + fname.length() + 1);
-    auto req_buf = C_RPC_REQ_BUF(index);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSRmdirReq.region_id = region_id;
     req_buf->FSRmdirReq.pinode = pinode;
+    req_buf->FSRmdirReq.pinode_hash = pinode_hash;
     strcpy(req_buf->FSRmdirReq.fname, fname.c_str());
     
-    bool complete_cb = false;
-    c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                            kFSRmdirReq, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                            &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                            set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-    while(complete_cb == false) {
-        c_ctx->rpc_->run_event_loop_once();
+    send_request(rctx, index, server_session_id, region_id, kFSRmdirReq);
+    return index;
+}
+
+rpc_resp_t RpcClient::RPC_Rmdir_finish(rpc_handle_t handle) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto res = wait_response(rctx, handle)->FSRmdirResp.resp_type;
+    free_window(rctx, handle);
+    return res;
+}
+
+rpc_handle_t RpcClient::RPC_BatchMknod_async(metafs_inode_t pinode, const vector<pair<string, mode_t>> &entries,
+                                              size_t start, size_t max_count, size_t &count,
+                                              const metafs_inode_t *prealloc_inodes) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
+
+    rpc_handle_t index = alloc_window(rctx);
+
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_, sizeof(wire_req_t::FSBatchMknodReq));
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSBatchMknodReq.region_id = region_id;
+    req_buf->FSBatchMknodReq.pinode = pinode;
+    req_buf->FSBatchMknodReq.pinode_hash = pinode_hash;
+    req_buf->FSBatchMknodReq.prealloc = prealloc_inodes != nullptr;
+
+    // entry: mode(4B) + [inode(8B)] + fname(end with '\0')
+    char *entry = (char *)req_buf->FSBatchMknodReq.entries;
+    int32_t entries_len = 0;
+    const int32_t inode_len = prealloc_inodes != nullptr ? metafs_inode_size : 0;
+    count = 0;
+    max_count = std::min(max_count, std::min(entries.size() - start, (size_t)MAX_BATCH_MKNOD_ENTRIES));
+    while(count < max_count) {
+        const string &fname = entries[start + count].first;
+        int32_t entry_len = sizeof(mode_t) + inode_len + fname.length() + 1;
+        if(entries_len + entry_len > MSG_ENTEY_MAX_SIZE) {
+            break;
+        }
+        char *p = entry + entries_len;
+        memcpy(p, &entries[start + count].second, sizeof(mode_t));
+        p += sizeof(mode_t);
+        if(prealloc_inodes != nullptr) {
+            memcpy(p, &prealloc_inodes[start + count], metafs_inode_size);
+            p += metafs_inode_size;
+        }
+        memcpy(p, fname.c_str(), fname.length() + 1);
+        entries_len += entry_len;
+        count++;
+    }
+    p_assert(count > 0, "no entry to batch mknod");
+    req_buf->FSBatchMknodReq.num_entries = count;
+    req_buf->FSBatchMknodReq.entries_len = entries_len;
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_, FSBatchMknodReq_hdr_size + entries_len);
+
+    send_request(rctx, index, server_session_id, region_id, kFSBatchMknodReq);
+    return index;
+}
+
+rpc_resp_t RpcClient::RPC_BatchMknod_finish(rpc_handle_t handle, rpc_resp_t *results, metafs_inode_t *inodes) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
+    auto res = resp_buf->FSBatchMknodResp.resp_type;
+    if(likely(res == RespType::kSuccess)) {
+        note_create_version(C_RPC_CONTEXT_WINDOW(rctx, handle).region_id, res, resp_buf->FSBatchMknodResp.create_version);
+        for(int32_t i = 0; i < resp_buf->FSBatchMknodResp.num_entries; i++) {
+            results[i] = resp_buf->FSBatchMknodResp.entries[i].resp_type;
+            inodes[i] = resp_buf->FSBatchMknodResp.entries[i].inode;
+        }
+    }
+    free_window(rctx, handle);
+    return res;
+}
+
+rpc_resp_t RpcClient::RPC_AllocInodes(metafs_inode_t pinode, int32_t count, metafs_inode_t &start_inode, int32_t &granted,
+                                      int32_t &lease_ms) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
+
+    rpc_handle_t index = alloc_window(rctx);
+
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_, FSAllocInodesReq_size);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSAllocInodesReq.region_id = region_id;
+    req_buf->FSAllocInodesReq.pinode = pinode;
+    req_buf->FSAllocInodesReq.pinode_hash = pinode_hash;
+    req_buf->FSAllocInodesReq.count = count;
+
+    send_request(rctx, index, server_session_id, region_id, kFSAllocInodesReq);
+    auto resp_buf = wait_response(rctx, index);
+    auto res = resp_buf->FSAllocInodesResp.resp_type;
+    if(likely(res == RespType::kSuccess)) {
+        start_inode = resp_buf->FSAllocInodesResp.start_inode;
+        granted = resp_buf->FSAllocInodesResp.count;
+        lease_ms = resp_buf->FSAllocInodesResp.lease_ms;
+    }
+    free_window(rctx, index);
+    return res;
+}
+
+rpc_handle_t RpcClient::RPC_ResolvePath_async(metafs_inode_t pinode, const vector<string> &names, size_t start, size_t &count) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
+
+    rpc_handle_t index = alloc_window(rctx);
+
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_, sizeof(wire_req_t::FSResolvePathReq));
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSResolvePathReq.region_id = region_id;
+    req_buf->FSResolvePathReq.pinode = pinode;
+    req_buf->FSResolvePathReq.pinode_hash = pinode_hash;
+
+    char *components = req_buf->FSResolvePathReq.components;
+    int32_t components_len = 0;
+    count = 0;
+    while(start + count < names.size() && count < MAX_RESOLVE_PATH_COMPONENTS) {
+        const string &name = names[start + count];
+        if(components_len + name.length() + 1 > MSG_ENTEY_MAX_SIZE) {
+            break;
+        }
+        memcpy(components + components_len, name.c_str(), name.length() + 1);
+        components_len += name.length() + 1;
+        count++;
+    }
+    p_assert(count > 0, "no component to resolve");
+    req_buf->FSResolvePathReq.num_components = count;
+    req_buf->FSResolvePathReq.components_len = components_len;
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_, FSResolvePathReq_hdr_size + components_len);
+
+    send_request(rctx, index, server_session_id, region_id, kFSResolvePathReq);
+    return index;
+}
+
+rpc_resp_t RpcClient::RPC_ResolvePath_finish(rpc_handle_t handle, metafs_inode_t *inodes, int32_t &num_resolved) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
+    auto res = resp_buf->FSResolvePathResp.resp_type;
+    num_resolved = 0;
+    if(res == RespType::kSuccess || res == RespType::kENOENT) {
+        note_create_version(resp_buf->FSResolvePathResp.last_region_id, res, resp_buf->FSResolvePathResp.create_version);
+        num_resolved = resp_buf->FSResolvePathResp.num_resolved;
+        memcpy(inodes, resp_buf->FSResolvePathResp.inodes, num_resolved * sizeof(metafs_inode_t));
+    }
+    free_window(rctx, handle);
+    return res;
+}
+
+// 解析一页readdir响应中的entries并加入open_dir, stats不为空时为readdirplus格式
+static void add_readdir_entries(shared_ptr<OpenDir> &open_dir, const uint8_t *entries, int num_result,
+                                vector<metafs_stat_t> *stats) {
+    FS_LOG("result: %d\n", num_result);
+    const char *fname_ptr = (const char *)entries;
+    int fname_len = -8;
+    metafs_inode_t inode;
+
+    // readdirplus: fname + inode + stat
+    while(stats != nullptr && num_result > 0) {
+        num_result--;
+        fname_len = strlen(fname_ptr) + 1;
+        inode = *(metafs_inode_t*)(fname_ptr + fname_len);
+        FileType ftype = ( inode & inode_prefix_msb) ? FileType::directory : FileType::regular;
+        open_dir->add(fname_ptr, fname_len - 1, ftype, inode);
+        stats->push_back(*(const metafs_stat_t*)(fname_ptr + fname_len + metafs_inode_size));
+        fname_ptr += fname_len + metafs_inode_size + metafs_stat_size;
+    }
+
+    // readdir: pinode + fname + inode
+    while(num_result-- > 0) {
+        fname_ptr += fname_len + 16;
+        fname_len = strlen(fname_ptr) + 1; // fname end with '\0'
+        inode = *(metafs_inode_t*)(fname_ptr + fname_len);
+        FileType ftype = ( inode & inode_prefix_msb) ? FileType::directory : FileType::regular;
+        FS_LOG("fname: %s\n", fname_ptr);
+        open_dir->add(fname_ptr, fname_len - 1, ftype, inode);
     }
-    
-    return C_RPC_RESP_BUF(index)->FSRmdirResp.resp_type;
 }
 
-// TODO: 对于大目录的情况需要进行优化
 // 目前不涉及分区，目录下的所有元数据文件聚集在同一个服务器中
-rpc_resp_t RpcClient::RPC_Readdir(metafs_inode_t pinode, shared_ptr<OpenDir> &open_dir) {
-    FS_LOG("RPC Readdir, pinode: %d", pinode);
+rpc_handle_t RpcClient::RPC_Readdir_page_async(metafs_inode_t pinode, uint64_t offset, bool plus) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    FS_LOG("RPC Readdir, pinode: %d, offset: %lu", pinode, offset);
     
-    uint64_t pinode_hash = XXH3_64bits(&pinode, metafs_inode_size) % PINODE_HASH_RANGE;
-    region_id_t region_id = find_region_id(RegionKey(0, pinode_hash));
-    p_assert(region_id != -1, "Invalid region_id");
-    int32_t server_session_id = region_id < c_ctx->total_servers ? region_id : 
-                                    JumpConsistentHash(region_id, c_ctx->total_servers); 
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
 
-    int index = 0;
+    rpc_handle_t index = alloc_window(rctx);
 
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_, FSReaddirReq_size);
-    auto req_buf = C_RPC_REQ_BUF(index);
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_, FSReaddirReq_size);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSReaddirReq.region_id = region_id;
     req_buf->FSReaddirReq.inode = pinode;
-    req_buf->FSReaddirReq.offset = 0;
-    
-    uint32_t is_uncomplete;
-    do{ 
-        FS_LOG("readdir-----------\n");
-        bool complete_cb = false;
-        c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                                kFSReaddirReq, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                                &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                                set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-        while(complete_cb == false) {
-            c_ctx->rpc_->run_event_loop_once();
-        }
-        
-        auto resp_buf = C_RPC_RESP_BUF(index);
-        auto res = resp_buf->FSReaddirResp.resp_type;
-        if(unlikely(res != RespType::kSuccess)) {
-            return res;
-        }
+    req_buf->FSReaddirReq.inode_hash = pinode_hash;
+    req_buf->FSReaddirReq.offset = offset;
+
+    send_request(rctx, index, server_session_id, region_id, plus ? kFSReaddirPlusReq : kFSReaddirReq);
+    return index;
+}
+
+rpc_resp_t RpcClient::RPC_Readdir_page_finish(rpc_handle_t handle, shared_ptr<OpenDir> &open_dir, vector<metafs_stat_t> *stats,
+                                              uint64_t &next_offset, bool &is_uncomplete) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
+    auto res = resp_buf->FSReaddirResp.resp_type;
+    if(unlikely(res != RespType::kSuccess)) {
+        free_window(rctx, handle);
+        return res;
+    }
+
+    add_readdir_entries(open_dir, resp_buf->FSReaddirResp.entries, resp_buf->FSReaddirResp.num_result, stats);
+    is_uncomplete = resp_buf->FSReaddirResp.is_uncomplete;
+    next_offset = resp_buf->FSReaddirResp.next_offset;
+    free_window(rctx, handle);
+    return RespType::kSuccess;
+}
+
+rpc_handle_t RpcClient::RPC_Opendir_async(metafs_inode_t pinode, const string &fname) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    uint64_t pinode_hash;
+    region_id_t region_id;
+    int32_t server_session_id = locate_server(pinode, pinode_hash, region_id);
+
+    rpc_handle_t index = alloc_window(rctx);
+
+    rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
+                    offsetof(wire_req_t, FSOpendirReq.fname) + fname.length() + 1);
+    auto req_buf = C_RPC_REQ_BUF(rctx, index);
+    req_buf->FSOpendirReq.region_id = region_id;
+    req_buf->FSOpendirReq.pinode = pinode;
+    req_buf->FSOpendirReq.pinode_hash = pinode_hash;
+    strcpy(req_buf->FSOpendirReq.fname, fname.c_str());
+
+    send_request(rctx, index, server_session_id, region_id, kFSOpendirReq);
+    return index;
+}
 
-        // write into buf
-        int result_offset = 0;
-
-        int num_result = resp_buf->FSReaddirResp.num_result;
-        FS_LOG("result: %d\n", num_result);
-        const char *fname_ptr = (const char *)&(resp_buf->FSReaddirResp.entries);
-        int fname_len = -8;
-        metafs_inode_t inode;
-
-        while(num_result--) {
-            fname_ptr += fname_len + 16;
-            fname_len = strlen(fname_ptr) + 1; // fname end with '\0'
-            inode = *(metafs_inode_t*)(fname_ptr + fname_len);
-            FileType ftype = ( inode & inode_prefix_msb) ? FileType::directory : FileType::regular;
-            FS_LOG("fname: %s\n", fname_ptr);
-            open_dir->add(string(fname_ptr), ftype, inode);
+rpc_resp_t RpcClient::RPC_Opendir_finish(rpc_handle_t handle, const string &path, metafs_inode_t pinode,
+                                         const string &fname, shared_ptr<OpenDir> &open_dir) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    auto resp_buf = wait_response(rctx, handle);
+    auto res = resp_buf->FSOpendirResp.resp_type;
+    note_create_version(C_RPC_CONTEXT_WINDOW(rctx, handle).region_id, res, resp_buf->FSOpendirResp.create_version);
+    if(likely(res == kSuccess)) {
+        open_dir = make_shared<OpenDir>(path, pinode, fname, resp_buf->FSOpendirResp.inode, resp_buf->FSOpendirResp.stat);
+        if(resp_buf->FSOpendirResp.page_included) {
+            add_readdir_entries(open_dir, resp_buf->FSOpendirResp.entries, resp_buf->FSOpendirResp.num_result, nullptr);
+            ReaddirCursor &cursor = open_dir->cursor();
+            cursor.next_offset = resp_buf->FSOpendirResp.next_offset;
+            cursor.eof = !resp_buf->FSOpendirResp.is_uncomplete;
         }
+    }
+    free_window(rctx, handle);
+    return res;
+}
 
-        is_uncomplete = resp_buf->FSReaddirResp.is_uncomplete;
-        if(is_uncomplete) {
-            // update next Readdir RPC's Req's offset elem
-            c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_, FSReaddirReq_size);
-            req_buf = C_RPC_REQ_BUF(index);
-            req_buf->FSReaddirReq.inode = pinode;
-            req_buf->FSReaddirReq.offset = resp_buf->FSReaddirResp.next_offset;
+rpc_resp_t RpcClient::RPC_Readdir(metafs_inode_t pinode, shared_ptr<OpenDir> &open_dir, vector<metafs_stat_t> *stats) {
+    uint64_t offset = 0;
+    bool is_uncomplete;
+    do {
+        rpc_resp_t res = RPC_Readdir_page(pinode, offset, open_dir, stats, offset, is_uncomplete);
+        if(unlikely(res != RespType::kSuccess)) {
+            return res;
         }
     } while(is_uncomplete);
 
     return RespType::kSuccess;
 }
 
-rpc_resp_t RpcClient::RPC_ReadRegionmap() {
-    // FS_LOG("read region map");
-    int32_t server_session_id = rand() % c_ctx->total_servers;
-    int index = 0;
-    c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_, sizeof(wire_req_t::ReadRegionmapReq));
-    auto req_buf = C_RPC_REQ_BUF(index);
-    req_buf->ReadRegionmapReq.client_id = c_ctx->id;
-    
-    bool complete_cb = false;
-    c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-                            kReadRegionmap, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-                            &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
-                            set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-
-    while(complete_cb == false) {
-        c_ctx->rpc_->run_event_loop_once();
+// 从server读取region map: 只读取epoch比本地新的server, 按region_id分页读取修改过的region并合并到本地
+rpc_resp_t RpcClient::RPC_ReadRegionmap(bool force) {
+    client_rpc_context *rctx = thread_rpc_ctx();
+    // 同一时刻只有一个线程更新region map, 其他线程等待后发现epoch已同步则直接返回
+    std::lock_guard<std::mutex> lock(c_ctx->region_map_mutex);
+    bool updated = false;
+    rpc_handle_t index = alloc_window(rctx);
+    for(int32_t server_id = 0; server_id < c_cfg->num_servers; server_id++) {
+        if(!force && c_ctx->seen_map_epoch[server_id] <= c_ctx->synced_map_epoch[server_id]) {
+            continue;
+        }
+
+        int32_t server_session_id = server_id * c_cfg->server_fg_threads;
+        uint64_t since_epoch = c_ctx->synced_map_epoch[server_id];
+        uint64_t map_epoch = 0;
+        region_id_t start_region_id = 0;
+        bool is_uncomplete = false;
+        bool first_page = true;
+        do {
+            rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_, sizeof(wire_req_t::ReadRegionmapReq));
+            auto req_buf = C_RPC_REQ_BUF(rctx, index);
+            req_buf->ReadRegionmapReq.client_id = c_ctx->id;
+            req_buf->ReadRegionmapReq.since_epoch = since_epoch;
+            req_buf->ReadRegionmapReq.start_region_id = start_region_id;
+
+            send_request(rctx, index, server_session_id, 0, kReadRegionmap);
+            auto resp = &(wait_response(rctx, index)->ReadRegionmapResp);
+            if(unlikely(resp->resp_type != RespType::kSuccess)) {
+                free_window(rctx, index);
+                return RespType::kFail;
+            }
+            // 分页期间region map可能被修改, 以第一页的epoch作为本次同步到的epoch, 之后的修改会在下次同步时读到
+            if(first_page) {
+                map_epoch = C_RPC_RESP_BUF(rctx, index)->map_epoch;
+                first_page = false;
+            }
+            for(int i = 0; i < resp->num_entries; i++) {
+                auto &region = resp->entries[i];
+                p_info("region#%d: s_hi:%lu, e_hi:%lu, epoch:%lu", region.region_id, region.start_key.hi, region.end_key.hi, region.epoch);
+                auto iter = c_ctx->region_map.find(region.region_id);
+                if(iter == c_ctx->region_map.end()) {
+                    c_ctx->region_map.insert(make_pair(region.region_id, region));
+                } else {
+                    iter->second = region;
+                }
+                updated = true;
+            }
+            is_uncomplete = resp->is_uncomplete;
+            start_region_id = resp->next_region_id;
+        } while(is_uncomplete);
+
+        c_ctx->synced_map_epoch[server_id] = map_epoch;
     }
-    
-    if(likely(C_RPC_RESP_BUF(index)->ReadRegionmapResp.resp_type == RespType::kSuccess)) {
-        auto resp = &(C_RPC_RESP_BUF(index)->ReadRegionmapResp);
-        int num_result = resp->num_entries;
-        // apply resp to region map
-        c_ctx->region_map.clear();
-        for(int i = 0; i < num_result; i++) {
-            auto region = resp->entries[i];
-            p_info("region#%d: s_hi:%d, s_low:%d, e_hi:%d, e_low:%d", region.region_id, region.start_key.hi, region.start_key.low, region.end_key.hi, region.end_key.low);
-            c_ctx->region_map.insert(make_pair(resp->entries[i], resp->entries[i].region_id));
+    free_window(rctx, index);
+
+    // apply region map to region route table
+    if(updated || c_ctx->route_table == nullptr) {
+        vector<ClientRegion> regions;
+        regions.reserve(c_ctx->region_map.size());
+        for(auto &iter : c_ctx->region_map) {
+            regions.push_back(iter.second);
         }
-        return RespType::kSuccess;
+        c_ctx->route_table = make_shared<const RegionRouteTable>(regions, c_ctx->total_servers);
+        c_ctx->route_version++;
     }
-
-    return RespType::kFail;
+    return RespType::kSuccess;
 }
 
 // TODO: for rename
@@ -342,21 +611,21 @@ rpc_resp_t RpcClient::RPC_ReadRegionmap() {
 //     req.mode_req.mode = mode;
 //     const char *key = fname.c_str();
 //     MurmurHash3_x64_128((void *) key, (int)strlen(key), 0, (void *) req.mode_req.hash_fname);
-//     c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+//     rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
 //                     sizeof(req.mode_req));
-//     memcpy(reinterpret_cast<char *>(C_RPC_CONTEXT_WINDOW(index).req_msgbuf_.buf_),
+//     memcpy(reinterpret_cast<char *>(C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_.buf_),
 //              reinterpret_cast<char *>(&req), sizeof(req.mode_req));
     
 //     bool complete_cb = false;
-//     c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-//                                      kRemove, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-//                                      &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
+//     rctx->rpc_->enqueue_request(rctx->session_num_vec_[server_session_id],
+//                                      kRemove, &C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
+//                                      &C_RPC_CONTEXT_WINDOW(rctx, index).resp_msgbuf_, 
 //                                      set_complete_cb, reinterpret_cast<void*>(&complete_cb));
 //     while(complete_cb == false) {
-//         c_ctx->rpc_->run_event_loop_once();
+//         rctx->rpc_->run_event_loop_once();
 //     }
     
-//     auto res_buf = C_RPC_RESP_BUF(index);
+//     auto res_buf = C_RPC_RESP_BUF(rctx, index);
 //     return res_buf->resp_type;
 // }
 
@@ -370,21 +639,21 @@ rpc_resp_t RpcClient::RPC_ReadRegionmap() {
 //     req.has_stat_req.pinode = pinode;
 //     req.has_stat_req.stat = stat;
 //     strcpy(req.has_stat_req.fname, fname.c_str());
-//     c_ctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
+//     rctx->rpc_->resize_msg_buffer(&C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
 //                     sizeof(req.has_stat_req));
-//     memcpy(reinterpret_cast<char *>(C_RPC_CONTEXT_WINDOW(index).req_msgbuf_.buf_),
+//     memcpy(reinterpret_cast<char *>(C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_.buf_),
 //              reinterpret_cast<char *>(&req), sizeof(req.has_stat_req));
     
 //     bool complete_cb = false;
-//     c_ctx->rpc_->enqueue_request(c_ctx->session_num_vec_[server_session_id],
-//                                      kCreateEntry, &C_RPC_CONTEXT_WINDOW(index).req_msgbuf_,
-//                                      &C_RPC_CONTEXT_WINDOW(index).resp_msgbuf_, 
+//     rctx->rpc_->enqueue_request(rctx->session_num_vec_[server_session_id],
+//                                      kCreateEntry, &C_RPC_CONTEXT_WINDOW(rctx, index).req_msgbuf_,
+//                                      &C_RPC_CONTEXT_WINDOW(rctx, index).resp_msgbuf_, 
 //                                      set_complete_cb, reinterpret_cast<void*>(&complete_cb));
 //     while(complete_cb == false) {
-//         c_ctx->rpc_->run_event_loop_once();
+//         rctx->rpc_->run_event_loop_once();
 //     }
     
-//     auto res_buf = C_RPC_RESP_BUF(index);
+//     auto res_buf = C_RPC_RESP_BUF(rctx, index);
 //     return res_buf->resp_type;
 // }
 
@@ -8,8 +8,9 @@ using namespace std;
 namespace metafs {
 
 atomic<region_id_t> global_region_id(0);
-unordered_map<region_id_t, ClientRegion> global_region_map;
-RWLock global_region_map_rwlock;
+map<region_id_t, ClientRegion> global_region_map;
+BRLock global_region_map_rwlock;
+atomic<uint64_t> global_region_epoch(0);
 
 struct server_config *s_cfg;
 erpc::Nexus* s_nexus; // 每个进程一个
@@ -17,6 +18,7 @@ thread_local struct server_context *s_ctx;
 struct server_context s_ctx_arr[MAX_FG_THREADS]; // 伪共享问题？
 threadsafe_queue<pair<size_t, region_id_t>> shared_split_queue;
 struct split_region_thread_context *st_ctx; // 只用于split thread
+BgWorkerPool *bg_pool;
 
 void server_parse_config(const char *fn) {
     p_assert(fn, "no config file");
@@ -32,6 +34,11 @@ void server_parse_config(const char *fn) {
       {"rocksdb_path", offsetof(struct server_config, rocksdb_path), cJSON_String, "/tmp/"},
       {"memcached_ip", offsetof(struct server_config, memcached_ip), cJSON_String, "localhost"},
       {"memcached_port", offsetof(struct server_config, memcached_port), cJSON_Number, "0"},
+      {"timestamp_policy", offsetof(struct server_config, timestamp_policy), cJSON_String, "strict"},
+      {"lazytime_flush_ms", offsetof(struct server_config, lazytime_flush_ms), cJSON_Number, "1000"},
+      {"lazytime_max_dirty", offsetof(struct server_config, lazytime_max_dirty), cJSON_Number, "65536"},
+      {"inode_cache_size", offsetof(struct server_config, inode_cache_size), cJSON_Number, "0"},
+      {"create_cap_lease_ms", offsetof(struct server_config, create_cap_lease_ms), cJSON_Number, "0"},
       {NULL, 0, 0, NULL},
     };
 
@@ -45,6 +52,20 @@ void init_server_config() {
     server_parse_config(fn);
     p_assert(s_cfg->server_fg_threads <= 40 
                 && s_cfg->server_fg_threads > 0, "");
+
+    if(strcmp(s_cfg->timestamp_policy, "strict") == 0) {
+        s_cfg->ts_policy = kTsStrict;
+    } else if(strcmp(s_cfg->timestamp_policy, "relatime") == 0) {
+        s_cfg->ts_policy = kTsRelatime;
+    } else if(strcmp(s_cfg->timestamp_policy, "noatime") == 0) {
+        s_cfg->ts_policy = kTsNoatime;
+    } else if(strcmp(s_cfg->timestamp_policy, "lazytime") == 0) {
+        s_cfg->ts_policy = kTsLazytime;
+    } else {
+        p_assert(false, "unknown timestamp_policy: %s", s_cfg->timestamp_policy);
+    }
+    p_assert(s_cfg->lazytime_flush_ms > 0 && s_cfg->lazytime_max_dirty > 0, "invalid lazytime config");
+    p_info("timestamp policy: %s", s_cfg->timestamp_policy);
     
     //init server id
 	{
@@ -91,6 +112,16 @@ void init_server_context(size_t thread_id) {
     p_assert(s_ctx->log_db != NULL, "rocksdb(logdb) init fail");
     p_info("init rocksdb success, path : %s", rocksdb_path.c_str());
 
+    // init DRAM inode cache
+    s_ctx->inode_cache = nullptr;
+    if(s_cfg->inode_cache_size > 0) {
+        s_ctx->inode_cache = new InodeCache(s_cfg->inode_cache_size);
+        p_info("thread#%d inode cache size: %d", thread_id, s_cfg->inode_cache_size);
+    }
+
+    // 后台任务计数
+    s_ctx->bg_inflight = 0;
+
     // init per-thread erpc context
     s_ctx->rpc = new erpc::Rpc<erpc::CTransport>(s_nexus, (void*)(s_ctx), thread_id, nullptr);
     s_ctx->rpc->retry_connect_on_invalid_rpc_id_ = true;
@@ -100,11 +131,108 @@ void init_server_context(size_t thread_id) {
     p_info("region register done");
 }
 
+// inode cache命中率和请求延迟的统计打印周期
+static const uint64_t kStatsIntervalMs = 60 * 1000;
+
+static void print_inode_cache_stats() {
+    InodeCache::Stats st = s_ctx->inode_cache->GetStats();
+    uint64_t lookups = st.hits + st.misses;
+    p_info("thread#%lu inode cache: hits %lu, misses %lu, hit rate %.2f%%, stale %lu, evictions %lu, entries %lu",
+        s_ctx->thread_id, st.hits, st.misses, lookups == 0 ? 0.0 : 100.0 * st.hits / lookups,
+        st.stale, st.evictions, st.entries);
+}
+
+// 打印本周期内每类请求的延迟并清零
+static void print_latency_stats() {
+    static const char *class_names[kNumHandlerClasses] = {"inline", "background"};
+    for(int i = 0; i < kNumHandlerClasses; i++) {
+        LatencyHist &hist = s_ctx->latency[i];
+        if(hist.count() == 0) {
+            continue;
+        }
+        p_info("thread#%lu %s requests: %lu, avg %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us",
+            s_ctx->thread_id, class_names[i], hist.count(), hist.avg_ns() / 1000.0,
+            hist.percentile_ns(50) / 1000.0, hist.percentile_ns(99) / 1000.0, hist.max_ns() / 1000.0);
+        hist.reset();
+    }
+}
+
+// worker执行完work后调用, 把任务交还给提交任务的前台线程
+static void complete_bg_task(BgTask *task) {
+    task->ctx->bg_done.push(task);
+}
+
+void submit_bg_task(BgTask *task) {
+    server_context *ctx = task->ctx;
+    if(bg_pool == nullptr) {
+        task->work(task);
+        task->done(task);
+        delete task;
+        return;
+    }
+    task->start_tsc = ctx->req_start_tsc;
+    ctx->req_deferred = true;
+    ctx->bg_inflight++;
+    bg_pool->submit(task);
+}
+
+void poll_bg_tasks(server_context *ctx) {
+    BgTask *task;
+    while(ctx->bg_done.pop(task)) {
+        ctx->bg_inflight--;
+        task->done(task);
+        record_latency(ctx, kHandlerBackground, task->start_tsc);
+        delete task;
+    }
+}
+
+// 所有client请求都经过这里注册, cls为请求的分类(见bg_worker.h), 同时统计每类请求的处理延迟;
+// 交给后台的请求在poll_bg_tasks中执行完done后统计
+template <void (*handler)(erpc::ReqHandle *, void *), HandlerClass cls>
+static void classified_handler(erpc::ReqHandle *req_handle, void *_context) {
+    server_context *ctx = static_cast<server_context *>(_context);
+    ctx->req_start_tsc = erpc::rdtsc();
+    ctx->req_deferred = false;
+    handler(req_handle, _context);
+    if(!ctx->req_deferred) {
+        record_latency(ctx, cls, ctx->req_start_tsc);
+    }
+}
+
 void run_server_thread(size_t thread_id) {
     p_info("init server#%d thread#%d", s_cfg->id, thread_id);
     init_server_context(thread_id);
     p_info("server#%d thread#%d run event loop", s_cfg->id, thread_id);
-    s_ctx->rpc->run_event_loop(1000000);
+    // 每轮event loop刷新一次粗粒度时钟, handler中取时间戳不再调用gettimeofday
+    uint64_t now_ms = CoarseClock::refresh();
+    uint64_t end_ms = now_ms + 1000000;
+    uint64_t next_flush_ms = now_ms + s_cfg->lazytime_flush_ms;
+    uint64_t next_stats_ms = now_ms + kStatsIntervalMs;
+    while(now_ms < end_ms) {
+        s_ctx->rpc->run_event_loop_once();
+        if(s_ctx->bg_inflight != 0) {
+            poll_bg_tasks(s_ctx);
+        }
+        now_ms = CoarseClock::refresh();
+        // lazytime: 每个flush周期在本线程将dirty时间戳批量写回
+        if(s_cfg->ts_policy == kTsLazytime && now_ms >= next_flush_ms) {
+            flush_dirty_stats(s_ctx);
+            next_flush_ms = now_ms + s_cfg->lazytime_flush_ms;
+        }
+        if(now_ms >= next_stats_ms) {
+            if(s_ctx->inode_cache != nullptr) {
+                print_inode_cache_stats();
+            }
+            print_latency_stats();
+            next_stats_ms = now_ms + kStatsIntervalMs;
+        }
+    }
+    // 等待已提交的后台任务回复完
+    while(s_ctx->bg_inflight != 0) {
+        s_ctx->rpc->run_event_loop_once();
+        poll_bg_tasks(s_ctx);
+    }
+    flush_dirty_stats(s_ctx);
 }
 
 void split_region_thread(size_t thread_id) {
@@ -168,19 +296,33 @@ void init_and_start_loop() {
     string uri(s_cfg->local_ip);
     uri += ":" + to_string(s_cfg->local_port);
     p_info("server uri: %s", uri.c_str());
+    // 不使用eRPC的后台线程: 其handler不在前台线程执行, 无法访问前台线程私有的状态;
+    // server_bg_threads用于BgWorkerPool, 只把扫描MetaDb的部分交给后台
     s_nexus = new erpc::Nexus(uri, 0, 0);
     p_assert(s_nexus != NULL, "s_nexus is null")
 
-    s_nexus->register_req_func(metafs::kReqType::kFSOpenReq, fs_open_handler);
-    s_nexus->register_req_func(metafs::kReqType::kFSUnlinkReq, fs_unlink_handler);
-    s_nexus->register_req_func(metafs::kReqType::kFSStatReq, fs_stat_handler);
-    s_nexus->register_req_func(metafs::kReqType::kFSMknodReq, fs_mknod_handler);
-    s_nexus->register_req_func(metafs::kReqType::kFSMkdirReq, fs_mkdir_handler);
-    s_nexus->register_req_func(metafs::kReqType::kFSRmdirReq, fs_rmdir_handler);
-    s_nexus->register_req_func(metafs::kReqType::kFSReaddirReq, fs_readdir_handler);
-    s_nexus->register_req_func(metafs::kReqType::kFSGetinodeReq, fs_getinode_handler);
+    if(s_cfg->server_bg_threads > 0) {
+        bg_pool = new BgWorkerPool();
+        bg_pool->start(s_cfg->server_bg_threads, complete_bg_task);
+        p_info("start %d background workers", s_cfg->server_bg_threads);
+    }
 
-    s_nexus->register_req_func(metafs::kReqType::kReadRegionmap, read_region_map_handler);
+    s_nexus->register_req_func(metafs::kReqType::kFSOpenReq, classified_handler<fs_open_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSUnlinkReq, classified_handler<fs_unlink_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSStatReq, classified_handler<fs_stat_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSMknodReq, classified_handler<fs_mknod_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSMkdirReq, classified_handler<fs_mkdir_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSRmdirReq, classified_handler<fs_rmdir_handler, kHandlerBackground>);
+    s_nexus->register_req_func(metafs::kReqType::kFSReaddirReq, classified_handler<fs_readdir_handler, kHandlerBackground>);
+    s_nexus->register_req_func(metafs::kReqType::kFSGetinodeReq, classified_handler<fs_getinode_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSBatchMknodReq, classified_handler<fs_batch_mknod_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSResolvePathReq, classified_handler<fs_resolve_path_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSReaddirPlusReq, classified_handler<fs_readdir_plus_handler, kHandlerBackground>);
+    s_nexus->register_req_func(metafs::kReqType::kFSOpenCreateReq, classified_handler<fs_open_create_handler, kHandlerInline>);
+    s_nexus->register_req_func(metafs::kReqType::kFSOpendirReq, classified_handler<fs_opendir_handler, kHandlerBackground>);
+    s_nexus->register_req_func(metafs::kReqType::kFSAllocInodesReq, classified_handler<fs_alloc_inodes_handler, kHandlerInline>);
+
+    s_nexus->register_req_func(metafs::kReqType::kReadRegionmap, classified_handler<read_region_map_handler, kHandlerInline>);
     
     s_nexus->register_req_func(metafs::kReqType::kCreateRegionReq, s2s_create_region_handler);
     s_nexus->register_req_func(metafs::kReqType::kSendRegionReq, s2s_send_region_handler);
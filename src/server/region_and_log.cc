@@ -3,6 +3,8 @@
 #include "util/jump_hash.h"
 #include "xxHash/xxhash.h"
 
+#include <rocksdb/write_batch.h>
+
 namespace metafs {
 
 // 初始时根据id注册region
@@ -12,21 +14,20 @@ void register_region() {
     region_id_t region_id = s_ctx->global_id;
     p_info("thread#%lu, region_id:%d", s_ctx->thread_id, region_id);
 
-    // 左闭右闭区间
-    RegionKey skey(0, region_id * PINODE_HASH_RANGE);
-    RegionKey ekey(0, (region_id + 1) * PINODE_HASH_RANGE - 1);
-    
+    // 左闭右闭区间, 所有server线程的初始region等分整个hash值域
+    RegionKey skey, ekey;
+    get_init_region_range(region_id, s_cfg->num_servers * s_cfg->server_fg_threads, skey, ekey);
+    p_info("region#%d: s_hi:%lu, e_hi:%lu", region_id, skey.hi, ekey.hi);
+
     ServerRegion *region = new ServerRegion(region_id, skey, ekey);
     region->region_status = RegionStatus::Normal;
     
-    {
-        WriteGuard wl(s_ctx->region_map_lock);
-        s_ctx->region_map.insert(make_pair(region_id, region));
-    }
+    s_ctx->region_table.insert(region_id, region);
 
     {
         WriteGuard wl(global_region_map_rwlock);
-        global_region_map.insert(make_pair(region_id, ClientRegion(region_id, skey, ekey)));
+        uint64_t epoch = ++global_region_epoch;
+        global_region_map.insert(make_pair(region_id, ClientRegion(region_id, skey, ekey, epoch)));
     }
 }
 
@@ -48,7 +49,13 @@ bool check_region_status(ServerRegion *region) {
 void check_region_and_split(ServerRegion *region) {
     p_info("******************");
     if (region->kv_num > region_split_threshold) {
-        RegionKey nr_skey(0, (region->end_key.hi >> 1) + 1);
+        if (region->start_key.hi == region->end_key.hi) {
+            p_info("region#%d only has one hash value, can not split", region->region_id);
+            region->region_status = RegionStatus::Normal;
+            return;
+        }
+        // 新region为原region的右半部分
+        RegionKey nr_skey(0, get_region_split_key(region->start_key, region->end_key) + 1);
         RegionKey nr_ekey(0, region->end_key.hi);
         region_id_t nr_region_id = global_region_id++;
         
@@ -63,10 +70,7 @@ void check_region_and_split(ServerRegion *region) {
         ServerRegion *nr = new ServerRegion(nr_region_id, nr_skey, nr_ekey);
         nr->left_region_id = region->region_id;
 
-        {
-            WriteGuard wl(s_ctx->region_map_lock);
-            s_ctx->region_map.insert(make_pair(nr_region_id, nr));
-        }
+        s_ctx->region_table.insert(nr_region_id, nr);
         
         shared_split_queue.push(make_pair(s_ctx->thread_id, nr_region_id));
     }
@@ -89,6 +93,18 @@ void log_op(ServerRegion *region, bool is_delete_op,
     p_assert(s.ok(), "write log fail");
 }
 
+void log_put_ops(ServerRegion *region, metafs_inode_t pinode, int32_t num_ops,
+        const char *const *fnames, const metafs_stat_t *stats, const metafs_inode_t *inodes) {
+    rocksdb::WriteBatch batch;
+    for(int32_t i = 0; i < num_ops; i++) {
+        log_key key(region->region_id, region->log_id++);
+        put_log_val log_val(pinode | inode_prefix_ssb, inodes[i], fnames[i], &stats[i]);
+        batch.Put(key.ToSlice(), log_val.ToSlice());
+    }
+    rocksdb::Status s = s_ctx->log_db->Write(rocksdb::WriteOptions(), &batch);
+    p_assert(s.ok(), "write log fail");
+}
+
 // establish rpc between servers
 
 // origin server methods
@@ -102,11 +118,8 @@ void rpc_create_region(region_id_t region_id) {
                     CreateRegionReq_size);
     auto req_buf = ST_RPC_REQ_BUF(msg_idx);
 
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[region_id];
-    }
+    ServerRegion *region = s_ctx->region_table.find(region_id);
+    p_assert(region != nullptr, "region should not be null");
     
     req_buf->CreateRegionReq.region_id = region_id;
     req_buf->CreateRegionReq.start_key = region->start_key;
@@ -149,13 +162,8 @@ void rpc_send_region_log(ServerRegion *region, int32_t next_log_id, uint64_t msg
         int32_t nums_logs = 0;
         char *entry_ptr = (char*)s_req->entries;
 
-        ServerRegion *left_region;
-        {
-            ReadGuard rl(s_ctx->region_map_lock);
-            auto region_iter = s_ctx->region_map.find(region->left_region_id);
-            p_assert(region_iter != s_ctx->region_map.end(), "region_iter should not be null");
-            left_region = region_iter->second;
-        }
+        ServerRegion *left_region = s_ctx->region_table.find(region->left_region_id);
+        p_assert(left_region != nullptr, "left_region should not be null");
 
         rocksdb::Iterator *log_iter = s_ctx->log_db->NewIterator(rocksdb::ReadOptions());
         log_key start_key(left_region->region_id, next_log_id);
@@ -184,15 +192,20 @@ void rpc_send_region_log(ServerRegion *region, int32_t next_log_id, uint64_t msg
                     p_assert(false, "not exist in global region map");
                 }
 
-                left_region->end_key.hi >>= 1;
-                p_assert(left_region->end_key.hi > 0, "region split fail, need to adjust init range");
+                // 原region保留左半部分, 与check_region_and_split中的分裂点一致
+                left_region->end_key.hi = region->start_key.hi - 1;
+                p_assert(left_region->start_key.hi <= left_region->end_key.hi, "region split fail, invalid split key");
 
-                ClientRegion r1(region->region_id, RegionKey(region->start_key), RegionKey(region->end_key));
-                ClientRegion r2(left_region->region_id, RegionKey(left_region->start_key), RegionKey(left_region->end_key));
+                // 两个子region使用同一个新epoch, client增量读取时一起拿到
+                uint64_t epoch = ++global_region_epoch;
+                ClientRegion r1(region->region_id, RegionKey(region->start_key), RegionKey(region->end_key), epoch);
+                ClientRegion r2(left_region->region_id, RegionKey(left_region->start_key), RegionKey(left_region->end_key), epoch);
 
                 global_region_map.insert(make_pair(r1.region_id, r1));
                 global_region_map.insert(make_pair(r2.region_id, r2));
                 
+                // region范围缩小, 使client缓存的该region的负缓存失效
+                left_region->create_version++;
                 left_region->region_status = RegionStatus::SplitAlmostDone;
             }
         }
@@ -220,13 +233,18 @@ void rpc_send_region_log(ServerRegion *region, int32_t next_log_id, uint64_t msg
             // 删除region的所有log
             // 删除region内kv，但目前metakv好像没开GC，就不删了
 
-            // 删除临时创建的region
-            {
-                WriteGuard wl(s_ctx->region_map_lock);
-                s_ctx->region_map.erase(region->region_id);
+            // region内的目录已经交给目标server的pinode_table, 本线程不再记录
+            size_t erased = s_ctx->pinode_table.erase_range(region->start_key.hi, region->end_key.hi);
+            p_info("erase %lu pinodes from pinode_table", erased);
+
+            // 删除临时创建的region, 前台线程可能仍在使用, 等其退出EpochGuard后再释放
+            s_ctx->region_table.erase(region->region_id);
+            EpochManager::instance().retire(region);
+
+            // region已经迁出, 丢弃前台线程的inode缓存, 之后迁回时不会读到迁出期间过期的项
+            if(s_ctx->inode_cache != nullptr) {
+                s_ctx->inode_cache->Invalidate();
             }
-            
-            delete region;
 
             // 更新region状态
             left_region->log_id = 0;
@@ -245,8 +263,14 @@ void rpc_send_region_log(ServerRegion *region, int32_t next_log_id, uint64_t msg
 
 const int32_t region_entry_max_size = (metafs_inode_size + METAFS_MAX_FNAME_LEN + metafs_inode_size + metafs_stat_size);
 
+// ReadDir读出的entry最短为pinode(8B)+fname(至少1B+'\0')+inode(8B), 发送时每条entry再附带stat,
+// 限制每次ReadDir读取的长度, 保证加上stat后不超过MSG_ENTEY_MAX_SIZE
+static const int64_t kMinRegionEntrySize = 2 * metafs_inode_size + 2;
+static const int64_t kSendRegionReadSize = MSG_ENTEY_MAX_SIZE * kMinRegionEntrySize / 
+                                           (kMinRegionEntrySize + metafs_stat_size);
 
-// 现在迁移是把整个目录迁走,该函数不迁stat
+
+// 现在迁移是把整个目录迁走, 目录下每个文件的stat随dentry一起发送
 // 如果传入的pinode==0,则表示pinode set还没有开始读
 void rpc_send_region(ServerRegion *region, uint64_t msg_idx, uint64_t pinode_hash, metafs_inode_t pinode, uint64_t next_offset) {
     int32_t server_session_id = region->region_id < st_ctx->num_server_sessions ? region->region_id : 
@@ -256,109 +280,104 @@ void rpc_send_region(ServerRegion *region, uint64_t msg_idx, uint64_t pinode_has
     p_info("rpc_send_region, msg_idx:%ld", msg_idx);
 
 {
-
-    ReadGuard rl(s_ctx->pinode_table_lock);
-    p_info("pinode_table size :%d", s_ctx->pinode_table.size());
-
-    map<uint64_t, set<metafs_inode_t>>::iterator pinode_set_iter;
-    set<metafs_inode_t>::iterator pinode_iter;
+    p_info("pinode_table size :%lu", s_ctx->pinode_table.size());
 
     // region是左闭右闭区间
     metafs_inode_t end_pinode_hash = region->end_key.hi;
 
-    for (; pinode_hash <= end_pinode_hash; pinode_hash++) {
-        pinode_set_iter = s_ctx->pinode_table.find(pinode_hash);
-        if(pinode_set_iter == s_ctx->pinode_table.end()) {
-            continue;
+    // hash值域为64位，只遍历pinode_table中实际存在的目录;
+    // 按(hash, pinode)顺序每次取下一个目录, 只短暂持有pinode_table的一个分片锁, 发送期间不阻塞mkdir/rmdir
+    PinodeTable::Entry entry;
+    while (s_ctx->pinode_table.lower_bound(pinode_hash, pinode, end_pinode_hash, &entry)) {
+        if (entry.hash != pinode_hash || entry.pinode != pinode) {
+            // 上次读到一半的目录已被删除
+            next_offset = 0;
         }
-        pinode_iter = (pinode == 0) ? pinode_set_iter->second.begin() : pinode_set_iter->second.find(pinode);
-        while(pinode_iter != pinode_set_iter->second.end()) {
-            pinode = *pinode_iter;
-            p_info("pinode: %llx, pinode_hash % PINODE_HASH_RANGE: %lu, next_offset: %ld", pinode, 
-                                XXH3_64bits((void*)&pinode, metafs_inode_size) % PINODE_HASH_RANGE, next_offset);
-            char *res = NULL;
-            MetaKvStatus status = ReadDir(s_ctx->metadb, pinode, &res, next_offset, MSG_ENTEY_MAX_SIZE);
-            if(res != NULL) {
-                st_ctx->rpc->resize_msg_buffer(&ST_CTX_RPC_WINDOW(msg_idx).req_msgbuf_, SendRegionReq_size);
-                auto s_req = &ST_RPC_REQ_BUF(msg_idx)->SendRegionReq;
-
-                // res前四个int64字段存储了res自身的元数据
-                struct LogScanHeader *header = (struct LogScanHeader *) res;
-                s_req->offset = header->new_offset;
-                next_offset = header->new_offset;
-                is_uncomplete = header->is_uncomplete;
-                s_req->num_result = header->rel_count;
-                s_req->entries_len = header->rel_len;
-                p_assert(s_req->entries_len <= MSG_ENTEY_MAX_SIZE, "buffer oversize, entries_len:%ld", s_req->entries_len);
-                memcpy(&s_req->entries, res + 4 * sizeof(uint64_t), s_req->entries_len);
-                free(res);
-                res = NULL;
-
-                {
-                    int32_t num_result = s_req->num_result;
-                    uint8_t *buf = s_req->entries;
-                    int qwert = 0;
-                    while(num_result--) {
-                        metafs_inode_t pinode = (metafs_inode_t)*buf;
-                        buf += metafs_inode_size;
-
-                        char *fname = (char*)buf;
-                        size_t fname_len = strlen(fname) + 1;
-                        buf += fname_len;
-
-                        metafs_inode_t inode = (metafs_inode_t)*buf;
-                        buf += metafs_inode_size;
-                        p_assert(false, "entry: %x, %x, %x, %x, pinode: %lx, fname: %s, inode:%lx",
-                                         buf[0], buf[1], buf[2], buf[3], pinode, fname, inode);
-                        p_info("#%d origin region: pinode:%llx, fname:%s, inode:%llx", qwert++, pinode, fname, inode);
-                    }
+        pinode_hash = entry.hash;
+        pinode = entry.pinode;
+        p_info("pinode: %llx, pinode_hash: %lu, next_offset: %ld", pinode, pinode_hash, next_offset);
+        char *res = NULL;
+        MetaKvStatus status = ReadDir(s_ctx->metadb, pinode, &res, next_offset, kSendRegionReadSize);
+        st_ctx->rpc->resize_msg_buffer(&ST_CTX_RPC_WINDOW(msg_idx).req_msgbuf_, SendRegionReq_size);
+        auto s_req = &ST_RPC_REQ_BUF(msg_idx)->SendRegionReq;
+        if(res != NULL) {
+            // res前四个int64字段存储了res自身的元数据
+            struct LogScanHeader *header = (struct LogScanHeader *) res;
+            s_req->offset = header->new_offset;
+            next_offset = header->new_offset;
+            is_uncomplete = header->is_uncomplete;
+            s_req->num_result = header->rel_count;
+
+            // pinode + fname + inode -> pinode + fname + inode + stat
+            const char *src = res + 4 * sizeof(uint64_t);
+            char *dst = (char *)s_req->entries;
+            for(int64_t i = 0; i < s_req->num_result; i++) {
+                size_t fname_len = strlen(src + metafs_inode_size) + 1;
+                size_t len = metafs_inode_size + fname_len + metafs_inode_size;
+                memcpy(dst, src, len);
+                metafs_inode_t inode;
+                memcpy(&inode, src + metafs_inode_size + fname_len, metafs_inode_size);
+                src += len;
+                dst += len;
+
+                MetaKvSlice stat_slice;
+                SliceInit(&stat_slice, metafs_stat_size, dst);
+                if(!check_status_ok(GetStat(s_ctx->metadb, inode, &stat_slice))) {
+                    memset(dst, 0, metafs_stat_size);
                 }
+                dst += metafs_stat_size;
+            }
+            s_req->entries_len = dst - (char *)s_req->entries;
+            p_assert(s_req->entries_len <= MSG_ENTEY_MAX_SIZE, "buffer oversize, entries_len:%ld", s_req->entries_len);
+            free(res);
+            res = NULL;
+        } else {
+            // 空目录也发送一次(num_result为0), 让目标server的pinode_table记录该目录
+            s_req->offset = 0;
+            next_offset = 0;
+            is_uncomplete = 0;
+            s_req->num_result = 0;
+            s_req->entries_len = 0;
+        }
 
-                ServerRegion *left_region;
-                {
-                    ReadGuard rl(s_ctx->region_map_lock);
-                    auto region_iter = s_ctx->region_map.find(region->left_region_id);
-                    p_assert(region_iter != s_ctx->region_map.end(), "region_iter should not be null");
-                    left_region = region_iter->second;
-                }
-                
-                // 更新原region的kv_num
-                left_region->kv_num -= s_req->num_result;
-            
-                p_info("send region to target, pinode: %llx, num_kv:%d, next_offset:%llu",
-                                 pinode, s_req->num_result, next_offset);
-                // 发送rpc
-                s_req->region_id = region->region_id;
-                s_req->is_uncomplete = is_uncomplete;
-                s_req->pinode_hash = pinode_hash;
-                s_req->pinode = pinode;
-
-                // 先使用同步实现
-                bool complete_cb = false;
-                st_ctx->rpc->enqueue_request(st_ctx->s2s_session_num_vec[server_session_id],
-                                        kSendRegionReq, &ST_CTX_RPC_WINDOW(msg_idx).req_msgbuf_,
-                                        &ST_CTX_RPC_WINDOW(msg_idx).resp_msgbuf_, 
-                                        set_complete_cb, reinterpret_cast<void*>(&complete_cb));
-                while(complete_cb == false) {
-                    st_ctx->rpc->run_event_loop_once();
-                }
+        ServerRegion *left_region = s_ctx->region_table.find(region->left_region_id);
+        p_assert(left_region != nullptr, "left_region should not be null");
+        
+        // 更新原region的kv_num
+        left_region->kv_num -= s_req->num_result;
+    
+        p_info("send region to target, pinode: %llx, num_kv:%d, next_offset:%llu",
+                         pinode, s_req->num_result, next_offset);
+        // 发送rpc
+        s_req->region_id = region->region_id;
+        s_req->is_uncomplete = is_uncomplete;
+        s_req->pinode_hash = pinode_hash;
+        s_req->pinode = pinode;
+
+        // 先使用同步实现
+        bool complete_cb = false;
+        st_ctx->rpc->enqueue_request(st_ctx->s2s_session_num_vec[server_session_id],
+                                kSendRegionReq, &ST_CTX_RPC_WINDOW(msg_idx).req_msgbuf_,
+                                &ST_CTX_RPC_WINDOW(msg_idx).resp_msgbuf_, 
+                                set_complete_cb, reinterpret_cast<void*>(&complete_cb));
+        while(complete_cb == false) {
+            st_ctx->rpc->run_event_loop_once();
+        }
 
-                auto resp = &ST_RPC_RESP_BUF(msg_idx)->SendRegionResp;
-                assert(resp->resp_type == RespType::kSuccess);
+        auto resp = &ST_RPC_RESP_BUF(msg_idx)->SendRegionResp;
+        assert(resp->resp_type == RespType::kSuccess);
 
-                if(is_uncomplete == 0) {
-                    pinode_iter++;
-                    next_offset = 0;
+        if (is_uncomplete == 0) {
+            // 当前目录发送完毕, 转到下一个目录
+            next_offset = 0;
+            if (++pinode == 0) {
+                // 当前hash下的pinode已到最大值, 转到下一个hash
+                if (pinode_hash == end_pinode_hash) {
+                    break;
                 }
-            } else {
-                // p_info("continue readdir2");
-                pinode_iter++;
-                next_offset = 0;
-                // p_assert(false, "should not be here, status: %d", status);
+                pinode_hash++;
             }
         }
-        pinode = 0;
-        next_offset = 0;
     }
         
     p_info("333333333333");
@@ -768,13 +787,8 @@ void rpc_create_region_cb(void *_context, void *_idx) {
     assert(resp->resp_type == RespType::kSuccess);
     // 发送region
 
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        auto region_iter = s_ctx->region_map.find(resp->region_id);
-        p_assert(region_iter != s_ctx->region_map.end(), "region_iter should not be null");
-        region = region_iter->second;
-    }
+    ServerRegion *region = s_ctx->region_table.find(resp->region_id);
+    p_assert(region != nullptr, "region should not be null");
 
     rpc_send_region(region, msg_idx, region->start_key.hi);
 }
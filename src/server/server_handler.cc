@@ -25,24 +25,109 @@ rpc_resp_t convert_status_to_resptype(MetaKvStatus status) {
   return RespType::kFail;
 }
 
+// relatime: atime距今超过一天时也要更新
+static const time_t kRelatimeInterval = 24 * 60 * 60;
+
+// relatime/noatime下更新时间戳, 返回是否有变化
+static bool touch_relaxed(metafs_stat_t *st, time_t now, bool trunc) {
+    bool changed = false;
+    if(s_cfg->ts_policy == kTsRelatime && st->atime != now &&
+        (st->atime <= st->mtime || st->atime <= st->ctime || now - st->atime >= kRelatimeInterval)) {
+        st->atime = now;
+        changed = true;
+    }
+    if(st->mtime != now) {
+        st->mtime = now;
+        changed = true;
+    }
+    if(trunc && st->ctime != now) {
+        st->ctime = now;
+        changed = true;
+    }
+    return changed;
+}
+
+MetaKvStatus touch_stat_on_write_open(server_context *ctx, metafs_inode_t pinode, MetaKvSlice *fname_slice,
+                                      metafs_inode_t inode, MetaKvSlice *stat_slice, bool trunc) {
+    metafs_stat_t *st = (metafs_stat_t *)(stat_slice->data);
+    time_t now = CoarseClock::now();
+    MetaKvStatus status = OK;
+
+    switch(s_cfg->ts_policy) {
+        case kTsStrict:
+            st->mtime = now;
+            st->atime = now;
+            if(trunc) {
+                st->ctime = now;
+            }
+            status = UpdateStat(ctx->metadb, inode, stat_slice);
+            break;
+        case kTsLazytime: {
+            st->mtime = now;
+            st->atime = now;
+            if(trunc) {
+                st->ctime = now;
+            }
+            ctx->dirty_stats[inode] = DirtyTimes{st->mtime, st->ctime, st->atime};
+            // dirty表满时整批写回, 不逐个淘汰
+            if(ctx->dirty_stats.size() >= (size_t)s_cfg->lazytime_max_dirty) {
+                flush_dirty_stats(ctx);
+            }
+            break;
+        }
+        default: {
+            // relatime/noatime: 时间戳为秒级, 同一秒内的重复写打开不再写MetaDb
+            if(!touch_relaxed(st, now, trunc)) {
+                return OK;
+            }
+            status = UpdateStat(ctx->metadb, inode, stat_slice);
+            break;
+        }
+    }
+
+    if(ctx->inode_cache != nullptr && check_status_ok(status)) {
+        ctx->inode_cache->Put(pinode, fname_slice->data, inode, *st);
+    }
+    return status;
+}
+
+void flush_dirty_stats(server_context *ctx) {
+    if(ctx->dirty_stats.empty()) {
+        return;
+    }
+    metafs_stat_t stat;
+    MetaKvSlice stat_slice;
+    SliceInit(&stat_slice, metafs_stat_size, (char*)&stat);
+    for(auto &entry : ctx->dirty_stats) {
+        // 期间被删除的inode直接跳过
+        if(!check_status_ok(GetStat(ctx->metadb, entry.first, &stat_slice))) {
+            continue;
+        }
+        stat.mtime = entry.second.mtime;
+        stat.ctime = entry.second.ctime;
+        stat.atime = entry.second.atime;
+        MetaKvStatus status = UpdateStat(ctx->metadb, entry.first, &stat_slice);
+        if(unlikely(!check_status_ok(status))) {
+            p_info("flush dirty stat fail, inode: %lx, status: %d", entry.first, status);
+        }
+    }
+    ctx->dirty_stats.clear();
+}
+
 void fs_open_handler(erpc::ReqHandle *req_handle, void *_context) {
     server_context *ctx = static_cast<server_context *>(_context);
-    MetaDb *mdb = ctx->metadb;
 
     const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSOpenReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSOpenResp; 
     
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
 
-    if(!check_is_blong_to_region(region, c_req->pinode_hash)) {
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
         c_resp->resp_type = RespType::kUpdateRegionMap;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSOpenResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSOpenResp_size);
+        return;
     }
 
     if(check_region_status(region)) {
@@ -51,18 +136,12 @@ void fs_open_handler(erpc::ReqHandle *req_handle, void *_context) {
         SliceInit(&stat_slice, metafs_stat_size, (char*)&(c_resp->stat));
         MetaKvSlice fname_slice;
         SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
-        MetaKvStatus status = GetFileInode(mdb, c_req->pinode, &fname_slice, &inode);
+        c_resp->create_version = region->create_version;
+        MetaKvStatus status = lookup_dentry(ctx, c_req->pinode, &fname_slice, &inode, &stat_slice);
         if(likely(check_status_ok(status))) {
-            status = GetStat(mdb ,inode, &stat_slice);
-            if(likely(check_status_ok(status))) {
-                if ((c_req->mode&0b11) == O_WRONLY || (c_req->mode&0b11) == O_RDWR) {
-                    struct timeval tv; 
-                    gettimeofday(&tv, NULL);
-                    ((metafs_stat_t*)(stat_slice.data))->mtime = tv.tv_sec;
-                    ((metafs_stat_t*)(stat_slice.data))->atime = tv.tv_sec;
-                    status = UpdateStat(mdb, inode, &stat_slice);
-                }
-            } 
+            if ((c_req->mode&0b11) == O_WRONLY || (c_req->mode&0b11) == O_RDWR) {
+                status = touch_stat_on_write_open(ctx, c_req->pinode, &fname_slice, inode, &stat_slice, false);
+            }
             // p_info("status: %d oid: %ld\n", status, c_resp->stat.oid.lo);
         } else {
             // p_info("open error: pinode:%ld, fname:%s len:%ld\n",c_req->pinode, c_req->fname, strlen(c_req->fname));
@@ -74,28 +153,23 @@ void fs_open_handler(erpc::ReqHandle *req_handle, void *_context) {
         c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
                             RespType::kUpdateRegionMap : RespType::kEBUSY;
     }
-    ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSOpenResp_size);
-    ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+    enqueue_resp(ctx->rpc, req_handle, FSOpenResp_size);
 }
 
 void fs_mknod_handler(erpc::ReqHandle *req_handle, void *_context) {
     server_context *ctx = static_cast<server_context *>(_context);
-    MetaDb *mdb = ctx->metadb;
 
     const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSMknodReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSMknodResp; 
     
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
 
-    if(!check_is_blong_to_region(region, c_req->pinode_hash)) {
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
         c_resp->resp_type = RespType::kUpdateRegionMap;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSMknodResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSMknodResp_size);
+        return;
     }
 
     if(check_region_status(region)) {
@@ -107,14 +181,15 @@ void fs_mknod_handler(erpc::ReqHandle *req_handle, void *_context) {
 
         MetaKvSlice fname_slice;
         SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
-        MetaKvStatus status = InsertFileInode(mdb, c_req->pinode, &fname_slice, inode);
+        MetaKvStatus status = insert_dentry(ctx, c_req->pinode, &fname_slice, inode, &stat_slice);
         if (likely(check_status_ok(status))) {
-            status = InsertStat(mdb, inode, &stat_slice);
             c_resp->inode = inode;
             region->kv_num++;
+            region->create_version++;
         } else {
             // p_info("mknod error\n");
         }
+        c_resp->create_version = region->create_version;
 
         RegionStatus s1 = RegionStatus::Normal;
         RegionStatus s2 = RegionStatus::IsSplit;
@@ -135,34 +210,295 @@ void fs_mknod_handler(erpc::ReqHandle *req_handle, void *_context) {
         }
 
         c_resp->resp_type = convert_status_to_resptype(status);
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSMknodResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSMknodResp_size);
     } else {
         c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
                             RespType::kUpdateRegionMap : RespType::kEBUSY;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSMknodResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSMknodResp_size);
     }
 }
 
-void fs_stat_handler(erpc::ReqHandle *req_handle, void *_context) {
+// client在目录下异步创建文件前租用一段inode: 从本线程的inode空间中划出, inode高位的server_id/thread_id保证全局唯一
+// 之后client用batch mknod(prealloc)把创建写入该目录的region, 租用但没有用掉的inode不回收;
+// 租约记录在本线程的inode_grants中, batch mknod只接受租约内的inode
+void fs_alloc_inodes_handler(erpc::ReqHandle *req_handle, void *_context) {
+    server_context *ctx = static_cast<server_context *>(_context);
+
+    const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
+    auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSAllocInodesReq;
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSAllocInodesResp; 
+    
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
+
+    c_resp->count = 0;
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
+        c_resp->resp_type = RespType::kUpdateRegionMap;
+        enqueue_resp(ctx->rpc, req_handle, FSAllocInodesResp_size);
+        return;
+    }
+
+    // 分裂期间不授予新的create capability
+    if(!check_region_status(region) || region->region_status != RegionStatus::Normal) {
+        c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
+                            RespType::kUpdateRegionMap : RespType::kEBUSY;
+        enqueue_resp(ctx->rpc, req_handle, FSAllocInodesResp_size);
+        return;
+    }
+
+    if(s_cfg->create_cap_lease_ms <= 0) {
+        c_resp->resp_type = RespType::kFail;
+        enqueue_resp(ctx->rpc, req_handle, FSAllocInodesResp_size);
+        return;
+    }
+
+    uint64_t now = get_monotonic_us();
+    vector<InodeGrant> &grants = s_ctx->inode_grants[region->region_id];
+    grants.erase(std::remove_if(grants.begin(), grants.end(),
+                                [now](const InodeGrant &g) { return now >= g.expire_us; }), grants.end());
+
+    int32_t count = std::max(1, std::min(c_req->count, (int32_t)MAX_INODE_GRANT));
+    c_resp->start_inode = s_ctx->alloc_inode;
+    c_resp->count = count;
+    c_resp->lease_ms = s_cfg->create_cap_lease_ms;
+    s_ctx->alloc_inode += count;
+    grants.push_back(InodeGrant{c_req->pinode, c_resp->start_inode, c_resp->start_inode + count,
+                                now + (uint64_t)s_cfg->create_cap_lease_ms * 1000});
+    c_resp->resp_type = RespType::kSuccess;
+    enqueue_resp(ctx->rpc, req_handle, FSAllocInodesResp_size);
+}
+
+// open(O_CREAT): 在一次请求内打开已有文件或创建文件
+// region内的请求由同一个server线程串行处理, 查找和创建之间不会有其他请求插入
+void fs_open_create_handler(erpc::ReqHandle *req_handle, void *_context) {
     server_context *ctx = static_cast<server_context *>(_context);
     MetaDb *mdb = ctx->metadb;
 
+    const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
+    auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSOpenCreateReq;
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSOpenCreateResp; 
+    
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
+
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
+        c_resp->resp_type = RespType::kUpdateRegionMap;
+        enqueue_resp(ctx->rpc, req_handle, FSOpenCreateResp_size);
+        return;
+    }
+
+    if(!check_region_status(region)) {
+        c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
+                            RespType::kUpdateRegionMap : RespType::kEBUSY;
+        enqueue_resp(ctx->rpc, req_handle, FSOpenCreateResp_size);
+        return;
+    }
+
+    metafs_inode_t inode;
+    MetaKvSlice stat_slice;
+    SliceInit(&stat_slice, metafs_stat_size, (char*)&(c_resp->stat));
+    MetaKvSlice fname_slice;
+    SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
+    c_resp->created = 0;
+
+    MetaKvStatus status = GetFileInode(mdb, c_req->pinode, &fname_slice, &inode);
+    if(check_status_ok(status)) {
+        // 文件已存在
+        c_resp->create_version = region->create_version;
+        c_resp->inode = inode;
+        if(c_req->flags & O_EXCL) {
+            c_resp->resp_type = RespType::kEXIST;
+        } else if(is_directory(inode)) {
+            c_resp->resp_type = RespType::kEISDIR;
+        } else {
+            status = get_stat(ctx, inode, &stat_slice);
+            int accmode = c_req->flags & O_ACCMODE;
+            if(check_status_ok(status) && (accmode == O_WRONLY || accmode == O_RDWR)) {
+                // stat中没有size, O_TRUNC只需要更新ctime
+                status = touch_stat_on_write_open(ctx, c_req->pinode, &fname_slice, inode, &stat_slice,
+                                                  (c_req->flags & O_TRUNC) != 0);
+            }
+            c_resp->resp_type = convert_status_to_resptype(status);
+        }
+        enqueue_resp(ctx->rpc, req_handle, FSOpenCreateResp_size);
+        return;
+    }
+
+    // create new file, 同fs_mknod_handler
+    inode = s_ctx->alloc_inode++;
+    c_resp->stat = metafs_stat_t(c_req->oid, c_req->mode);
+    status = insert_dentry(ctx, c_req->pinode, &fname_slice, inode, &stat_slice);
+    if(likely(check_status_ok(status))) {
+        c_resp->inode = inode;
+        c_resp->created = 1;
+        region->kv_num++;
+        region->create_version++;
+
+        RegionStatus s1 = RegionStatus::Normal;
+        RegionStatus s2 = RegionStatus::IsSplit;
+        if (region->kv_num > region_split_threshold 
+            && region->region_status.compare_exchange_strong(s1, s2)) {
+            check_region_and_split(region);
+        }
+
+        if(region->region_status == RegionStatus::IsSplit || 
+            region->region_status == RegionStatus::SplitAlmostDone) {
+            log_op(region, false, c_req->pinode, c_req->fname, &c_resp->stat, inode);
+        }
+    }
+    c_resp->create_version = region->create_version;
+    c_resp->resp_type = convert_status_to_resptype(status);
+    enqueue_resp(ctx->rpc, req_handle, FSOpenCreateResp_size);
+}
+
+static inline bool check_inode_granted(const vector<InodeGrant> *grants, metafs_inode_t pinode,
+                                       metafs_inode_t inode, uint64_t now) {
+    if(grants == nullptr) {
+        return false;
+    }
+    for(const InodeGrant &g : *grants) {
+        if(g.pinode == pinode && inode >= g.start_inode && inode < g.end_inode && now < g.expire_us) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 同一目录下批量创建文件: 整批的inode一次分配, kv_num/create_version/split检查/log每批只处理一次
+void fs_batch_mknod_handler(erpc::ReqHandle *req_handle, void *_context) {
+    server_context *ctx = static_cast<server_context *>(_context);
+
+    const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
+    auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSBatchMknodReq;
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSBatchMknodResp; 
+    
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
+
+    c_resp->num_entries = 0;
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
+        c_resp->resp_type = RespType::kUpdateRegionMap;
+        enqueue_resp(ctx->rpc, req_handle, FSBatchMknodResp_hdr_size);
+        return;
+    }
+
+    if(!check_region_status(region)) {
+        c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
+                            RespType::kUpdateRegionMap : RespType::kEBUSY;
+        enqueue_resp(ctx->rpc, req_handle, FSBatchMknodResp_hdr_size);
+        return;
+    }
+
+    int32_t num_entries = c_req->num_entries;
+    if(unlikely(num_entries <= 0 || num_entries > MAX_BATCH_MKNOD_ENTRIES)) {
+        c_resp->resp_type = RespType::kFail;
+        enqueue_resp(ctx->rpc, req_handle, FSBatchMknodResp_hdr_size);
+        return;
+    }
+
+    // 创建失败的entry也占用一个inode号, 不回收; prealloc时使用client租用的inode
+    metafs_inode_t first_inode = 0;
+    const vector<InodeGrant> *grants = nullptr;
+    uint64_t now = 0;
+    if(!c_req->prealloc) {
+        first_inode = s_ctx->alloc_inode;
+        s_ctx->alloc_inode += num_entries;
+    } else {
+        auto iter = s_ctx->inode_grants.find(region->region_id);
+        if(iter != s_ctx->inode_grants.end()) {
+            grants = &iter->second;
+        }
+        now = get_monotonic_us();
+    }
+
+    // 创建成功的entry, 分裂期间需要写log
+    const char *created_fnames[MAX_BATCH_MKNOD_ENTRIES];
+    metafs_stat_t created_stats[MAX_BATCH_MKNOD_ENTRIES];
+    metafs_inode_t created_inodes[MAX_BATCH_MKNOD_ENTRIES];
+    int32_t num_created = 0;
+
+    const char *entry = (const char *)c_req->entries;
+    for(int32_t i = 0; i < num_entries; i++) {
+        mode_t mode;
+        memcpy(&mode, entry, sizeof(mode_t));
+        entry += sizeof(mode_t);
+        metafs_inode_t inode = first_inode + i;
+        if(c_req->prealloc) {
+            memcpy(&inode, entry, metafs_inode_size);
+            entry += metafs_inode_size;
+        }
+        const char *fname = entry;
+        size_t fname_len = strlen(fname) + 1;
+        entry = fname + fname_len;
+
+        // 只接受本region上该目录尚未到期的租约内的inode
+        if(c_req->prealloc && !check_inode_granted(grants, c_req->pinode, inode, now)) {
+            c_resp->entries[i].resp_type = RespType::kFail;
+            c_resp->entries[i].inode = inode;
+            continue;
+        }
+
+        // 租用的inode都是普通文件的inode
+        if(unlikely(inode == 0 || is_directory(inode))) {
+            c_resp->entries[i].resp_type = RespType::kFail;
+            c_resp->entries[i].inode = inode;
+            continue;
+        }
+
+        metafs_stat_t &stat = created_stats[num_created];
+        stat = metafs_stat_t(mode);
+        MetaKvSlice stat_slice;
+        SliceInit(&stat_slice, metafs_stat_size, (char*)&stat);
+
+        MetaKvSlice fname_slice;
+        SliceInit(&fname_slice, fname_len, (char*)fname);
+        MetaKvStatus status = insert_dentry(ctx, c_req->pinode, &fname_slice, inode, &stat_slice);
+        if(likely(check_status_ok(status))) {
+            created_fnames[num_created] = fname;
+            created_inodes[num_created] = inode;
+            num_created++;
+        }
+        c_resp->entries[i].resp_type = convert_status_to_resptype(status);
+        c_resp->entries[i].inode = inode;
+    }
+
+    if(num_created > 0) {
+        region->kv_num += num_created;
+        region->create_version++;
+    }
+    c_resp->create_version = region->create_version;
+
+    RegionStatus s1 = RegionStatus::Normal;
+    RegionStatus s2 = RegionStatus::IsSplit;
+    if (region->kv_num > region_split_threshold 
+        && region->region_status.compare_exchange_strong(s1, s2)) {
+        check_region_and_split(region);
+    }
+
+    if(num_created > 0 && (region->region_status == RegionStatus::IsSplit || 
+        region->region_status == RegionStatus::SplitAlmostDone)) {
+        log_put_ops(region, c_req->pinode, num_created, created_fnames, created_stats, created_inodes);
+    }
+
+    c_resp->resp_type = RespType::kSuccess;
+    c_resp->num_entries = num_entries;
+    enqueue_resp(ctx->rpc, req_handle, FSBatchMknodResp_hdr_size + num_entries * sizeof(c_resp->entries[0]));
+}
+
+void fs_stat_handler(erpc::ReqHandle *req_handle, void *_context) {
+    server_context *ctx = static_cast<server_context *>(_context);
+
     const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSStatReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSStatResp; 
     
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
 
-    if(!check_is_blong_to_region(region, c_req->pinode_hash)) {
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
         c_resp->resp_type = RespType::kUpdateRegionMap;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSStatResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSStatResp_size);
+        return;
     }
 
     if(check_region_status(region)) {
@@ -172,38 +508,31 @@ void fs_stat_handler(erpc::ReqHandle *req_handle, void *_context) {
 
         MetaKvSlice fname_slice;
         SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
-        MetaKvStatus status = GetFileInode(mdb, c_req->pinode, &fname_slice, &inode);
-        if (likely(check_status_ok(status))) {
-            status = GetStat(mdb, inode, &stat_slice);
-            c_resp->inode = inode;
-        } 
+        c_resp->create_version = region->create_version;
+        MetaKvStatus status = lookup_dentry(ctx, c_req->pinode, &fname_slice, &inode, &stat_slice);
+        c_resp->inode = inode;
         c_resp->resp_type = convert_status_to_resptype(status);
     } else {
         c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
                             RespType::kUpdateRegionMap : RespType::kEBUSY; 
     }  
-    ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSStatResp_size);
-    ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+    enqueue_resp(ctx->rpc, req_handle, FSStatResp_size);
 }
 
 void fs_unlink_handler(erpc::ReqHandle *req_handle, void *_context) {
     server_context *ctx = static_cast<server_context *>(_context);
-    MetaDb *mdb = ctx->metadb;
 
     const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSUnlinkReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSUnlinkResp; 
     
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
 
-    if(!check_is_blong_to_region(region, c_req->pinode_hash)) {
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
         c_resp->resp_type = RespType::kUpdateRegionMap;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSUnlinkResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSUnlinkResp_size);
+        return;
     }
 
     if(check_region_status(region)) {
@@ -211,9 +540,8 @@ void fs_unlink_handler(erpc::ReqHandle *req_handle, void *_context) {
         MetaKvSlice fname_slice;
         SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
 
-        MetaKvStatus status = DeleteFileInode(mdb, c_req->pinode, &fname_slice, &inode);
+        MetaKvStatus status = remove_dentry(ctx, c_req->pinode, &fname_slice, &inode);
         if (likely(check_status_ok(status))) {
-            status = DeleteStat(mdb, inode);
             region->kv_num--;
         } else {
             // p_info("unlink error\n");
@@ -229,29 +557,24 @@ void fs_unlink_handler(erpc::ReqHandle *req_handle, void *_context) {
         c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
                             RespType::kUpdateRegionMap : RespType::kEBUSY; 
     }
-    ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSUnlinkResp_size);
-    ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+    enqueue_resp(ctx->rpc, req_handle, FSUnlinkResp_size);
 }
 
 // mkdir时需要将目录号插入pinode_table, 方便之后region_split, TODO: 根目录需要处理？
 void fs_mkdir_handler(erpc::ReqHandle *req_handle, void *_context) {
     server_context *ctx = static_cast<server_context *>(_context);
-    MetaDb *mdb = ctx->metadb;
 
     const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSMkdirReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSMkdirResp; 
     
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
 
-    if(!check_is_blong_to_region(region, c_req->pinode_hash)) {
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
         c_resp->resp_type = RespType::kUpdateRegionMap;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSMkdirResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSMkdirResp_size);
+        return;
     }
 
     if(check_region_status(region)) {
@@ -265,20 +588,18 @@ void fs_mkdir_handler(erpc::ReqHandle *req_handle, void *_context) {
 
         MetaKvSlice fname_slice;
         SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
-        MetaKvStatus status = InsertFileInode(mdb, c_req->pinode, &fname_slice, inode);
+        MetaKvStatus status = insert_dentry(ctx, c_req->pinode, &fname_slice, inode, &stat_slice);
         if (likely(check_status_ok(status))) {
-            status = InsertStat(mdb, inode, &stat_slice);
             region->kv_num++;
+            region->create_version++;
             
             // char *tmp;
             // MetaKvStatus status = ReadDir(mdb, inode, &tmp, 0, MSG_ENTEY_MAX_SIZE);
             // p_assert(status == OK, "not exist dir");
 
-            if (region->region_status == RegionStatus::Normal
-                 || region->region_status == RegionStatus::ToBeSplit) {
-                WriteGuard wl(s_ctx->pinode_table_lock);
-                s_ctx->pinode_table[XXH3_64bits(&inode, metafs_inode_size) % PINODE_HASH_RANGE].insert(inode);
-            }
+            // pinode_table分片加锁, 不再阻塞迁移扫描; 迁移期间新建的目录若落在迁出的region内,
+            // 由迁移扫描或日志回放交给目标server, 迁移完成后从本线程的pinode_table中删除
+            s_ctx->pinode_table.insert(get_pinode_hash(inode), inode);
             
             c_resp->inode = inode;
 
@@ -309,6 +630,8 @@ void fs_mkdir_handler(erpc::ReqHandle *req_handle, void *_context) {
             // }
         }
 
+        c_resp->create_version = region->create_version;
+
         RegionStatus s1 = RegionStatus::Normal;
         RegionStatus s2 = RegionStatus::IsSplit;
         if (region->kv_num > region_split_threshold 
@@ -328,74 +651,269 @@ void fs_mkdir_handler(erpc::ReqHandle *req_handle, void *_context) {
         } 
 
         c_resp->resp_type = convert_status_to_resptype(status);
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSMkdirResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_); 
+        enqueue_resp(ctx->rpc, req_handle, FSMkdirResp_size);
     } else {
         c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
                             RespType::kUpdateRegionMap : RespType::kEBUSY; 
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSMkdirResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSMkdirResp_size);
+    }
+    
+}
+
+// 在worker线程扫描目录, 结果直接写入c_resp
+static void readdir_work(BgTask *task) {
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(task->req_handle->pre_resp_msgbuf_.buf_)->FSReaddirResp; 
+    char* res = NULL;
+
+    // metakv readdir 返回的buf的格式: 0: next_offset, 1: is_uncomplete, 2: num_result, 3: entries_len
+    MetaKvStatus status = ReadDir(task->ctx->metadb, task->inode, &res, task->offset, MSG_ENTEY_MAX_SIZE);
+    if (likely(check_status_ok(status))) {
+        int64_t* entry_mdata = (int64_t*)res;
+        c_resp->next_offset = entry_mdata[0];
+        c_resp->is_uncomplete = entry_mdata[1];
+        c_resp->num_result = entry_mdata[2];
+        c_resp->entries_len = entry_mdata[3] - 4 * sizeof(int64_t);
+        // // p_info("rel_count:%ld\n", resp->num_result);
+        assert(entry_mdata[2] <= MSG_ENTEY_MAX_SIZE);
+        memcpy(&c_resp->entries, res + 4 * sizeof(int64_t), c_resp->entries_len);
+        free(res);
+    } else {
+        // p_info("readdir error, dir_inode:%ld, offset:%ld, %p\n",c_req->inode&kPrefixMask, c_req->offset, res);
+    }
+
+    if (res == NULL) {
+        c_resp->num_result = 0;
+        status = OK;
+        // p_info("read empty directory\n");
     }
     
+    c_resp->resp_type = convert_status_to_resptype(status);
+}
+
+static void readdir_done(BgTask *task) {
+    enqueue_resp(task->ctx->rpc, task->req_handle, FSReaddirResp_size);
 }
 
+// 扫描目录交给后台worker, 大目录的分页读取不阻塞本线程上的其他请求
 void fs_readdir_handler(erpc::ReqHandle *req_handle, void *_context) {
     server_context *ctx = static_cast<server_context *>(_context);
-    MetaDb *mdb = ctx->metadb;
 
     const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSReaddirReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSReaddirResp; 
     
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
 
-    if(!check_is_blong_to_region(region, c_req->inode_hash)) {
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->inode_hash)) {
         c_resp->resp_type = RespType::kUpdateRegionMap;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSReaddirResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSReaddirResp_size);
+        return;
     }
 
     if(check_region_status(region)) {
-        char* res = NULL;
-        metafs_inode_t inode;
+        BgTask *task = new BgTask();
+        task->ctx = ctx;
+        task->req_handle = req_handle;
+        task->work = readdir_work;
+        task->done = readdir_done;
+        task->inode = c_req->inode;
+        task->offset = c_req->offset;
+        submit_bg_task(task);
+    } else {
+        c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
+                            RespType::kUpdateRegionMap : RespType::kEBUSY; 
+        enqueue_resp(ctx->rpc, req_handle, FSReaddirResp_size);
+    }
+}
 
-        // metakv readdir 返回的buf的格式: 0: next_offset, 1: is_uncomplete, 2: num_result, 3: entries_len
-        MetaKvStatus status = ReadDir(mdb, c_req->inode, &res, c_req->offset, MSG_ENTEY_MAX_SIZE);
-        if (likely(check_status_ok(status))) {
-            int64_t* entry_mdata = (int64_t*)res;
-            c_resp->next_offset = entry_mdata[0];
-            c_resp->is_uncomplete = entry_mdata[1];
-            c_resp->num_result = entry_mdata[2];
-            c_resp->entries_len = entry_mdata[3] - 4 * sizeof(int64_t);
-            // // p_info("rel_count:%ld\n", resp->num_result);
-            assert(entry_mdata[2] <= MSG_ENTEY_MAX_SIZE);
-            memcpy(&c_resp->entries, res + 4 * sizeof(int64_t), c_resp->entries_len);
-            free(res);
-        } else {
-            // p_info("readdir error, dir_inode:%ld, offset:%ld, %p\n",c_req->inode&kPrefixMask, c_req->offset, res);
+// metakv的entry最短为pinode(8B)+fname(至少1B+'\0')+inode(8B), readdirplus去掉pinode后每条entry多出stat,
+// 限制每次ReadDir读取的长度, 保证加上stat后不超过MSG_ENTEY_MAX_SIZE
+static const int64_t kMinDirEntrySize = 2 * metafs_inode_size + 2;
+static const int64_t kReaddirPlusReadSize = MSG_ENTEY_MAX_SIZE * kMinDirEntrySize / 
+                                            (kMinDirEntrySize - metafs_inode_size + metafs_stat_size);
+
+// 在worker线程扫描目录并读取每个entry的stat, 时间戳在readdir_plus_done中叠加
+static void readdir_plus_work(BgTask *task) {
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(task->req_handle->pre_resp_msgbuf_.buf_)->FSReaddirResp; 
+    MetaDb *mdb = task->ctx->metadb;
+
+    char* res = NULL;
+    c_resp->num_result = 0;
+    c_resp->entries_len = 0;
+    c_resp->is_uncomplete = 0;
+    // metakv readdir 返回的buf的格式: 0: next_offset, 1: is_uncomplete, 2: num_result, 3: entries_len
+    MetaKvStatus status = ReadDir(mdb, task->inode, &res, task->offset, kReaddirPlusReadSize);
+    if (likely(check_status_ok(status)) && res != NULL) {
+        int64_t* entry_mdata = (int64_t*)res;
+        c_resp->next_offset = entry_mdata[0];
+        c_resp->is_uncomplete = entry_mdata[1];
+        c_resp->num_result = entry_mdata[2];
+
+        // pinode + fname + inode -> fname + inode + stat
+        const char *src = res + 4 * sizeof(int64_t);
+        char *dst = (char *)c_resp->entries;
+        for(int32_t i = 0; i < c_resp->num_result; i++) {
+            src += metafs_inode_size;
+            size_t fname_len = strlen(src) + 1;
+            memcpy(dst, src, fname_len + metafs_inode_size);
+            metafs_inode_t inode;
+            memcpy(&inode, src + fname_len, metafs_inode_size);
+            src += fname_len + metafs_inode_size;
+            dst += fname_len + metafs_inode_size;
+
+            MetaKvSlice stat_slice;
+            SliceInit(&stat_slice, metafs_stat_size, dst);
+            if(!check_status_ok(GetStat(mdb, inode, &stat_slice))) {
+                ((metafs_stat_t *)dst)->mode = 0;
+            }
+            dst += metafs_stat_size;
         }
+        c_resp->entries_len = dst - (char *)c_resp->entries;
+        p_assert(c_resp->entries_len <= MSG_ENTEY_MAX_SIZE, "readdirplus entries overflow");
+        free(res);
+    } else if (res == NULL) {
+        // read empty directory
+        status = OK;
+    }
 
-        if (res == NULL) {
-            c_resp->num_result = 0;
-            status = OK;
-            // p_info("read empty directory\n");
+    c_resp->resp_type = convert_status_to_resptype(status);
+}
+
+// 回到前台线程后叠加lazytime下尚未写回的时间戳, dirty_stats只能由本线程访问
+static void readdir_plus_done(BgTask *task) {
+    server_context *ctx = task->ctx;
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(task->req_handle->pre_resp_msgbuf_.buf_)->FSReaddirResp; 
+    if(unlikely(!ctx->dirty_stats.empty())) {
+        char *entry = (char *)c_resp->entries;
+        for(int32_t i = 0; i < c_resp->num_result; i++) {
+            entry += strlen(entry) + 1;
+            metafs_inode_t inode;
+            memcpy(&inode, entry, metafs_inode_size);
+            entry += metafs_inode_size;
+            metafs_stat_t *st = (metafs_stat_t *)entry;
+            if(st->mode != 0) {
+                overlay_dirty_times(ctx, inode, st);
+            }
+            entry += metafs_stat_size;
         }
-        
-        c_resp->resp_type = convert_status_to_resptype(status);
+    }
+    enqueue_resp(ctx->rpc, task->req_handle, FSReaddirResp_size);
+}
+
+// 与fs_readdir_handler相同, 但每个entry附带其stat, 目录下文件的stat与dentry存储在同一个MetaDb中
+void fs_readdir_plus_handler(erpc::ReqHandle *req_handle, void *_context) {
+    server_context *ctx = static_cast<server_context *>(_context);
+
+    const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
+    auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSReaddirReq;
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSReaddirResp; 
+    
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
+
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->inode_hash)) {
+        c_resp->resp_type = RespType::kUpdateRegionMap;
+        enqueue_resp(ctx->rpc, req_handle, FSReaddirResp_size);
+        return;
+    }
+
+    if(!check_region_status(region)) {
+        c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
+                            RespType::kUpdateRegionMap : RespType::kEBUSY; 
+        enqueue_resp(ctx->rpc, req_handle, FSReaddirResp_size);
+        return;
+    }
+
+    BgTask *task = new BgTask();
+    task->ctx = ctx;
+    task->req_handle = req_handle;
+    task->work = readdir_plus_work;
+    task->done = readdir_plus_done;
+    task->inode = c_req->inode;
+    task->offset = c_req->offset;
+    submit_bg_task(task);
+}
+
+// 在本线程的region中查找pinode_hash所属且可以服务的region, 没有时返回nullptr
+// 先检查调用者当前所在的region(相邻路径分量常落在同一region), 不在其中时再遍历本线程的region(每个线程只有几个)
+// 调用者需要在EpochGuard内
+static ServerRegion *find_local_region(uint64_t pinode_hash, ServerRegion *cur_region) {
+    if(cur_region != nullptr && check_is_blong_to_region(cur_region, pinode_hash)) {
+        return check_region_status(cur_region) ? cur_region : nullptr;
+    }
+    for(auto &iter : s_ctx->region_table.snapshot()->regions) {
+        ServerRegion *region = iter.second;
+        if(check_is_blong_to_region(region, pinode_hash)) {
+            return check_region_status(region) ? region : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+// 在worker线程检查待删除的目录是否为空
+static void rmdir_check_work(BgTask *task) {
+    char* res = NULL;
+    // metakv readdir 返回的buf的格式: 0: next_offset, 1: is_uncomplete, 2: num_result, 3: entries_len
+    task->status = ReadDir(task->ctx->metadb, task->inode, &res, 0, 256);
+    if (res == NULL) {
+        task->status = OK;
+        task->has_entries = false;
     } else {
+        task->has_entries = (((uint64_t*)res)[2] != 0);
+        free(res);
+    }
+}
+
+// 回到前台线程删除目录; 检查期间region可能开始分裂, 重新检查region
+static void rmdir_done(BgTask *task) {
+    server_context *ctx = task->ctx;
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(task->req_handle->pre_resp_msgbuf_.buf_)->FSRmdirResp; 
+
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(task->region_id);
+
+    if(region == nullptr || !check_is_blong_to_region(region, task->pinode_hash)) {
+        c_resp->resp_type = RespType::kUpdateRegionMap;
+    } else if(!check_region_status(region)) {
         c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
                             RespType::kUpdateRegionMap : RespType::kEBUSY; 
+    } else {
+        // 检查期间本线程可能已在该目录下创建了文件, 子目录region的create_version变化时重新检查一次
+        if(task->child_region_local) {
+            ServerRegion *child_region = s_ctx->region_table.find(task->child_region_id);
+            if(child_region == nullptr || child_region->create_version != task->child_create_version) {
+                rmdir_check_work(task);
+            }
+        }
+
+        MetaKvStatus status = task->status;
+        if(unlikely(!check_status_ok(status))) {
+            c_resp->resp_type = convert_status_to_resptype(status);
+        } else if(task->has_entries) {
+            c_resp->resp_type = RespType::kENOTEMPTY;
+        } else {
+            MetaKvSlice fname_slice;
+            SliceInit(&fname_slice, strlen(task->fname) + 1, task->fname);
+            metafs_inode_t inode;
+            status = remove_dentry(ctx, task->pinode, &fname_slice, &inode);
+            if(likely(check_status_ok(status))) {
+                region->kv_num--;
+                s_ctx->pinode_table.erase(get_pinode_hash(task->inode), task->inode);
+
+                if(region->region_status == RegionStatus::IsSplit || 
+                    region->region_status == RegionStatus::SplitAlmostDone) {
+                    log_op(region, true, task->pinode, task->fname);
+                }
+            }
+            c_resp->resp_type = convert_status_to_resptype(status);
+        }
     }
-    
-    ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSReaddirResp_size);
-    ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+
+    enqueue_resp(ctx->rpc, task->req_handle, FSRmdirResp_size);
 }
 
-// 删除目录时，暂时不清除pinode_table对应的pinode
+// 删除目录时同时从pinode_table中删除该目录; 目录是否为空的检查交给后台worker
 void fs_rmdir_handler(erpc::ReqHandle *req_handle, void *_context) {
     server_context *ctx = static_cast<server_context *>(_context);
     MetaDb *mdb = ctx->metadb;
@@ -404,69 +922,50 @@ void fs_rmdir_handler(erpc::ReqHandle *req_handle, void *_context) {
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSRmdirReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSRmdirResp; 
     
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
 
-    if(!check_is_blong_to_region(region, c_req->pinode_hash)) {
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
         c_resp->resp_type = RespType::kUpdateRegionMap;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSRmdirResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSRmdirResp_size);
+        return;
     }
 
     if(check_region_status(region)) {
         metafs_inode_t inode;
         MetaKvSlice fname_slice;
         SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
-        // TODO: check directory has entry
         MetaKvStatus status = GetFileInode(mdb, c_req->pinode, &fname_slice, &inode);
 
-        if (likely(is_directory(inode))) {
-            if (likely(check_status_ok(status))) {
-                char* res = NULL;
-                bool has_files;
-                // p_info("rmdir, inode: %llx", inode);
-                // metakv readdir 返回的buf的格式: 0: next_offset, 1: is_uncomplete, 2: num_result, 3: entries_len
-                status = ReadDir(mdb, inode, &res, 0, 256);
-                if (res == NULL) {
-                    status = OK;
-                    has_files = false;
-                } else {
-                    has_files = (((uint64_t*)res)[2] == 0);
-                    free(res);
-                }
-
-                if (likely(check_status_ok(status)) && !has_files) {
-                    status = DeleteFileInode(mdb, c_req->pinode, &fname_slice, &inode);
-                    if (likely(check_status_ok(status))) {
-                        status = DeleteStat(mdb, inode);
-                    }
-                    region->kv_num--;
-
-                    if(region->region_status == RegionStatus::IsSplit || 
-                        region->region_status == RegionStatus::SplitAlmostDone) {
-                        log_op(region, true, c_req->pinode, c_req->fname);
-                    }
-                } else {
-                    // p_info("can not rmdir, has file in this directoty %ld, %s\n", c_req->pinode&kPrefixMask, c_req->fname);
-                }
-            } else {
-                // p_info("rmdir error\n");
+        if (likely(check_status_ok(status) && is_directory(inode))) {
+            BgTask *task = new BgTask();
+            task->ctx = ctx;
+            task->req_handle = req_handle;
+            task->work = rmdir_check_work;
+            task->done = rmdir_done;
+            task->region_id = c_req->region_id;
+            task->pinode = c_req->pinode;
+            task->pinode_hash = c_req->pinode_hash;
+            task->inode = inode;
+            memcpy(task->fname, c_req->fname, strlen(c_req->fname) + 1);
+            // 目录下的文件由hash(inode)所属的region创建, 该region在本线程时记录其create_version
+            ServerRegion *child_region = find_local_region(get_pinode_hash(inode), region);
+            task->child_region_local = child_region != nullptr;
+            if(child_region != nullptr) {
+                task->child_region_id = child_region->region_id;
+                task->child_create_version = child_region->create_version;
             }
-        } else {
-            status = KEY_NOT_EXIST;
+            submit_bg_task(task);
+            return;
         }
 
-        c_resp->resp_type = convert_status_to_resptype(status);
+        c_resp->resp_type = convert_status_to_resptype(check_status_ok(status) ? KEY_NOT_EXIST : status);
     } else {
         c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
                             RespType::kUpdateRegionMap : RespType::kEBUSY; 
     }
     
-    ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSRmdirResp_size);
-    ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+    enqueue_resp(ctx->rpc, req_handle, FSRmdirResp_size);
 }
 
 void fs_getinode_handler(erpc::ReqHandle *req_handle, void *_context) {
@@ -477,16 +976,13 @@ void fs_getinode_handler(erpc::ReqHandle *req_handle, void *_context) {
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSGetinodeReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSGetinodeResp; 
     
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
 
-    if(!check_is_blong_to_region(region, c_req->pinode_hash)) {
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
         c_resp->resp_type = RespType::kUpdateRegionMap;
-        ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSGetinodeResp_size);
-        ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+        enqueue_resp(ctx->rpc, req_handle, FSGetinodeResp_size);
+        return;
     }
 
     if(check_region_status(region)) {
@@ -494,6 +990,7 @@ void fs_getinode_handler(erpc::ReqHandle *req_handle, void *_context) {
         MetaKvSlice fname_slice;
         SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
 
+        c_resp->create_version = region->create_version;
         MetaKvStatus status = GetFileInode(mdb, c_req->pinode, &fname_slice, &inode);
         if (likely(check_status_ok(status))) {
             c_resp->inode = inode;
@@ -506,8 +1003,162 @@ void fs_getinode_handler(erpc::ReqHandle *req_handle, void *_context) {
         c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
                             RespType::kUpdateRegionMap : RespType::kEBUSY; 
     }
-    ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, FSGetinodeResp_size);
-    ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+    enqueue_resp(ctx->rpc, req_handle, FSGetinodeResp_size);
+}
+
+// 从pinode开始依次解析多个路径分量, 直到下一个分量的父目录不属于本线程的region
+// 返回已解析的inode, client从第一个未解析的分量起向其父目录所属的region继续解析
+void fs_resolve_path_handler(erpc::ReqHandle *req_handle, void *_context) {
+    server_context *ctx = static_cast<server_context *>(_context);
+    MetaDb *mdb = ctx->metadb;
+
+    const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
+    auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSResolvePathReq;
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSResolvePathResp; 
+    
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
+
+    c_resp->num_resolved = 0;
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
+        c_resp->resp_type = RespType::kUpdateRegionMap;
+        enqueue_resp(ctx->rpc, req_handle, FSResolvePathResp_hdr_size);
+        return;
+    }
+
+    if(!check_region_status(region)) {
+        c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
+                            RespType::kUpdateRegionMap : RespType::kEBUSY;
+        enqueue_resp(ctx->rpc, req_handle, FSResolvePathResp_hdr_size);
+        return;
+    }
+
+    if(unlikely(c_req->num_components <= 0 || c_req->num_components > MAX_RESOLVE_PATH_COMPONENTS)) {
+        c_resp->resp_type = RespType::kFail;
+        enqueue_resp(ctx->rpc, req_handle, FSResolvePathResp_hdr_size);
+        return;
+    }
+
+    metafs_inode_t pinode = c_req->pinode;
+    const char *fname = c_req->components;
+    rpc_resp_t res = RespType::kSuccess;
+    for(int32_t i = 0; i < c_req->num_components; i++) {
+        if(i > 0) {
+            region = find_local_region(get_pinode_hash(pinode), region);
+            if(region == nullptr) {
+                break;
+            }
+        }
+
+        size_t fname_len = strlen(fname) + 1;
+        MetaKvSlice fname_slice;
+        SliceInit(&fname_slice, fname_len, (char*)fname);
+        c_resp->last_region_id = region->region_id;
+        c_resp->create_version = region->create_version;
+        metafs_inode_t inode;
+        MetaKvStatus status = GetFileInode(mdb, pinode, &fname_slice, &inode);
+        if(unlikely(!check_status_ok(status))) {
+            res = convert_status_to_resptype(status);
+            break;
+        }
+
+        c_resp->inodes[c_resp->num_resolved++] = inode;
+        pinode = inode;
+        fname += fname_len;
+    }
+
+    c_resp->resp_type = res;
+    enqueue_resp(ctx->rpc, req_handle, FSResolvePathResp_hdr_size + c_resp->num_resolved * sizeof(metafs_inode_t));
+}
+
+// 在worker线程读取opendir响应中的第一页, 读取失败时不附带, 由client另外readdir
+static void opendir_page_work(BgTask *task) {
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(task->req_handle->pre_resp_msgbuf_.buf_)->FSOpendirResp; 
+    char* res = NULL;
+    c_resp->num_result = 0;
+    c_resp->is_uncomplete = 0;
+    // metakv readdir 返回的buf的格式: 0: next_offset, 1: is_uncomplete, 2: num_result, 3: entries_len
+    MetaKvStatus status = ReadDir(task->ctx->metadb, task->inode, &res, 0, OPENDIR_ENTRY_MAX_SIZE);
+    if(likely(check_status_ok(status)) && res != NULL) {
+        int64_t* entry_mdata = (int64_t*)res;
+        c_resp->next_offset = entry_mdata[0];
+        c_resp->is_uncomplete = entry_mdata[1];
+        c_resp->num_result = entry_mdata[2];
+        c_resp->entries_len = entry_mdata[3] - 4 * sizeof(int64_t);
+        p_assert(c_resp->entries_len <= OPENDIR_ENTRY_MAX_SIZE, "opendir entries overflow");
+        memcpy(&c_resp->entries, res + 4 * sizeof(int64_t), c_resp->entries_len);
+        c_resp->page_included = 1;
+        free(res);
+    } else if(res == NULL) {
+        // read empty directory
+        c_resp->page_included = 1;
+    }
+}
+
+static void opendir_page_done(BgTask *task) {
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(task->req_handle->pre_resp_msgbuf_.buf_)->FSOpendirResp; 
+    enqueue_resp(task->ctx->rpc, task->req_handle, FSOpendirResp_hdr_size + c_resp->entries_len);
+}
+
+// 查找目录的inode和stat; 目录的entry也在本线程的region中时由后台worker一并读取第一页, 省去一次readdir往返
+// 目录的entry不在本线程的region中时只返回inode和stat, client再向目录所属的region读取第一页
+void fs_opendir_handler(erpc::ReqHandle *req_handle, void *_context) {
+    server_context *ctx = static_cast<server_context *>(_context);
+
+    const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
+    auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->FSOpendirReq;
+    auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->FSOpendirResp; 
+    
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
+
+    c_resp->page_included = 0;
+    c_resp->entries_len = 0;
+    if(region == nullptr || !check_is_blong_to_region(region, c_req->pinode_hash)) {
+        c_resp->resp_type = RespType::kUpdateRegionMap;
+        enqueue_resp(ctx->rpc, req_handle, FSOpendirResp_hdr_size);
+        return;
+    }
+
+    if(!check_region_status(region)) {
+        c_resp->resp_type = region->region_status == RegionStatus::SplitAlmostDone ? 
+                            RespType::kUpdateRegionMap : RespType::kEBUSY;
+        enqueue_resp(ctx->rpc, req_handle, FSOpendirResp_hdr_size);
+        return;
+    }
+
+    metafs_inode_t inode;
+    MetaKvSlice stat_slice;
+    SliceInit(&stat_slice, metafs_stat_size, (char*)&(c_resp->stat));
+    MetaKvSlice fname_slice;
+    SliceInit(&fname_slice, strlen(c_req->fname) + 1, (char*)&(c_req->fname));
+    c_resp->create_version = region->create_version;
+    MetaKvStatus status = lookup_dentry(ctx, c_req->pinode, &fname_slice, &inode, &stat_slice);
+    if(unlikely(!check_status_ok(status))) {
+        c_resp->resp_type = convert_status_to_resptype(status);
+        enqueue_resp(ctx->rpc, req_handle, FSOpendirResp_hdr_size);
+        return;
+    }
+    c_resp->inode = inode;
+    if(!is_directory(inode)) {
+        c_resp->resp_type = RespType::kENOTDIR;
+        enqueue_resp(ctx->rpc, req_handle, FSOpendirResp_hdr_size);
+        return;
+    }
+
+    c_resp->resp_type = RespType::kSuccess;
+    if(find_local_region(get_pinode_hash(inode), region) != nullptr) {
+        BgTask *task = new BgTask();
+        task->ctx = ctx;
+        task->req_handle = req_handle;
+        task->work = opendir_page_work;
+        task->done = opendir_page_done;
+        task->inode = inode;
+        submit_bg_task(task);
+        return;
+    }
+
+    enqueue_resp(ctx->rpc, req_handle, FSOpendirResp_hdr_size);
 }
 
 void read_region_map_handler(erpc::ReqHandle *req_handle, void *_context) {
@@ -517,16 +1168,26 @@ void read_region_map_handler(erpc::ReqHandle *req_handle, void *_context) {
     auto c_req = &reinterpret_cast<wire_req_t *>(req_msgbuf->buf_)->ReadRegionmapReq;
     auto c_resp = &reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->ReadRegionmapResp; 
 
-    p_info("client#%d read region map", c_req->client_id);
+    p_info("client#%d read region map, since epoch:%lu, start region#%d", c_req->client_id, c_req->since_epoch, c_req->start_region_id);
 
+    const int32_t max_entries = sizeof(c_resp->entries) / sizeof(ClientRegion);
+    int32_t i = 0;
     ReadGuard region_rl(global_region_map_rwlock);
-    int i = 0;
-    for(auto iter = global_region_map.begin(); iter != global_region_map.end(); iter++) {
-        c_resp->entries[i++] = iter->second;
+    // epoch在写锁内修改, 读锁内读取的epoch与本次返回的region一致
+    uint64_t map_epoch = global_region_epoch.load();
+    auto iter = global_region_map.lower_bound(c_req->start_region_id);
+    for(; iter != global_region_map.end() && i < max_entries; iter++) {
+        // 只返回client上次同步之后修改过的region
+        if(iter->second.epoch > c_req->since_epoch) {
+            c_resp->entries[i++] = iter->second;
+        }
     }
 
     c_resp->resp_type = RespType::kSuccess;
     c_resp->num_entries = i;
+    c_resp->is_uncomplete = iter != global_region_map.end();
+    c_resp->next_region_id = c_resp->is_uncomplete ? iter->first : 0;
+    reinterpret_cast<wire_resp_t *>(req_handle->pre_resp_msgbuf_.buf_)->map_epoch = map_epoch;
     ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, offsetof(wire_resp_t, ReadRegionmapResp.entries) + i * sizeof(ClientRegion));
     ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
 }
@@ -539,16 +1200,12 @@ void s2s_create_region_handler(erpc::ReqHandle *req_handle, void *_context) {
     ServerRegion *region = new ServerRegion(c_req->region_id, c_req->start_key, c_req->end_key);
     region->region_status = RegionStatus::NotReady;
 
-    {
-        WriteGuard wl(s_ctx->region_map_lock);
-        s_ctx->region_map.insert(make_pair(c_req->region_id, region));
-    }    
+    s_ctx->region_table.insert(c_req->region_id, region);
 
     c_resp->region_id = c_req->region_id;
     c_resp->resp_type = RespType::kSuccess;
 
-    s_ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, CreateRegionResp_size);
-    s_ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+    enqueue_resp(s_ctx->rpc, req_handle, CreateRegionResp_size);
 }
 
 void s2s_send_region_handler(erpc::ReqHandle *req_handle, void *_context) {
@@ -559,10 +1216,10 @@ void s2s_send_region_handler(erpc::ReqHandle *req_handle, void *_context) {
 
     int32_t num_result = c_req->num_result;
     uint8_t *buf = c_req->entries;
-    MetaDb *mdb = s_ctx->metadb;
-    int qwert = 0;
+    // entry格式: pinode + fname + inode + stat, 整数字段不一定对齐
     while(num_result--) {
-        metafs_inode_t pinode = (metafs_inode_t)*buf;
+        metafs_inode_t pinode;
+        memcpy(&pinode, buf, metafs_inode_size);
         buf += metafs_inode_size;
 
         char *fname = (char*)buf;
@@ -571,29 +1228,26 @@ void s2s_send_region_handler(erpc::ReqHandle *req_handle, void *_context) {
         SliceInit(&fname_slice, fname_len, fname);
         buf += fname_len;
 
-        metafs_inode_t inode = (metafs_inode_t)*buf;
+        metafs_inode_t inode;
+        memcpy(&inode, buf, metafs_inode_size);
         buf += metafs_inode_size;
 
-        p_info("#%d build region: pinode:%llx, fname:%s, inode:%llx", qwert++, pinode, fname, inode);
-        
         MetaKvSlice stat_slice;
-        metafs_stat_t stat;
-        SliceInit(&stat_slice, metafs_stat_size, (char*)&stat);
+        SliceInit(&stat_slice, metafs_stat_size, (char*)buf);
+        buf += metafs_stat_size;
         // put into kv
-        MetaKvStatus status = InsertFileInode(mdb, pinode, &fname_slice, inode);
-        if (likely(check_status_ok(status))) {
-            status = InsertStat(mdb, inode, &stat_slice);
-        }
+        insert_dentry(s_ctx, pinode, &fname_slice, inode, &stat_slice);
     }
 
-    ServerRegion *region;
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
+    p_assert(region != nullptr, "region should not be null");
     
     region->kv_num += c_req->num_result; 
 
+    // 迁入的目录记录到本线程的pinode_table, 之后本server再分裂时可以找到
+    s_ctx->pinode_table.insert(c_req->pinode_hash, c_req->pinode);
+
     c_resp->resp_type = RespType::kSuccess;
     c_resp->is_uncomplete = c_req->is_uncomplete;
     c_resp->region_id = c_req->region_id;
@@ -601,8 +1255,7 @@ void s2s_send_region_handler(erpc::ReqHandle *req_handle, void *_context) {
     c_resp->pinode = c_req->pinode;
     c_resp->offset = c_req->offset;
     p_info("build region---------");
-    s_ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, SendRegionReq_size);
-    s_ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+    enqueue_resp(s_ctx->rpc, req_handle, SendRegionResp_size);
 }
 
 // XXX: 在replay日志时, 对于delete操作会将kv_num--,对于put操作会将kv_num++,会造成计数不准确
@@ -613,20 +1266,17 @@ const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
 
     int32_t num_logs = c_req->num_logs;
     uint8_t *buf = c_req->entries;
-    MetaDb *mdb = s_ctx->metadb;
-    ServerRegion *region;
-
-    {
-        ReadGuard rl(s_ctx->region_map_lock);
-        region = s_ctx->region_map[c_req->region_id];
-    }
+    EpochGuard eg;
+    ServerRegion *region = s_ctx->region_table.find(c_req->region_id);
+    p_assert(region != nullptr, "region should not be null");
 
     // entry中每条log格式:
-      // put_log格式: pinode(PUT(1)/DELETE(0)嵌入inode次高位) + inode + metafs_stat + fname(end with '\0)
+      // put_log格式: pinode(PUT(1)/DELETE(0)嵌入inode次高位) + inode + metafs_stat + only_update_stat(1B) + fname(end with '\0)
       // delete log格式: pinode(PUT(1)/DELETE(0)嵌入inode次高位) + fname(end with '\0)
 
     while(num_logs--) {
-        metafs_inode_t pinode = (metafs_inode_t)*buf;
+        metafs_inode_t pinode;
+        memcpy(&pinode, buf, metafs_inode_size);
         bool is_delete_op = (pinode & inode_prefix_ssb) == 0;
         pinode &= ~inode_prefix_ssb;
         buf += metafs_inode_size;
@@ -639,19 +1289,21 @@ const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
             buf += fname_len;
 
             metafs_inode_t inode;
-            MetaKvStatus status = DeleteFileInode(mdb, pinode, &fname_slice, &inode);
-            if (likely(check_status_ok(status))) {
-                status = DeleteStat(mdb, inode);
-            }
+            MetaKvStatus status = remove_dentry(s_ctx, pinode, &fname_slice, &inode);
             // region中kv数减1
             region->kv_num--;
+            if(check_status_ok(status) && is_directory(inode)) {
+                s_ctx->pinode_table.erase(get_pinode_hash(inode), inode);
+            }
         } else { // is put op
-            metafs_inode_t inode = (metafs_inode_t)*buf;
+            metafs_inode_t inode;
+            memcpy(&inode, buf, metafs_inode_size);
             buf += metafs_inode_size;
 
             MetaKvSlice stat_slice;
             SliceInit(&stat_slice, metafs_stat_size, (char*)buf);
             buf += metafs_stat_size;
+            buf += sizeof(bool); // only_update_stat
 
             char *fname = (char*)buf;
             size_t fname_len = strlen(fname) + 1;
@@ -660,11 +1312,12 @@ const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
             buf += fname_len;
 
             // put into kv
-            MetaKvStatus status = InsertFileInode(mdb, pinode, &fname_slice, inode);
-            if (likely(check_status_ok(status))) {
-                status = InsertStat(mdb, inode, &stat_slice);
-            }
+            insert_dentry(s_ctx, pinode, &fname_slice, inode, &stat_slice);
             region->kv_num++;
+            // 迁移期间新建的目录, 只记录属于本region的
+            if(is_directory(inode) && check_is_blong_to_region(region, get_pinode_hash(inode))) {
+                s_ctx->pinode_table.insert(get_pinode_hash(inode), inode);
+            }
         }
     }
 
@@ -677,8 +1330,7 @@ const erpc::MsgBuffer *req_msgbuf = req_handle->get_req_msgbuf();
     c_resp->region_id = c_req->region_id;
     c_resp->next_log_id = c_req->next_log_id;
     
-    s_ctx->rpc->resize_msg_buffer(&req_handle->pre_resp_msgbuf_, SendRegionLogResp_size);
-    s_ctx->rpc->enqueue_response(req_handle, &req_handle->pre_resp_msgbuf_);
+    enqueue_resp(s_ctx->rpc, req_handle, SendRegionLogResp_size);
 }
 
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+// test下benchmark共用的辅助函数, 只包含头文件
+// create_files: 在挂载目录下准备测试文件
+// wait_all / wait_arrived: 工作线程与计时的主线程之间按阶段同步
+#pragma once
+
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <string>
+#include <thread>
+#include <atomic>
+
+// 在dir下创建prefix0 ~ prefix{num_files-1}, dir已存在时认为文件已经创建过
+static inline int create_files(const std::string &dir, const char *prefix, int num_files) {
+    if(mkdir(dir.c_str(), S_IRWXU | S_IRWXG | S_IRWXO) != 0) {
+        if(errno == EEXIST) {
+            return 0;
+        }
+        std::cerr << "mkdir " << dir << " fail: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    for(int i = 0; i < num_files; i++) {
+        std::string path = dir + "/" + prefix + std::to_string(i);
+        int fd = open(path.c_str(), O_CREAT | O_WRONLY, S_IRWXU);
+        if(fd < 0) {
+            std::cerr << "create " << path << " fail: " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+inline std::atomic<int> ready_threads(0);
+inline std::atomic<int> failed_ops(0);
+
+// 所有线程到达后再开始下一阶段, 保证各线程同时执行同一阶段; phase从1开始递增
+static inline void wait_all(int num_threads, int phase) {
+    ready_threads++;
+    while(ready_threads.load() < num_threads * phase) {
+        std::this_thread::yield();
+    }
+}
+
+// 主线程只负责计时: 等待num_threads个线程都进入过第phase次wait_all
+static inline void wait_arrived(int num_threads, int phase) {
+    while(ready_threads.load() < num_threads * phase) {
+        std::this_thread::yield();
+    }
+}
@@ -0,0 +1,78 @@
+/* Microbenchmark for server reader-writer locks
+ *
+ * Compare RWLock (mutex + condition variables) with the reader-biased BRLock at 1..max_threads threads.
+ * Every thread takes ReadGuard around a small read of shared data; one in write_every ops takes WriteGuard instead
+ * (0 = read only), the pattern of read_region_map_handler vs region split on global_region_map_rwlock.
+ *
+ * build: g++ -O2 -std=c++17 -I../include brlock_bench.cc -o brlock_bench -lpthread
+ * run:   ./brlock_bench [ops_per_thread] [write_every] [max_threads]
+ */
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "util/rwlock.h"
+#include "util/brlock.h"
+
+using namespace metafs;
+
+static uint64_t shared_data[8];
+static volatile uint64_t sink;
+
+template <typename Lock>
+static double run(Lock &lock, int num_threads, long ops, long write_every) {
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t]() {
+            ready++;
+            while(!go.load()) {
+            }
+            uint64_t sum = 0;
+            for(long i = 0; i < ops; i++) {
+                if(write_every != 0 && (i + t) % write_every == 0) {
+                    WriteGuard wl(lock);
+                    shared_data[i & 7]++;
+                } else {
+                    ReadGuard rl(lock);
+                    sum += shared_data[i & 7];
+                }
+            }
+            sink = sum;
+        });
+    }
+    while(ready.load() < num_threads) {
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for(auto &t : threads) {
+        t.join();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return num_threads * ops / secs / 1e6;
+}
+
+int main(int argc, char **argv) {
+    long ops = argc > 1 ? atol(argv[1]) : 1000000;
+    long write_every = argc > 2 ? atol(argv[2]) : 0;
+    int max_threads = argc > 3 ? atoi(argv[3]) : 64;
+    printf("ops_per_thread: %ld, write_every: %ld, hardware threads: %u\n",
+        ops, write_every, std::thread::hardware_concurrency());
+    printf("%8s %14s %14s %16s %16s %14s\n", "threads", "RWLock Mops/s", "BRLock Mops/s",
+        "read_contended", "write_contended", "write_drain");
+
+    for(int n = 1; n <= max_threads; n *= 2) {
+        RWLock rw;
+        BRLock br;
+        double rw_mops = run(rw, n, ops, write_every);
+        double br_mops = run(br, n, ops, write_every);
+        BRLock::Stats st = br.stats();
+        printf("%8d %14.2f %14.2f %16lu %16lu %14lu\n", n, rw_mops, br_mops,
+            st.read_contended, st.write_contended, st.write_drain);
+    }
+    return 0;
+}
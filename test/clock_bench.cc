@@ -0,0 +1,80 @@
+/* Microbenchmark for metadata timestamp sources
+ *
+ * Per-op cost of gettimeofday, time, clock_gettime(CLOCK_REALTIME / CLOCK_REALTIME_COARSE),
+ * rdtsc and CoarseClock::now() after the clock is driven by refresh() (as in the server event loop).
+ * With num_threads > 1 every thread also calls refresh() every 64 reads, like several server threads do.
+ *
+ * build: g++ -O2 -std=c++17 -I../include clock_bench.cc -o clock_bench -lpthread
+ * run:   ./clock_bench [num_ops] [num_threads]
+ */
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <sys/time.h>
+
+#include "common/common.h"
+#include "util/coarse_clock.h"
+
+using namespace metafs;
+
+static volatile uint64_t sink;
+
+template <typename F>
+static double bench(const char *name, long num_ops, int num_threads, F f) {
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for(int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&]() {
+            uint64_t sum = 0;
+            for(long i = 0; i < num_ops; i++) {
+                sum += f(i);
+            }
+            sink = sum;
+        });
+    }
+    for(auto &t : threads) {
+        t.join();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / num_ops;
+    printf("%-32s %8.2f ns/op\n", name, ns);
+    return ns;
+}
+
+int main(int argc, char **argv) {
+    long num_ops = argc > 1 ? atol(argv[1]) : 10000000;
+    int num_threads = argc > 2 ? atoi(argv[2]) : 1;
+    printf("num_ops: %ld, num_threads: %d\n", num_ops, num_threads);
+
+    double base = bench("gettimeofday", num_ops, num_threads, [](long) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (uint64_t)tv.tv_sec;
+    });
+    bench("time", num_ops, num_threads, [](long) {
+        return (uint64_t)time(NULL);
+    });
+    bench("clock_gettime(REALTIME)", num_ops, num_threads, [](long) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return (uint64_t)ts.tv_sec;
+    });
+    bench("clock_gettime(REALTIME_COARSE)", num_ops, num_threads, [](long) {
+        return CoarseClock::read_ms();
+    });
+    bench("rdtsc", num_ops, num_threads, [](long) {
+        return (uint64_t)rdtsc();
+    });
+
+    CoarseClock::refresh();
+    double coarse = bench("CoarseClock::now", num_ops, num_threads, [](long i) {
+        if((i & 63) == 0) {
+            CoarseClock::refresh();
+        }
+        return (uint64_t)CoarseClock::now();
+    });
+    printf("CoarseClock::now speedup over gettimeofday: %.1fx\n", base / coarse);
+    return 0;
+}
@@ -0,0 +1,137 @@
+/* Test ClockCache (util/clock_cache.h)
+ *
+ * Uses one shard with 16 slots (12 entries at most) so probe chains wrap around the end of the slot array.
+ * Erase (erase_at) must shift later entries of the same probe chain back without losing any of them,
+ * and a full shard must evict (evict_one) an entry whose CLOCK bit is not set.
+ * A fixed-seed random run checks Put/Get/Erase against std::map.
+ *
+ * build: g++ -O2 -std=c++17 -I../include clock_cache_test.cc -o clock_cache_test
+ * run:   ./clock_cache_test
+ */
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <random>
+
+#include "util/clock_cache.h"
+
+using namespace metafs;
+
+typedef ClockCache<uint64_t, NullLock> Cache;
+
+static const size_t kCapacity = 12;
+
+static Cache *new_cache() {
+    // 1个分片, 16个槽位(每个槽位32B)
+    Cache *cache = new Cache(16 * 32, 1);
+    assert(cache->Capacity() == kCapacity);
+    return cache;
+}
+
+static bool contains(Cache *cache, uint64_t key) {
+    uint64_t value;
+    return cache->Get(1, key, 0, &value) && value == key * 10;
+}
+
+static void test_erase_backward_shift() {
+    // 每次删除不同位置的条目, 剩下的条目都要能找到
+    for(uint64_t victim = 0; victim < kCapacity; victim++) {
+        Cache *cache = new_cache();
+        for(uint64_t k = 0; k < kCapacity; k++) {
+            cache->Put(1, k, 0, k * 10);
+        }
+        assert(cache->GetStats().entries == kCapacity);
+        assert(cache->Erase(1, victim, 0));
+        assert(!cache->Erase(1, victim, 0));
+        for(uint64_t k = 0; k < kCapacity; k++) {
+            assert(contains(cache, k) == (k != victim));
+        }
+        assert(cache->GetStats().entries == kCapacity - 1);
+        assert(cache->GetStats().evictions == 0);
+        delete cache;
+    }
+}
+
+static void test_evict_unreferenced() {
+    Cache *cache = new_cache();
+    for(uint64_t k = 0; k < kCapacity; k++) {
+        cache->Put(1, k, 0, k * 10);
+    }
+    // 前一半被访问过, 设置了CLOCK访问位
+    for(uint64_t k = 0; k < kCapacity / 2; k++) {
+        assert(contains(cache, k));
+    }
+    cache->Put(1, 100, 0, 1000);
+    Cache::Stats stats = cache->GetStats();
+    assert(stats.evictions == 1);
+    assert(stats.entries == kCapacity);
+    for(uint64_t k = 0; k < kCapacity / 2; k++) {
+        assert(contains(cache, k));
+    }
+    int missing = 0;
+    for(uint64_t k = kCapacity / 2; k < kCapacity; k++) {
+        missing += contains(cache, k) ? 0 : 1;
+    }
+    assert(missing == 1);
+    assert(contains(cache, 100));
+
+    // 持续插入时条目数不超过容量, 淘汰后的表仍然可以正确查找
+    for(uint64_t k = 200; k < 400; k++) {
+        cache->Put(1, k, 0, k * 10);
+        assert(contains(cache, k));
+        assert(cache->GetStats().entries == kCapacity);
+    }
+    delete cache;
+}
+
+static void test_random_against_map() {
+    Cache *cache = new_cache();
+    std::map<uint64_t, uint64_t> ref; // 可能已被淘汰, 只能用来验证命中的值
+    std::mt19937_64 rng(20240601);
+    for(int round = 0; round < 100000; round++) {
+        uint64_t key = rng() % 32;
+        switch(rng() % 3) {
+            case 0: {
+                uint64_t value = rng();
+                cache->Put(1, key, 0, value);
+                ref[key] = value;
+                uint64_t got;
+                assert(cache->Get(1, key, 0, &got) && got == value);
+                break;
+            }
+            case 1: {
+                uint64_t got;
+                if(cache->Get(1, key, 0, &got)) {
+                    assert(ref.count(key) == 1 && ref[key] == got);
+                }
+                break;
+            }
+            default: {
+                bool erased = cache->Erase(1, key, 0);
+                assert(!erased || ref.count(key) == 1);
+                ref.erase(key);
+                break;
+            }
+        }
+        assert(cache->GetStats().entries <= kCapacity);
+    }
+    delete cache;
+
+    // 指纹不同视为不同的key
+    cache = new_cache();
+    cache->Put(1, 7, 1, 70);
+    cache->Put(1, 7, 2, 71);
+    uint64_t got;
+    assert(cache->Get(1, 7, 1, &got) && got == 70);
+    assert(cache->Get(1, 7, 2, &got) && got == 71);
+    delete cache;
+}
+
+int main() {
+    test_erase_backward_shift();
+    test_evict_unreferenced();
+    test_random_against_map();
+    std::cout << "clock cache test pass" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+/* getdents benchmark
+ *
+ * Creates num_files files in one directory under the mount dir (skipped if the directory already exists),
+ * then lists it num_rounds times with raw getdents64 calls and reports entries/s of the listing.
+ *
+ * build: g++ -O2 -std=c++17 getdents_bench.cc -o getdents_bench
+ * run:   LD_PRELOAD=libmetafs_client.so ./getdents_bench [num_files] [num_rounds] [mount_dir] [buf_size]
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "bench_util.h"
+
+// 只遍历d_reclen, 不依赖d_name之外的字段
+struct bench_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+// 返回读到的entry数(包括.和..), 失败返回-1
+static long list_dir(const std::string &dir, std::vector<char> &buf) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if(fd < 0) {
+        std::cerr << "open " << dir << " fail: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    long entries = 0;
+    while(true) {
+        long n = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+        if(n < 0) {
+            std::cerr << "getdents64 fail: " << std::strerror(errno) << std::endl;
+            entries = -1;
+            break;
+        }
+        if(n == 0) {
+            break;
+        }
+        for(long off = 0; off < n; ) {
+            auto *de = reinterpret_cast<bench_dirent64 *>(buf.data() + off);
+            off += de->d_reclen;
+            entries++;
+        }
+    }
+    close(fd);
+    return entries;
+}
+
+int main(int argc, char* argv[]) {
+    int num_files = argc > 1 ? atoi(argv[1]) : 100000;
+    int num_rounds = argc > 2 ? atoi(argv[2]) : 10;
+    std::string mntdir = argc > 3 ? argv[3] : "/tmp/metafs";
+    size_t buf_size = argc > 4 ? atol(argv[4]) : 32768;
+    std::string dir = mntdir + "/getdents_bench_" + std::to_string(num_files);
+
+    auto start = std::chrono::steady_clock::now();
+    if(create_files(dir, "f", num_files) != 0) {
+        return EXIT_FAILURE;
+    }
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "prepare: " << num_files << " files, " << sec << " s" << std::endl;
+
+    std::vector<char> buf(buf_size);
+    uint64_t total = 0;
+    start = std::chrono::steady_clock::now();
+    for(int r = 0; r < num_rounds; r++) {
+        long n = list_dir(dir, buf);
+        if(n < 0) {
+            return EXIT_FAILURE;
+        }
+        if(n < num_files) {
+            std::cerr << "round " << r << " listed " << n << " entries, expect >= " << num_files << std::endl;
+            return EXIT_FAILURE;
+        }
+        total += n;
+    }
+    sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "getdents64: " << num_rounds << " rounds, " << total << " entries, "
+              << sec << " s, " << total / sec << " entries/s" << std::endl;
+    return 0;
+}
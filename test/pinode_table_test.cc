@@ -0,0 +1,140 @@
+/* Test PinodeTable (server/pinode_table.h)
+ *
+ * lower_bound has to walk forward across empty shards and stop at end_hash (also at the last shard),
+ * erase_range has to remove exactly [start_hash, end_hash] when the range starts and ends in the middle of
+ * a shard / bucket. A fixed-seed random run checks both against std::set.
+ *
+ * build: g++ -O2 -std=c++17 -I../include pinode_table_test.cc -o pinode_table_test
+ * run:   ./pinode_table_test
+ */
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <set>
+#include <random>
+#include <utility>
+
+#include "server/pinode_table.h"
+
+using namespace metafs;
+
+// 分片为hash高6位, 桶为之后8位
+static uint64_t make_hash(uint64_t shard, uint64_t bucket, uint64_t low) {
+    return (shard << 58) | (bucket << 50) | low;
+}
+
+static void test_lower_bound_across_shards() {
+    PinodeTable table;
+    uint64_t h3 = make_hash(3, 7, 100);
+    uint64_t h40 = make_hash(40, 0, 5);
+    uint64_t h63 = make_hash(63, 255, 9);
+    assert(table.insert(h3, 1));
+    assert(table.insert(h3, 2));
+    assert(!table.insert(h3, 2));
+    assert(table.insert(h40, 3));
+    assert(table.insert(h63, 4));
+    assert(table.size() == 4);
+
+    PinodeTable::Entry e;
+    // 同一hash按pinode有序
+    assert(table.lower_bound(h3, 0, UINT64_MAX, &e) && e.hash == h3 && e.pinode == 1);
+    assert(table.lower_bound(h3, 2, UINT64_MAX, &e) && e.hash == h3 && e.pinode == 2);
+    // 跳过空分片4~39
+    assert(table.lower_bound(h3, 3, UINT64_MAX, &e) && e.hash == h40 && e.pinode == 3);
+    assert(table.lower_bound(make_hash(4, 0, 0), 0, UINT64_MAX, &e) && e.hash == h40);
+    // end_hash在下一个entry之前
+    assert(!table.lower_bound(make_hash(4, 0, 0), 0, h40 - 1, &e));
+    assert(table.lower_bound(make_hash(4, 0, 0), 0, h40, &e) && e.hash == h40);
+    // 最后一个分片之后结束, 不回绕
+    assert(table.lower_bound(h40, 4, UINT64_MAX, &e) && e.hash == h63);
+    assert(!table.lower_bound(h63, 5, UINT64_MAX, &e));
+    assert(!table.lower_bound(UINT64_MAX, 0, UINT64_MAX, &e));
+
+    assert(table.erase(h40, 3));
+    assert(!table.erase(h40, 3));
+    assert(table.lower_bound(h3, 3, UINT64_MAX, &e) && e.hash == h63);
+    assert(table.size() == 3);
+}
+
+static void test_erase_range_partial_shards() {
+    PinodeTable table;
+    uint64_t hashes[] = {
+        make_hash(5, 0, 1), make_hash(5, 100, 1), make_hash(5, 100, 50), make_hash(5, 255, 7),
+        make_hash(6, 0, 0), make_hash(6, 10, 3),
+        make_hash(7, 100, 0), make_hash(7, 100, 1), make_hash(7, 200, 0),
+    };
+    for(uint64_t h : hashes) {
+        assert(table.insert(h, h & 0xff));
+    }
+
+    // 从分片5桶100的中间到分片7桶100的中间
+    uint64_t start = make_hash(5, 100, 10);
+    uint64_t end = make_hash(7, 100, 0);
+    assert(table.erase_range(start, end) == 5);
+    assert(table.size() == 4);
+
+    PinodeTable::Entry e;
+    assert(table.lower_bound(0, 0, UINT64_MAX, &e) && e.hash == make_hash(5, 0, 1));
+    assert(table.lower_bound(make_hash(5, 0, 2), 0, UINT64_MAX, &e) && e.hash == make_hash(5, 100, 1));
+    assert(table.lower_bound(make_hash(5, 100, 2), 0, UINT64_MAX, &e) && e.hash == make_hash(7, 100, 1));
+    assert(table.lower_bound(make_hash(7, 100, 2), 0, UINT64_MAX, &e) && e.hash == make_hash(7, 200, 0));
+
+    // 区间内没有entry
+    assert(table.erase_range(make_hash(8, 0, 0), make_hash(60, 0, 0)) == 0);
+    assert(table.erase_range(0, UINT64_MAX) == 4);
+    assert(table.size() == 0);
+}
+
+static void test_random_against_set() {
+    PinodeTable table;
+    std::set<std::pair<uint64_t, metafs_inode_t>> ref;
+    std::mt19937_64 rng(20240601);
+    // hash集中在少数分片和桶内, 让区间操作经常跨分片且落在桶中间
+    auto rand_hash = [&rng]() {
+        return make_hash(rng() % 8, rng() % 4, rng() % 64);
+    };
+
+    for(int round = 0; round < 20000; round++) {
+        uint64_t h = rand_hash();
+        metafs_inode_t pinode = rng() % 4;
+        switch(rng() % 4) {
+            case 0:
+            case 1:
+                assert(table.insert(h, pinode) == ref.insert({h, pinode}).second);
+                break;
+            case 2:
+                assert(table.erase(h, pinode) == (ref.erase({h, pinode}) == 1));
+                break;
+            default: {
+                uint64_t end = rand_hash();
+                if(end < h) {
+                    std::swap(h, end);
+                }
+                if(rng() % 8 == 0) {
+                    size_t n = 0;
+                    for(auto iter = ref.lower_bound({h, 0}); iter != ref.end() && iter->first <= end; ) {
+                        iter = ref.erase(iter);
+                        n++;
+                    }
+                    assert(table.erase_range(h, end) == n);
+                } else {
+                    PinodeTable::Entry e;
+                    auto iter = ref.lower_bound({h, pinode});
+                    bool expect = iter != ref.end() && iter->first <= end;
+                    assert(table.lower_bound(h, pinode, end, &e) == expect);
+                    assert(!expect || (e.hash == iter->first && e.pinode == iter->second));
+                }
+                break;
+            }
+        }
+    }
+    assert(table.size() == ref.size());
+}
+
+int main() {
+    test_lower_bound_across_shards();
+    test_erase_range_partial_shards();
+    test_random_against_set();
+    std::cout << "pinode table test pass" << std::endl;
+    return 0;
+}
@@ -0,0 +1,85 @@
+/* Microbenchmark for client region lookup
+ *
+ * Compare the old linear scan over the sorted region map with the flat
+ * RegionRouteTable (binary search + cached session index).
+ *
+ * build: g++ -O2 -std=c++17 -I../include -I../thirdparty region_route_bench.cc -o region_route_bench
+ */
+#include <iostream>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "client/region_route.h"
+
+using namespace metafs;
+
+struct region_cmp_func {
+    bool operator()(const ClientRegion &lhs, const ClientRegion &rhs) const {
+        return lhs.end_key.hi < rhs.start_key.hi;
+    }
+};
+
+typedef std::map<ClientRegion, region_id_t, region_cmp_func> region_map_t;
+
+// the lookup used by the client before RegionRouteTable
+static region_id_t linear_find_region_id(const region_map_t &region_map, uint64_t hash) {
+    for(auto iter = region_map.begin(); iter != region_map.end(); iter++) {
+        if(hash >= iter->first.start_key.hi && hash <= iter->first.end_key.hi) {
+            return iter->second;
+        }
+    }
+    return -1;
+}
+
+static inline uint64_t next_rand(uint64_t &x) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+int main(int argc, char* argv[]) {
+    const int32_t total_servers = 16;
+    const int nregions[] = {10, 1000, 100000};
+
+    for(int n : nregions) {
+        std::vector<ClientRegion> regions;
+        region_map_t region_map;
+        for(int i = 0; i < n; i++) {
+            RegionKey skey, ekey;
+            get_init_region_range(i, n, skey, ekey);
+            regions.push_back(ClientRegion(i, skey, ekey));
+            region_map.insert(std::make_pair(ClientRegion(i, skey, ekey), i));
+        }
+        RegionRouteTable table(regions, total_servers);
+
+        // keep the linear scan run short for large maps
+        const uint64_t table_ops = 10000000;
+        const uint64_t linear_ops = std::max<uint64_t>(10000, table_ops / n * 10);
+        uint64_t seed = 88172645463325252ULL;
+        uint64_t checksum = 0;
+
+        auto t0 = std::chrono::steady_clock::now();
+        for(uint64_t i = 0; i < linear_ops; i++) {
+            checksum += linear_find_region_id(region_map, next_rand(seed));
+        }
+        auto t1 = std::chrono::steady_clock::now();
+
+        seed = 88172645463325252ULL;
+        for(uint64_t i = 0; i < table_ops; i++) {
+            const RegionRoute *route = table.find(next_rand(seed));
+            checksum += route->region_id + route->session_idx;
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        double linear_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / linear_ops;
+        double table_ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / table_ops;
+        std::cout << "regions: " << n
+                  << "\tlinear scan: " << linear_ns << " ns/op"
+                  << "\troute table: " << table_ns << " ns/op"
+                  << "\t(checksum " << checksum << ")" << std::endl;
+    }
+    return 0;
+}
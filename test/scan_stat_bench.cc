@@ -0,0 +1,107 @@
+/* Stat latency under concurrent directory scans
+ *
+ * Creates big_files files in one directory and hot_files files in another under the mount dir
+ * (each skipped if the directory already exists). Then it stats the hot files round-robin num_ops times,
+ * first alone and then while scan_threads threads keep listing the big directory with readdir,
+ * and reports the stat p50 / p99 / max latency of both phases.
+ * Used to compare server_bg_threads = 0 (readdir runs on the server's eRPC thread) with > 0 (background workers);
+ * set server_fg_threads to 1 in server.json so stat and readdir share one server thread,
+ * client_threads in client.json >= scan_threads + 1 and attr_timeout_ms = 0 so every stat reaches the server.
+ *
+ * build: g++ -O2 -std=c++17 -pthread scan_stat_bench.cc -o scan_stat_bench
+ * run:   LD_PRELOAD=libmetafs_client.so ./scan_stat_bench [big_files] [hot_files] [num_ops] [scan_threads] [mount_dir]
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <cstring>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "bench_util.h"
+
+static std::atomic<bool> scanning(false);
+static std::atomic<long> scanned_entries(0);
+
+static void scan_loop(std::string dir) {
+    while(scanning.load()) {
+        DIR *dp = opendir(dir.c_str());
+        if(dp == NULL) {
+            std::cerr << "opendir " << dir << " fail: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        long n = 0;
+        while(readdir(dp) != NULL) {
+            n++;
+        }
+        closedir(dp);
+        scanned_entries += n;
+    }
+}
+
+static int run_stats(const std::vector<std::string> &paths, long num_ops, const char *phase) {
+    std::vector<uint32_t> lat_ns(num_ops);
+    struct stat st;
+    for(long i = 0; i < num_ops; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        if(stat(paths[i % paths.size()].c_str(), &st) != 0) {
+            std::cerr << "stat " << paths[i % paths.size()] << " fail: " << std::strerror(errno) << std::endl;
+            return -1;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        lat_ns[i] = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+    }
+    std::sort(lat_ns.begin(), lat_ns.end());
+    std::cout << phase << ": stat p50 " << lat_ns[num_ops / 2] / 1000.0 << " us"
+              << ", p99 " << lat_ns[num_ops * 99 / 100] / 1000.0 << " us"
+              << ", max " << lat_ns[num_ops - 1] / 1000.0 << " us" << std::endl;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int big_files = argc > 1 ? atoi(argv[1]) : 1000000;
+    int hot_files = argc > 2 ? atoi(argv[2]) : 1024;
+    long num_ops = argc > 3 ? atol(argv[3]) : 200000;
+    int scan_threads = argc > 4 ? atoi(argv[4]) : 1;
+    std::string mntdir = argc > 5 ? argv[5] : "/tmp/metafs";
+    std::string big_dir = mntdir + "/scan_stat_bench_big";
+    std::string hot_dir = mntdir + "/scan_stat_bench_hot";
+    std::cout << "big_files: " << big_files << ", hot_files: " << hot_files << ", num_ops: " << num_ops
+              << ", scan_threads: " << scan_threads << std::endl;
+
+    if(create_files(big_dir, "b", big_files) != 0 || create_files(hot_dir, "h", hot_files) != 0) {
+        return 1;
+    }
+    std::vector<std::string> paths(hot_files);
+    for(int i = 0; i < hot_files; i++) {
+        paths[i] = hot_dir + "/h" + std::to_string(i);
+    }
+
+    // 预热, 不计时
+    if(run_stats(paths, hot_files, "warmup") != 0 || run_stats(paths, num_ops, "idle") != 0) {
+        return 1;
+    }
+
+    scanning = true;
+    std::vector<std::thread> threads;
+    for(int i = 0; i < scan_threads; i++) {
+        threads.emplace_back(scan_loop, big_dir);
+    }
+    auto start = std::chrono::steady_clock::now();
+    int ret = run_stats(paths, num_ops, "scanning");
+    scanning = false;
+    for(auto &t : threads) {
+        t.join();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "scan: " << (long)(scanned_entries.load() / secs) << " entries/s" << std::endl;
+    return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+/* Test region split with non-empty directories
+ *
+ * Creates num_dirs directories with files_per_dir files each under /tmp/metafs/split, so that regions holding
+ * more than region_split_threshold (200000) entries split and migrate whole directories to other servers.
+ * A second batch of files is created while the split may still be in progress (migrated through the region log).
+ * Afterwards every file must still be stat-able with its mode, every directory must list all of its files,
+ * and unlink / rmdir must work on the migrated directories.
+ *
+ * build: g++ -O2 -std=c++17 split_test.cc -o split_test
+ * run:   LD_PRELOAD=... ./split_test [num_dirs] [files_per_dir]
+ */
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdlib>
+#include <sys/types.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cassert>
+#include <string>
+
+static const std::string mntdir = "/tmp/metafs";
+static const std::string topdir = mntdir + "/split";
+
+static std::string dir_path(int d) {
+    return topdir + "/dir_" + std::to_string(d);
+}
+
+static std::string file_path(int d, int f) {
+    return dir_path(d) + "/file_" + std::to_string(f);
+}
+
+static void create_files(int num_dirs, int start, int end) {
+    for(int d = 0; d < num_dirs; d++) {
+        for(int f = start; f < end; f++) {
+            int fd = open(file_path(d, f).c_str(), O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
+            if(fd < 0) {
+                std::cerr << "ERROR: create " << file_path(d, f) << " fail: " << std::strerror(errno) << std::endl;
+                exit(-1);
+            }
+            close(fd);
+        }
+    }
+}
+
+static int count_entries(const std::string &dir) {
+    DIR *dirstream = opendir(dir.c_str());
+    assert(dirstream != NULL);
+    int n = 0;
+    struct dirent *d;
+    while((d = readdir(dirstream)) != NULL) {
+        if(strcmp(d->d_name, ".") != 0 && strcmp(d->d_name, "..") != 0) {
+            n++;
+        }
+    }
+    closedir(dirstream);
+    return n;
+}
+
+int main(int argc, char* argv[]) {
+    int num_dirs = argc > 1 ? atoi(argv[1]) : 64;
+    int files_per_dir = argc > 2 ? atoi(argv[2]) : 8000;
+    int first_batch = files_per_dir * 3 / 4;
+
+    int ret = mkdir(topdir.c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+    assert(ret == 0);
+    for(int d = 0; d < num_dirs; d++) {
+        ret = mkdir(dir_path(d).c_str(), S_IRWXU | S_IRWXG | S_IRWXO);
+        assert(ret == 0);
+    }
+
+    // 第一批文件使region超过分裂阈值, 第二批可能在迁移过程中写入
+    create_files(num_dirs, 0, first_batch);
+    create_files(num_dirs, first_batch, files_per_dir);
+
+    // 等待迁移结束
+    sleep(10);
+
+    struct stat st;
+    for(int d = 0; d < num_dirs; d++) {
+        ret = stat(dir_path(d).c_str(), &st);
+        assert(ret == 0 && S_ISDIR(st.st_mode));
+        for(int f = 0; f < files_per_dir; f++) {
+            ret = stat(file_path(d, f).c_str(), &st);
+            if(ret != 0 || !S_ISREG(st.st_mode)) {
+                std::cerr << "ERROR: stat " << file_path(d, f) << " fail after split: " << std::strerror(errno) << std::endl;
+                return -1;
+            }
+        }
+        int n = count_entries(dir_path(d));
+        if(n != files_per_dir) {
+            std::cerr << "ERROR: " << dir_path(d) << " has " << n << " entries, expect " << files_per_dir << std::endl;
+            return -1;
+        }
+    }
+
+    // 非空目录不能删除
+    ret = rmdir(dir_path(0).c_str());
+    assert(ret != 0 && errno == ENOTEMPTY);
+
+    for(int d = 0; d < num_dirs; d++) {
+        for(int f = 0; f < files_per_dir; f++) {
+            ret = unlink(file_path(d, f).c_str());
+            assert(ret == 0);
+        }
+        ret = stat(file_path(d, 0).c_str(), &st);
+        assert(ret != 0 && errno == ENOENT);
+        ret = rmdir(dir_path(d).c_str());
+        assert(ret == 0);
+    }
+    ret = rmdir(topdir.c_str());
+    assert(ret == 0);
+
+    std::cout << "split test pass" << std::endl;
+    return 0;
+}